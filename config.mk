@@ -4,12 +4,14 @@ BIN_DIR=$(PWD)/bin
 CC=g++ -std=c++11 -Wall -g
 CFLAGS=-I$(PWD)/deps/ssd1306/src
 # LIBS=-lmpg123 \
+# 	-lFLAC \
 # 	-lao \
 # 	-ltag \
 # 	-L../deps/ssd1306/bld \
 # 	-lssd1306 \
 # 	-lpthread
 LIBS=-lmpg123 \
+	-lFLAC \
 	-lao \
 	-ltag \
 	-L$(PWD)/deps/ssd1306/bld \
@@ -37,6 +39,13 @@ MAKE_TEST = \
 		-o $(addprefix $(BIN_DIR)/, ${@:.o=}) \
 		-L. -lzp3 $(LIBS)
 
+MAKE_BENCH = \
+	echo "BENCH [${@:.o=}]"; \
+	$(CC) $(CFLAGS) -c ${@:.o=.cpp} -o $@; \
+	$(CC) $(CFLAGS) $@ \
+		-o $(addprefix $(BIN_DIR)/, ${@:.o=}) \
+		-L. -lzp3 $(LIBS)
+
 MAKE_EXE = \
 	@echo "EXE [$@]"; \
 	$(CC) $(CFLAGS) $@.o \
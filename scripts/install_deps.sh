@@ -11,6 +11,7 @@ echo "Installing libopenjp2 ..." && $APT_INSTALL libopenjp2-*
 echo "Installing build essentials ..." && $APT_INSTALL build-essential 
 echo "Installing luma.oled ..." && sudo -H pip3 install --upgrade -q luma.oled
 echo "Installing libtag ..." && $APT_INSTALL libtag1-dev
+echo "Installing libFLAC ..." && $APT_INSTALL libflac-dev
 echo "Installing python-vlc ..." && $PIP_INSTALL python-vlc
 echo "Installing click ..." && $PIP_INSTALL click
 echo "Installing gpiozero ..." && $PIP_INSTALL gpiozero
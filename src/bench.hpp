@@ -0,0 +1,49 @@
+#ifndef ZP3_BENCH_HPP
+#define ZP3_BENCH_HPP
+
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "test.hpp"
+#include "util.hpp"
+
+#define BENCH_MUSIC_LIBRARY "/tmp/zp3_bench_library"
+
+#define RUN_BENCH(BENCH) \
+  printf("%sBENCH%s [%s]\n", KMAG, KNRM, #BENCH); \
+  fflush(stdout); \
+  BENCH();
+
+/**
+ * Create a synthetic music library at `dst` by copying every song in `src`
+ * `nb_copies` times. Returns number of songs created.
+ */
+inline size_t bench_make_library(const std::string &src,
+                                 const std::string &dst,
+                                 const size_t nb_copies) {
+  std::vector<std::string> file_list;
+  walkdir(src, file_list, "mp3");
+
+  std::string cmd = "rm -rf " + dst;
+  if (system(cmd.c_str()) != 0) {
+    return 0;
+  }
+
+  size_t nb_songs = 0;
+  for (size_t i = 0; i < nb_copies; i++) {
+    const std::string copy_dir = dst + "/copy" + std::to_string(i);
+    cmd = "mkdir -p " + copy_dir + " && cp -r " + src + "/* " + copy_dir;
+    if (system(cmd.c_str()) != 0) {
+      return nb_songs;
+    }
+    nb_songs += file_list.size();
+  }
+
+  return nb_songs;
+}
+
+#endif // ZP3_BENCH_HPP
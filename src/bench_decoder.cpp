@@ -0,0 +1,152 @@
+#include <FLAC/stream_encoder.h>
+
+#include "bench.hpp"
+#include "decoder.hpp"
+
+#define BENCH_WAV "/tmp/zp3_bench_decoder.wav"
+#define BENCH_FLAC "/tmp/zp3_bench_decoder.flac"
+
+static void put_le(std::string &buf, const uint32_t value, const int nb_bytes) {
+  for (int i = 0; i < nb_bytes; i++) {
+    buf += (char) ((value >> (8 * i)) & 0xff);
+  }
+}
+
+/**
+ * Decode the whole file at `path`, returns the PCM and sets the format.
+ */
+static std::vector<int16_t> bench_decode_file(const std::string &path,
+                                              long &rate,
+                                              int &channels) {
+  std::vector<int16_t> pcm;
+  reader_t reader;
+  decoder_t decoder;
+  if (reader_open(reader, path) != 0 || decoder_open(decoder, reader) != 0) {
+    reader_close(reader);
+    return pcm;
+  }
+  rate = decoder.rate;
+  channels = decoder.channels;
+
+  std::vector<unsigned char> block(decoder_block_size(decoder));
+  size_t done = 0;
+  while (decoder_read(decoder, block.data(), block.size(), done) == DECODER_OK) {
+    const int16_t *samples = (const int16_t *) block.data();
+    pcm.insert(pcm.end(), samples, samples + done / 2);
+  }
+  decoder_close(decoder);
+  reader_close(reader);
+
+  return pcm;
+}
+
+static void bench_write_wav(const std::string &path,
+                            const std::vector<int16_t> &pcm,
+                            const long rate,
+                            const int channels) {
+  const uint32_t data_size = pcm.size() * 2;
+  std::string wav = "RIFF";
+  put_le(wav, 4 + 8 + 16 + 8 + data_size, 4);
+  wav += "WAVEfmt ";
+  put_le(wav, 16, 4);
+  put_le(wav, 1, 2);
+  put_le(wav, channels, 2);
+  put_le(wav, rate, 4);
+  put_le(wav, rate * channels * 2, 4);
+  put_le(wav, channels * 2, 2);
+  put_le(wav, 16, 2);
+  wav += "data";
+  put_le(wav, data_size, 4);
+  wav.append((const char *) pcm.data(), data_size);
+
+  FILE *fp = fopen(path.c_str(), "wb");
+  fwrite(wav.data(), 1, wav.size(), fp);
+  fclose(fp);
+}
+
+static void bench_write_flac(const std::string &path,
+                             const std::vector<int16_t> &pcm,
+                             const long rate,
+                             const int channels) {
+  FLAC__StreamEncoder *encoder = FLAC__stream_encoder_new();
+  FLAC__stream_encoder_set_channels(encoder, channels);
+  FLAC__stream_encoder_set_bits_per_sample(encoder, 16);
+  FLAC__stream_encoder_set_sample_rate(encoder, rate);
+  FLAC__stream_encoder_set_compression_level(encoder, 5);
+  if (FLAC__stream_encoder_init_file(encoder, path.c_str(), NULL, NULL)
+      == FLAC__STREAM_ENCODER_INIT_STATUS_OK) {
+    std::vector<FLAC__int32> samples(pcm.begin(), pcm.end());
+    FLAC__stream_encoder_process_interleaved(encoder,
+                                             samples.data(),
+                                             samples.size() / channels);
+    FLAC__stream_encoder_finish(encoder);
+  }
+  FLAC__stream_encoder_delete(encoder);
+}
+
+static void bench_decoder_file(const std::string &path) {
+  const int nb_runs = 5;
+  float best = 0.0f;
+  size_t bytes = 0;
+  size_t file_size = 0;
+  float length = 0.0f;
+  int type = DECODER_NONE;
+
+  for (int i = 0; i < nb_runs; i++) {
+    reader_t reader;
+    decoder_t decoder;
+    if (reader_open(reader, path) != 0 || decoder_open(decoder, reader) != 0) {
+      reader_close(reader);
+      return;
+    }
+    music_seek_entry_t built;
+    decoder_index(decoder, nullptr, built);
+    type = decoder.type;
+    length = decoder_duration(decoder);
+    file_size = reader.size;
+
+    std::vector<unsigned char> block(decoder_block_size(decoder));
+    size_t done = 0;
+    bytes = 0;
+    struct timespec t = tic();
+    while (decoder_read(decoder, block.data(), block.size(), done) == DECODER_OK) {
+      bytes += done;
+    }
+    const float elapsed = toc(&t);
+    best = (i == 0) ? elapsed : std::min(best, elapsed);
+
+    decoder_close(decoder);
+    reader_close(reader);
+  }
+
+  printf("  %-6s  file: %6.2f MB  decode: %7.2f ms  %7.1f x realtime  %7.1f MB/s PCM\n",
+         decoder_name(type),
+         file_size / 1e6,
+         best * 1e3,
+         length / best,
+         bytes / 1e6 / best);
+}
+
+void bench_decoder_throughput() {
+  decoder_init();
+
+  // WAV and FLAC copies of the test song, so every backend decodes the same
+  // audio
+  long rate = 0;
+  int channels = 0;
+  const auto pcm = bench_decode_file(TEST_SONG, rate, channels);
+  if (pcm.size() == 0) {
+    return;
+  }
+  bench_write_wav(BENCH_WAV, pcm, rate, channels);
+  bench_write_flac(BENCH_FLAC, pcm, rate, channels);
+
+  bench_decoder_file(TEST_SONG);
+  bench_decoder_file(BENCH_FLAC);
+  bench_decoder_file(BENCH_WAV);
+}
+
+int main(int argc, char **argv) {
+  RUN_BENCH(bench_decoder_throughput);
+  return 0;
+}
@@ -0,0 +1,68 @@
+#include "bench.hpp"
+#include "display.hpp"
+
+void bench_display_menu_page() {
+  const int nb_frames = 1000;
+  display_t display;
+
+  std::vector<std::string> entries;
+  for (int i = 0; i < 12; i++) {
+    entries.push_back("Some Song Title " + std::to_string(i));
+  }
+  menu_init(display.menu, entries);
+
+  // Cold, every string is rasterised for every frame
+  struct timespec t = tic();
+  for (int i = 0; i < nb_frames; i++) {
+    text_cache_clear(display.text_cache);
+    display_menu(display, i % 12);
+  }
+  const float cold = toc(&t) * 1e3 / nb_frames;
+
+  // Warm, every string comes from the cache
+  t = tic();
+  for (int i = 0; i < nb_frames; i++) {
+    display_menu(display, i % 12);
+  }
+  const float warm = toc(&t) * 1e3 / nb_frames;
+
+  printf("  12 entry page  cold: %.3f ms  warm: %.3f ms\n", cold, warm);
+}
+
+void bench_display_songs_keypress() {
+  const int nb_keypresses = 1000;
+
+  for (const size_t nb_songs : {100, 50000}) {
+    music_t music;
+    {
+      songs_t songs;
+      for (size_t i = 0; i < nb_songs; i++) {
+        song_t song;
+        song.artist = "Artist Name " + std::to_string(i / 100);
+        song.album = "Album Name " + std::to_string(i / 10);
+        song.title = "Some Song Title " + std::to_string(i);
+        song.file_path = "/data/music/" + std::to_string(i) + ".mp3";
+        song.track_number = i % 10 + 1;
+        songs.push_back(song);
+      }
+      music_init(music, songs);
+    }
+    const auto view = music_filter_songs(music);
+
+    // Each keypress moves the selection down by one and redraws the list
+    display_t display;
+    struct timespec t = tic();
+    for (int i = 0; i < nb_keypresses; i++) {
+      display_show_songs(display, view, i % nb_songs);
+    }
+    const float elapsed = toc(&t) * 1e3 / nb_keypresses;
+
+    printf("  songs: %6zu  keypress to frame: %.3f ms\n", nb_songs, elapsed);
+  }
+}
+
+int main(int argc, char **argv) {
+  RUN_BENCH(bench_display_menu_page);
+  RUN_BENCH(bench_display_songs_keypress);
+  return 0;
+}
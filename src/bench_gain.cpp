@@ -0,0 +1,47 @@
+#include "bench.hpp"
+#include "gain.hpp"
+
+/**
+ * Samples per second through `gain_apply()` for one implementation, on
+ * decode sized blocks.
+ */
+static float bench_gain_rate(const int impl, const int16_t from, const int16_t to) {
+  const size_t block_size = 2304;
+  const size_t nb_blocks = 20000;
+  std::vector<int16_t> samples(block_size);
+  for (size_t i = 0; i < block_size; i++) {
+    samples[i] = (rand() % 65536) - 32768;
+  }
+
+  gain_t gain;
+  gain.impl = impl;
+  struct timespec t = tic();
+  for (size_t i = 0; i < nb_blocks; i++) {
+    // Alternate so every block ramps
+    const int16_t target = (i % 2 == 0) ? to : from;
+    gain_apply(gain, samples.data(), samples.size(), target);
+  }
+  const float elapsed = toc(&t);
+
+  return block_size * nb_blocks / elapsed;
+}
+
+void bench_gain_apply() {
+  const int impls[3] = {GAIN_SCALAR, GAIN_SSE2, GAIN_NEON};
+  for (const auto impl : impls) {
+    if (gain_has_impl(impl) == false) {
+      continue;
+    }
+    const float attenuate = bench_gain_rate(impl, GAIN_UNITY / 4, GAIN_UNITY / 2);
+    const float boost = bench_gain_rate(impl, GAIN_UNITY, 2 * GAIN_UNITY);
+    printf("  %-6s  volume: %8.1f Msamples/s  boost + soft clip: %8.1f Msamples/s\n",
+           gain_impl_name(impl),
+           attenuate / 1e6,
+           boost / 1e6);
+  }
+}
+
+int main(int argc, char **argv) {
+  RUN_BENCH(bench_gain_apply);
+  return 0;
+}
@@ -0,0 +1,211 @@
+#include "bench.hpp"
+#include "music.hpp"
+
+// Library representation before the song table, kept for comparison
+struct legacy_music_t {
+  songs_t songs;
+  std::map<std::string, std::set<std::string>> artists;
+  std::map<std::string, std::vector<song_t>> albums;
+};
+
+static songs_t make_songs(const size_t nb_artists,
+                          const size_t nb_albums,
+                          const size_t nb_tracks) {
+  songs_t songs;
+  for (size_t i = 0; i < nb_artists; i++) {
+    for (size_t j = 0; j < nb_albums; j++) {
+      for (size_t k = 0; k < nb_tracks; k++) {
+        song_t song;
+        song.artist = "Artist Name " + std::to_string(i);
+        song.album = "Album Name " + std::to_string(j);
+        song.title = "Some Song Title " + std::to_string(songs.size());
+        song.file_path = "/data/music/" + song.artist + "/" + song.album + "/"
+                         + std::to_string(k) + " - " + song.title + ".mp3";
+        song.year = 2000 + j;
+        song.track_number = k + 1;
+        songs.push_back(song);
+      }
+    }
+  }
+
+  return songs;
+}
+
+static float rss_mb() {
+  malloc_trim(0);
+  long size = 0;
+  long resident = 0;
+  FILE *fp = fopen("/proc/self/statm", "r");
+  if (fp == NULL || fscanf(fp, "%ld %ld", &size, &resident) != 2) {
+    resident = 0;
+  }
+  if (fp) {
+    fclose(fp);
+  }
+  return resident * sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+}
+
+void bench_music_load_library() {
+  const std::string index_path = BENCH_MUSIC_LIBRARY "/.zp3_index";
+  const size_t copies[3] = {10, 100, 1000};
+
+  for (const auto nb_copies : copies) {
+    const auto nb_songs = bench_make_library(TEST_MUSIC_LIBRARY,
+                                             BENCH_MUSIC_LIBRARY,
+                                             nb_copies);
+
+    // Cold start: no index, every file is parsed and the index is written
+    music_t music;
+    struct timespec t_cold = tic();
+    music_load_library(music, BENCH_MUSIC_LIBRARY, index_path);
+    const float cold = toc(&t_cold);
+
+    // Warm start: nothing changed, everything comes from the index
+    struct timespec t_warm = tic();
+    music_load_library(music, BENCH_MUSIC_LIBRARY, index_path);
+    const float warm = toc(&t_warm);
+
+    printf("  songs: %6zu  cold: %8.4fs  warm: %8.4fs  speedup: %6.2fx\n",
+           nb_songs,
+           cold,
+           warm,
+           cold / warm);
+  }
+}
+
+void bench_songs_parse_metadata() {
+  const auto nb_songs = bench_make_library(TEST_MUSIC_LIBRARY,
+                                           BENCH_MUSIC_LIBRARY,
+                                           200);
+  std::vector<std::string> file_list;
+  walkdir(BENCH_MUSIC_LIBRARY, file_list, "mp3");
+
+  const size_t threads[6] = {1, 2, 4, 8, 16, 32};
+  for (const auto nb_threads : threads) {
+    std::vector<song_t> songs;
+    struct timespec t = tic();
+    songs_parse_metadata(songs, file_list, nb_threads);
+    const float elapsed = toc(&t);
+
+    printf("  threads: %2zu  songs: %6zu  time: %8.4fs  files/sec: %10.1f\n",
+           nb_threads,
+           nb_songs,
+           elapsed,
+           file_list.size() / elapsed);
+  }
+}
+
+void bench_song_parse_metadata() {
+  bench_make_library(TEST_MUSIC_LIBRARY, BENCH_MUSIC_LIBRARY, 200);
+  std::vector<std::string> file_list;
+  walkdir(BENCH_MUSIC_LIBRARY, file_list, "mp3");
+
+  // Fast ID3 reader
+  struct timespec t_id3 = tic();
+  for (const auto &file_path : file_list) {
+    id3_tag_t tag;
+    id3_read(tag, file_path);
+  }
+  const float id3 = toc(&t_id3);
+
+  // TagLib
+  struct timespec t_taglib = tic();
+  for (const auto &file_path : file_list) {
+    song_t song;
+    song_parse_metadata_taglib(song, file_path);
+  }
+  const float taglib = toc(&t_taglib);
+
+  printf("  songs: %zu  id3: %8.4fs (%.1f us/song)  taglib: %8.4fs (%.1f us/song)\n",
+         file_list.size(),
+         id3,
+         id3 * 1e6 / file_list.size(),
+         taglib,
+         taglib * 1e6 / file_list.size());
+}
+
+void bench_music_memory() {
+  const size_t nb_artists = 500;
+  const size_t nb_albums = 10;
+  const size_t nb_tracks = 10;
+
+  // Legacy: vector of songs plus a copy of every song per album
+  float legacy = 0.0;
+  {
+    const float before = rss_mb();
+    legacy_music_t music;
+    music.songs = make_songs(nb_artists, nb_albums, nb_tracks);
+    std::sort(music.songs.begin(), music.songs.end(), song_comparator);
+    for (const auto &song : music.songs) {
+      music.artists[song.artist].insert(song.album);
+    }
+    for (const auto &song : music.songs) {
+      music.albums[song.album].push_back(song);
+    }
+    legacy = rss_mb() - before;
+  }
+
+  // Interned song table
+  float table = 0.0;
+  {
+    const float before = rss_mb();
+    music_t music;
+    {
+      auto songs = make_songs(nb_artists, nb_albums, nb_tracks);
+      music_init(music, songs);
+    }
+    table = rss_mb() - before;
+  }
+
+  printf("  songs: %zu  legacy: %7.2f MB  song table: %7.2f MB\n",
+         nb_artists * nb_albums * nb_tracks,
+         legacy,
+         table);
+}
+
+void bench_music_filter() {
+  const size_t nb_lookups = 100000;
+
+  for (const size_t nb_artists : {10, 100, 1000}) {
+    music_t music;
+    {
+      auto songs = make_songs(nb_artists, 10, 10);
+      music_init(music, songs);
+    }
+
+    // Query artists spread across the whole library
+    std::vector<std::string> artists;
+    for (size_t i = 0; i < nb_artists; i += std::max(nb_artists / 10, (size_t) 1)) {
+      artists.push_back("Artist Name " + std::to_string(i));
+    }
+
+    size_t found = 0;
+    struct timespec t = tic();
+    for (size_t i = 0; i < nb_lookups; i++) {
+      const auto &artist = artists[i % artists.size()];
+      found += music_filter_songs(music, artist, "Album Name 5").size;
+    }
+    const float songs_us = toc(&t) * 1e6 / nb_lookups;
+
+    t = tic();
+    for (size_t i = 0; i < nb_lookups; i++) {
+      found += music_filter_albums(music, artists[i % artists.size()]).size();
+    }
+    const float albums_us = toc(&t) * 1e6 / nb_lookups;
+
+    printf("  songs: %6zu  filter songs: %6.2f us  filter albums: %6.2f us  [%zu]\n",
+           music.songs.size(),
+           songs_us,
+           albums_us,
+           found);
+  }
+}
+
+int main(int argc, char **argv) {
+  RUN_BENCH(bench_music_load_library);
+  RUN_BENCH(bench_songs_parse_metadata);
+  RUN_BENCH(bench_song_parse_metadata);
+  RUN_BENCH(bench_music_memory);
+  RUN_BENCH(bench_music_filter);
+  return 0;
+}
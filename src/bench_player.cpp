@@ -0,0 +1,105 @@
+#include "bench.hpp"
+#include "player.hpp"
+
+void bench_player_display() {
+  player_init();
+  display_t display;
+  music_t music;
+  {
+    songs_t songs(1);
+    song_parse_metadata(songs[0], TEST_SONG);
+    music_init(music, songs);
+  }
+  const song_t song = music_get_song(music, 0);
+
+  // Before: the decode loop redraws the screen for every block
+  {
+    track_t track;
+    if (track_open(track, song) != 0) {
+      return;
+    }
+
+    const float bytes_per_sec = track.decoder.rate * track.decoder.channels * DECODER_BITS / 8;
+    size_t blocks = 0;
+    size_t decoded = 0;
+    float total = 0.0f;
+    float worst = 0.0f;
+    while (track.status == DECODER_OK) {
+      struct timespec t = tic();
+      const float song_time = decoded / bytes_per_sec;
+      display_song(display, PLAYER_PLAY, song, song_time, track.length);
+      decoded += track.buffered;
+      track.status = decoder_read(track.decoder,
+                                  track.buffer.data(),
+                                  track.buffer.size(),
+                                  track.buffered);
+      const float elapsed = toc(&t);
+      total += elapsed;
+      worst = max(worst, elapsed);
+      blocks++;
+    }
+    printf("  inline:   redraws/sec: %6.1f  decode loop: avg %6.3f ms  max %6.3f ms\n",
+           blocks / track.length,
+           total * 1e3 / blocks,
+           worst * 1e3);
+    track_close(track);
+  }
+
+  // After: a display thread redraws at most display_fps times a second
+  {
+    player_t player;
+    player.volume = 0.0;
+    player.display = &display;
+    player.song_queue = music_filter_songs(music);
+    player.player_state = PLAYER_PLAY;
+    struct timespec t = tic();
+    player_thread(&player);
+    const float elapsed = toc(&t);
+    printf("  threaded: redraws/sec: %6.1f  decode loop: avg %6.3f ms  max %6.3f ms\n",
+           player.redraws / elapsed,
+           player.decode_time * 1e3 / player.decode_blocks,
+           player.decode_time_max * 1e3);
+  }
+}
+
+void bench_player_read_ahead() {
+  player_init();
+  song_t song;
+  song_parse_metadata(song, TEST_SONG);
+
+  const size_t windows[3] = {16 * 1024, READER_WINDOW, 4 * READER_WINDOW};
+  for (const auto window : windows) {
+    // Drop the file from the page cache so reads have to go to disk
+    const int fd = open(TEST_SONG, O_RDONLY);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+
+    track_t track;
+    if (track_open(track, song, window) != 0) {
+      return;
+    }
+
+    struct timespec t = tic();
+    while (track.status == DECODER_OK) {
+      track.status = decoder_read(track.decoder,
+                                  track.buffer.data(),
+                                  track.buffer.size(),
+                                  track.buffered);
+    }
+    const float elapsed = toc(&t);
+
+    printf("  window: %5zu KB  decode: %7.3f ms  io wait: %7.3f ms  max read: %6.3f ms  prefetches: %zu\n",
+           window / 1024,
+           elapsed * 1e3,
+           track.reader.io_wait * 1e3,
+           track.reader.io_wait_max * 1e3,
+           track.reader.nb_prefetches);
+    track_close(track);
+  }
+}
+
+int main(int argc, char **argv) {
+  RUN_BENCH(bench_player_display);
+  RUN_BENCH(bench_player_read_ahead);
+  return 0;
+}
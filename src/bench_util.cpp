@@ -0,0 +1,97 @@
+#include "bench.hpp"
+#include "util.hpp"
+
+#define BENCH_TREE "/tmp/zp3_bench_tree"
+
+// The recursive readdir() based walkdir() this was replaced with
+static void walkdir_recursive(const std::string &path,
+                              std::vector<std::string> &file_list,
+                              const std::string &target_ext) {
+  DIR *dir = opendir(path.c_str());
+  if (dir == NULL) {
+    return;
+  }
+
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    std::string value(entry->d_name);
+    if (value == "." || value == "..") {
+      continue;
+    }
+
+    const auto ext_len = target_ext.length();
+    const auto file_ext = value.substr(value.length() - ext_len, ext_len);
+    if (entry->d_type == DT_DIR) {
+      walkdir_recursive(path + "/" + value, file_list, target_ext);
+    } else if (target_ext == "*" || target_ext == file_ext) {
+      file_list.push_back(path + "/" + value);
+    }
+  }
+
+  closedir(dir);
+}
+
+static size_t make_tree(const size_t nb_dirs, const size_t nb_files) {
+  const char *exts[4] = {"mp3", "flac", "ogg", "jpg"};
+
+  std::string cmd = "rm -rf " BENCH_TREE;
+  if (system(cmd.c_str()) != 0) {
+    return 0;
+  }
+
+  size_t nb_created = 0;
+  for (size_t i = 0; i < nb_dirs; i++) {
+    const std::string dir = BENCH_TREE "/artist" + std::to_string(i / 10)
+                            + "/album" + std::to_string(i % 10);
+    cmd = "mkdir -p " + dir;
+    if (system(cmd.c_str()) != 0) {
+      return nb_created;
+    }
+
+    for (size_t j = 0; j < nb_files; j++) {
+      const std::string path = dir + "/" + std::to_string(j) + "-track." + exts[j % 4];
+      const int fd = open(path.c_str(), O_CREAT | O_WRONLY, 0644);
+      if (fd != -1) {
+        close(fd);
+        nb_created++;
+      }
+    }
+  }
+
+  return nb_created;
+}
+
+void bench_walkdir() {
+  const auto nb_files = make_tree(1000, 100);
+
+  std::vector<std::string> file_list;
+  struct timespec t_recursive = tic();
+  walkdir_recursive(BENCH_TREE, file_list, "mp3");
+  walkdir_recursive(BENCH_TREE, file_list, "flac");
+  walkdir_recursive(BENCH_TREE, file_list, "ogg");
+  const float recursive = toc(&t_recursive);
+  const size_t nb_recursive = file_list.size();
+
+  file_list.clear();
+  struct timespec t_iterative = tic();
+  walkdir(BENCH_TREE, file_list, std::vector<std::string>{"mp3", "flac", "ogg"});
+  const float iterative = toc(&t_iterative);
+
+  printf("  files: %zu  matched: %zu / %zu\n",
+         nb_files,
+         nb_recursive,
+         file_list.size());
+  printf("  recursive readdir (3 passes): %8.4fs\n", recursive);
+  printf("  iterative getdents64 (1 pass): %8.4fs  speedup: %.2fx\n",
+         iterative,
+         recursive / iterative);
+
+  if (system("rm -rf " BENCH_TREE) != 0) {
+    printf("  failed to remove [%s]\n", BENCH_TREE);
+  }
+}
+
+int main(int argc, char **argv) {
+  RUN_BENCH(bench_walkdir);
+  return 0;
+}
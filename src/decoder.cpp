@@ -0,0 +1,558 @@
+#include "decoder.hpp"
+
+static uint16_t read_le16(const unsigned char *data) {
+  return data[0] | (data[1] << 8);
+}
+
+static uint32_t read_le32(const unsigned char *data) {
+  return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t) data[3] << 24);
+}
+
+void decoder_init() {
+  // Do this only once!
+  mpg123_init();
+}
+
+/**
+ * Guess the format of the file behind `reader` from its first bytes.
+ */
+int decoder_sniff(reader_t &reader) {
+  unsigned char data[12];
+  const ssize_t retval = reader_pread(reader, data, sizeof(data), 0);
+  if (retval <= 0) {
+    return DECODER_NONE;
+  }
+  const size_t size = retval;
+
+  if (size >= 12 && memcmp(data, "RIFF", 4) == 0 && memcmp(data + 8, "WAVE", 4) == 0) {
+    return DECODER_WAV;
+  }
+
+  // Skip an ID3v2 tag, some taggers put one in front of FLAC files too
+  size_t pos = 0;
+  if (size >= 10 && memcmp(data, "ID3", 3) == 0) {
+    pos = 10 + ((data[6] & 0x7f) << 21 | (data[7] & 0x7f) << 14
+                | (data[8] & 0x7f) << 7 | (data[9] & 0x7f));
+    pos += (data[5] & 0x10) ? 10 : 0;
+  }
+  unsigned char magic[4];
+  if (reader_pread(reader, magic, sizeof(magic), pos) == sizeof(magic)
+      && memcmp(magic, "fLaC", 4) == 0) {
+    return DECODER_FLAC;
+  }
+
+  // Anything else with an ID3 tag is taken to be MPEG audio, mpg123 finds
+  // the first frame itself
+  if (pos > 0 || (size >= 2 && data[0] == 0xff && (data[1] & 0xe0) == 0xe0)) {
+    return DECODER_MPG123;
+  }
+
+  return DECODER_NONE;
+}
+
+const char *decoder_name(const int type) {
+  if (type == DECODER_MPG123) {
+    return "mpg123";
+  } else if (type == DECODER_FLAC) {
+    return "flac";
+  } else if (type == DECODER_WAV) {
+    return "wav";
+  }
+  return "none";
+}
+
+static int decoder_open_mpg123(decoder_t &decoder) {
+  const char *path = decoder.reader->path.c_str();
+
+  // Initialize MPG123, trimming encoder delay and padding
+  int err = 0;
+  decoder.mh = mpg123_new(NULL, &err);
+  if (decoder.mh == nullptr) {
+    LOG_ERROR("Failed to create decoder: %s", mpg123_plain_strerror(err));
+    return -1;
+  }
+  mpg123_param(decoder.mh, MPG123_ADD_FLAGS, MPG123_GAPLESS, 0.0);
+
+  // Open the file through the reader and get the decoding format
+  int encoding = 0;
+  if (mpg123_replace_reader_handle(decoder.mh, reader_read, reader_lseek, NULL) != MPG123_OK
+      || mpg123_open_handle(decoder.mh, decoder.reader) != MPG123_OK
+      || mpg123_getformat(decoder.mh,
+                          &decoder.rate,
+                          &decoder.channels,
+                          &encoding) != MPG123_OK) {
+    LOG_ERROR("Failed to open [%s]: %s", path, mpg123_strerror(decoder.mh));
+    return -1;
+  }
+
+  // Fix the format so it cannot change mid track
+  mpg123_format_none(decoder.mh);
+  mpg123_format(decoder.mh, decoder.rate, decoder.channels, MPG123_ENC_SIGNED_16);
+
+  return 0;
+}
+
+static int decoder_read_mpg123(decoder_t &decoder,
+                               unsigned char *buf,
+                               const size_t size,
+                               size_t &done) {
+  const int retval = mpg123_read(decoder.mh, buf, size, &done);
+  if (retval == MPG123_OK || retval == MPG123_NEW_FORMAT) {
+    return DECODER_OK;
+  } else if (retval == MPG123_DONE) {
+    return DECODER_DONE;
+  }
+
+  LOG_ERROR("Failed to decode [%s]: %s",
+            decoder.reader->path.c_str(),
+            mpg123_strerror(decoder.mh));
+  return DECODER_ERROR;
+}
+
+static FLAC__StreamDecoderReadStatus flac_read(const FLAC__StreamDecoder *flac,
+                                               FLAC__byte buffer[],
+                                               size_t *bytes,
+                                               void *client_data) {
+  decoder_t &decoder = *(decoder_t *) client_data;
+  const ssize_t size = reader_read(decoder.reader, buffer, *bytes);
+  if (size < 0) {
+    *bytes = 0;
+    return FLAC__STREAM_DECODER_READ_STATUS_ABORT;
+  }
+
+  *bytes = size;
+  if (size == 0) {
+    return FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
+  }
+  return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+}
+
+static FLAC__StreamDecoderSeekStatus flac_seek(const FLAC__StreamDecoder *flac,
+                                               FLAC__uint64 offset,
+                                               void *client_data) {
+  decoder_t &decoder = *(decoder_t *) client_data;
+  if (reader_lseek(decoder.reader, offset, SEEK_SET) == -1) {
+    return FLAC__STREAM_DECODER_SEEK_STATUS_ERROR;
+  }
+  return FLAC__STREAM_DECODER_SEEK_STATUS_OK;
+}
+
+static FLAC__StreamDecoderTellStatus flac_tell(const FLAC__StreamDecoder *flac,
+                                               FLAC__uint64 *offset,
+                                               void *client_data) {
+  const decoder_t &decoder = *(decoder_t *) client_data;
+  *offset = decoder.reader->pos;
+  return FLAC__STREAM_DECODER_TELL_STATUS_OK;
+}
+
+static FLAC__StreamDecoderLengthStatus flac_length(const FLAC__StreamDecoder *flac,
+                                                   FLAC__uint64 *length,
+                                                   void *client_data) {
+  const decoder_t &decoder = *(decoder_t *) client_data;
+  *length = decoder.reader->size;
+  return FLAC__STREAM_DECODER_LENGTH_STATUS_OK;
+}
+
+static FLAC__bool flac_eof(const FLAC__StreamDecoder *flac, void *client_data) {
+  const decoder_t &decoder = *(decoder_t *) client_data;
+  return decoder.reader->pos >= decoder.reader->size;
+}
+
+/**
+ * Convert samples [`start`, `end`) of a decoded FLAC frame to interleaved
+ * 16-bit samples at `dst`.
+ */
+static void flac_convert(unsigned char *dst,
+                         const FLAC__int32 *const buffer[],
+                         const size_t start,
+                         const size_t end,
+                         const int channels,
+                         const int bits) {
+  int16_t *out = (int16_t *) dst;
+  for (size_t i = start; i < end; i++) {
+    for (int c = 0; c < channels; c++) {
+      const FLAC__int32 sample = buffer[c][i];
+      *out++ = (bits > 16) ? sample >> (bits - 16) : sample << (16 - bits);
+    }
+  }
+}
+
+static FLAC__StreamDecoderWriteStatus flac_write(const FLAC__StreamDecoder *flac,
+                                                 const FLAC__Frame *frame,
+                                                 const FLAC__int32 *const buffer[],
+                                                 void *client_data) {
+  decoder_t &decoder = *(decoder_t *) client_data;
+  const size_t nb_samples = frame->header.blocksize;
+  const int bits = frame->header.bits_per_sample;
+  if ((int) frame->header.channels != decoder.channels) {
+    LOG_ERROR("Channel count changed in [%s]!", decoder.reader->path.c_str());
+    decoder.failed = true;
+    return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+  }
+
+  // As much as fits straight into the caller's buffer, the rest is kept
+  const size_t frame_size = decoder.channels * DECODER_BITS / 8;
+  size_t direct = 0;
+  if (decoder.out != nullptr) {
+    direct = std::min(nb_samples, (decoder.out_size - decoder.out_done) / frame_size);
+    flac_convert(decoder.out + decoder.out_done, buffer, 0, direct, decoder.channels, bits);
+    decoder.out_done += direct * frame_size;
+  }
+
+  decoder.pending.resize((nb_samples - direct) * frame_size);
+  decoder.pending_pos = 0;
+  flac_convert(decoder.pending.data(), buffer, direct, nb_samples, decoder.channels, bits);
+
+  return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+static void flac_metadata(const FLAC__StreamDecoder *flac,
+                          const FLAC__StreamMetadata *metadata,
+                          void *client_data) {
+  decoder_t &decoder = *(decoder_t *) client_data;
+  if (metadata->type == FLAC__METADATA_TYPE_STREAMINFO) {
+    decoder.rate = metadata->data.stream_info.sample_rate;
+    decoder.channels = metadata->data.stream_info.channels;
+    decoder.flac_bits = metadata->data.stream_info.bits_per_sample;
+    decoder.samples = metadata->data.stream_info.total_samples;
+  }
+}
+
+static void flac_error(const FLAC__StreamDecoder *flac,
+                       FLAC__StreamDecoderErrorStatus status,
+                       void *client_data) {
+  const decoder_t &decoder = *(decoder_t *) client_data;
+  LOG_WARN("FLAC error in [%s]: %s",
+           decoder.reader->path.c_str(),
+           FLAC__StreamDecoderErrorStatusString[status]);
+}
+
+static int decoder_open_flac(decoder_t &decoder) {
+  const char *path = decoder.reader->path.c_str();
+
+  decoder.flac = FLAC__stream_decoder_new();
+  if (decoder.flac == nullptr) {
+    LOG_ERROR("Failed to create FLAC decoder!");
+    return -1;
+  }
+
+  // Read the stream info, which gives the format and length
+  if (FLAC__stream_decoder_init_stream(decoder.flac,
+                                       flac_read,
+                                       flac_seek,
+                                       flac_tell,
+                                       flac_length,
+                                       flac_eof,
+                                       flac_write,
+                                       flac_metadata,
+                                       flac_error,
+                                       &decoder) != FLAC__STREAM_DECODER_INIT_STATUS_OK
+      || FLAC__stream_decoder_process_until_end_of_metadata(decoder.flac) == false
+      || decoder.rate == 0 || decoder.channels == 0) {
+    const auto state = FLAC__stream_decoder_get_state(decoder.flac);
+    LOG_ERROR("Failed to open [%s]: %s", path, FLAC__StreamDecoderStateString[state]);
+    return -1;
+  }
+
+  return 0;
+}
+
+static int decoder_read_flac(decoder_t &decoder,
+                             unsigned char *buf,
+                             const size_t size,
+                             size_t &done) {
+  // Left over from the last frame first
+  const size_t frame_size = decoder.channels * DECODER_BITS / 8;
+  const size_t left = decoder.pending.size() - decoder.pending_pos;
+  const size_t copied = std::min(left, size - size % frame_size);
+  memcpy(buf, decoder.pending.data() + decoder.pending_pos, copied);
+  decoder.pending_pos += copied;
+
+  // Then decode frames into the buffer until it is full
+  decoder.out = buf;
+  decoder.out_size = size;
+  decoder.out_done = copied;
+  int status = DECODER_OK;
+  while (decoder.pending_pos == decoder.pending.size()
+         && decoder.out_done + frame_size <= size) {
+    const auto state = FLAC__stream_decoder_get_state(decoder.flac);
+    if (state == FLAC__STREAM_DECODER_END_OF_STREAM) {
+      status = (decoder.out_done == 0) ? DECODER_DONE : DECODER_OK;
+      break;
+    }
+    if (FLAC__stream_decoder_process_single(decoder.flac) == false || decoder.failed) {
+      LOG_ERROR("Failed to decode [%s]!", decoder.reader->path.c_str());
+      status = DECODER_ERROR;
+      break;
+    }
+  }
+  done = decoder.out_done;
+  decoder.out = nullptr;
+
+  return status;
+}
+
+static off_t decoder_seek_flac(decoder_t &decoder, const off_t sample) {
+  // The frame holding the target sample is decoded into `pending`, starting
+  // at the target
+  decoder.pending.clear();
+  decoder.pending_pos = 0;
+  off_t target = std::max(sample, (off_t) 0);
+  if (decoder.samples > 0) {
+    target = std::min(target, decoder.samples - 1);
+  }
+  if (FLAC__stream_decoder_seek_absolute(decoder.flac, target) == false) {
+    LOG_ERROR("Failed to seek in [%s]!", decoder.reader->path.c_str());
+    FLAC__stream_decoder_flush(decoder.flac);
+    return -1;
+  }
+
+  return target;
+}
+
+static int decoder_open_wav(decoder_t &decoder) {
+  reader_t &reader = *decoder.reader;
+  const char *path = reader.path.c_str();
+
+  // Walk the RIFF chunks up to the sample data
+  int format = 0;
+  int bits = 0;
+  size_t pos = 12;
+  unsigned char chunk[8];
+  unsigned char fmt[40];
+  while (reader_pread(reader, chunk, sizeof(chunk), pos) == sizeof(chunk)) {
+    const size_t chunk_size = read_le32(chunk + 4);
+    const size_t body = pos + 8;
+
+    if (memcmp(chunk, "fmt ", 4) == 0 && chunk_size >= 16
+        && reader_pread(reader, fmt, 16, body) == 16) {
+      format = read_le16(fmt);
+      decoder.channels = read_le16(fmt + 2);
+      decoder.rate = read_le32(fmt + 4);
+      bits = read_le16(fmt + 14);
+
+      // WAVE_FORMAT_EXTENSIBLE, the format is at the start of the sub format
+      if (format == 0xfffe && chunk_size >= 40
+          && reader_pread(reader, fmt, 40, body) == 40) {
+        format = read_le16(fmt + 24);
+      }
+    } else if (memcmp(chunk, "data", 4) == 0) {
+      decoder.data_offset = body;
+      decoder.data_size = std::min(chunk_size, reader.size - body);
+      break;
+    }
+
+    // Chunks are padded to an even size
+    pos = body + chunk_size + (chunk_size & 1);
+  }
+
+  if (format != 1 || bits != DECODER_BITS || decoder.channels == 0
+      || decoder.rate == 0 || decoder.data_offset == 0) {
+    LOG_ERROR("Unsupported WAV file [%s], expected 16-bit PCM!", path);
+    return -1;
+  }
+  decoder.samples = decoder.data_size / (decoder.channels * DECODER_BITS / 8);
+
+  return (reader_lseek(decoder.reader, decoder.data_offset, SEEK_SET) == -1) ? -1 : 0;
+}
+
+static int decoder_read_wav(decoder_t &decoder,
+                            unsigned char *buf,
+                            const size_t size,
+                            size_t &done) {
+  const size_t frame_size = decoder.channels * DECODER_BITS / 8;
+  const size_t end = decoder.data_offset + decoder.data_size;
+  const size_t left = (decoder.reader->pos < end) ? end - decoder.reader->pos : 0;
+  const size_t count = std::min(left, size - size % frame_size);
+  if (count == 0) {
+    return DECODER_DONE;
+  }
+
+  const ssize_t retval = reader_read(decoder.reader, buf, count);
+  if (retval < 0) {
+    LOG_ERROR("Failed to read [%s]!", decoder.reader->path.c_str());
+    return DECODER_ERROR;
+  }
+  done = retval;
+
+  return DECODER_OK;
+}
+
+static off_t decoder_seek_wav(decoder_t &decoder, const off_t sample) {
+  const off_t target = std::min(std::max(sample, (off_t) 0), decoder.samples);
+  const size_t frame_size = decoder.channels * DECODER_BITS / 8;
+  if (reader_lseek(decoder.reader, decoder.data_offset + target * frame_size, SEEK_SET) == -1) {
+    return -1;
+  }
+
+  return target;
+}
+
+/**
+ * Open a decoder for the file behind `reader`. The decoder keeps a pointer
+ * to both the reader and itself in the backend, so neither may move while
+ * it is open.
+ */
+int decoder_open(decoder_t &decoder, reader_t &reader) {
+  decoder_close(decoder);
+  decoder.reader = &reader;
+  decoder.type = decoder_sniff(reader);
+
+  int retval = -1;
+  if (decoder.type == DECODER_MPG123) {
+    retval = decoder_open_mpg123(decoder);
+  } else if (decoder.type == DECODER_FLAC) {
+    retval = decoder_open_flac(decoder);
+  } else if (decoder.type == DECODER_WAV) {
+    retval = decoder_open_wav(decoder);
+  } else {
+    LOG_ERROR("Unknown audio format [%s]!", reader.path.c_str());
+  }
+
+  if (retval != 0) {
+    decoder_close(decoder);
+    return -1;
+  }
+
+  return 0;
+}
+
+void decoder_close(decoder_t &decoder) {
+  if (decoder.mh != nullptr) {
+    mpg123_close(decoder.mh);
+    mpg123_delete(decoder.mh);
+    decoder.mh = nullptr;
+  }
+  if (decoder.flac != nullptr) {
+    FLAC__stream_decoder_finish(decoder.flac);
+    FLAC__stream_decoder_delete(decoder.flac);
+    decoder.flac = nullptr;
+  }
+
+  decoder.type = DECODER_NONE;
+  decoder.reader = nullptr;
+  decoder.rate = 0;
+  decoder.channels = 0;
+  decoder.samples = 0;
+  decoder.flac_bits = 0;
+  decoder.out = nullptr;
+  decoder.out_size = 0;
+  decoder.out_done = 0;
+  decoder.pending.clear();
+  decoder.pending_pos = 0;
+  decoder.failed = false;
+  decoder.data_offset = 0;
+  decoder.data_size = 0;
+}
+
+/**
+ * Give an MPEG decoder the frame index in `seek`, which also gives the exact
+ * length of the track. Returns 0 if the index was used or the format needs
+ * none, -1 if there is no usable index.
+ */
+int decoder_set_index(decoder_t &decoder, const music_seek_entry_t *seek) {
+  if (decoder.type != DECODER_MPG123) {
+    return 0;
+  }
+
+  if (seek == nullptr || seek->rate != decoder.rate || seek->step <= 0) {
+    return -1;
+  }
+  std::vector<off_t> offsets(seek->offsets.begin(), seek->offsets.end());
+  if (mpg123_set_index(decoder.mh, offsets.data(), seek->step, offsets.size()) != MPG123_OK) {
+    return -1;
+  }
+  decoder.samples = seek->samples;
+
+  return 0;
+}
+
+/**
+ * Give an MPEG decoder a frame index, either the one from `seek` or one
+ * built by scanning the whole file, which also gives the exact length of the
+ * track. Returns 1 if a new index was built into `built`, 0 otherwise. The
+ * other formats know their length and seek without an index.
+ */
+int decoder_index(decoder_t &decoder,
+                  const music_seek_entry_t *seek,
+                  music_seek_entry_t &built) {
+  if (decoder.type != DECODER_MPG123 || decoder_set_index(decoder, seek) == 0) {
+    return 0;
+  }
+
+  off_t *offsets = nullptr;
+  off_t step = 0;
+  size_t fill = 0;
+  if (mpg123_scan(decoder.mh) != MPG123_OK
+      || mpg123_index(decoder.mh, &offsets, &step, &fill) != MPG123_OK) {
+    LOG_WARN("Failed to index [%s]", decoder.reader->path.c_str());
+    return 0;
+  }
+  decoder.samples = mpg123_length(decoder.mh);
+  built.rate = decoder.rate;
+  built.samples = decoder.samples;
+  built.step = step;
+  built.offsets.assign(offsets, offsets + fill);
+
+  return 1;
+}
+
+/**
+ * Size of the blocks the decoder produces, reads should be at least this big.
+ */
+size_t decoder_block_size(decoder_t &decoder) {
+  if (decoder.type == DECODER_MPG123) {
+    return mpg123_outblock(decoder.mh);
+  }
+  return DECODER_BLOCK_SIZE;
+}
+
+/**
+ * Decode up to `size` bytes of PCM into `buf`, `done` is set to the number of
+ * bytes written.
+ */
+int decoder_read(decoder_t &decoder,
+                 unsigned char *buf,
+                 const size_t size,
+                 size_t &done) {
+  done = 0;
+  if (decoder.type == DECODER_MPG123) {
+    return decoder_read_mpg123(decoder, buf, size, done);
+  } else if (decoder.type == DECODER_FLAC) {
+    return decoder_read_flac(decoder, buf, size, done);
+  } else if (decoder.type == DECODER_WAV) {
+    return decoder_read_wav(decoder, buf, size, done);
+  }
+
+  return DECODER_ERROR;
+}
+
+/**
+ * Seek to `sample`. Returns the sample decoding continues from, or -1.
+ */
+off_t decoder_seek(decoder_t &decoder, const off_t sample) {
+  if (decoder.type == DECODER_MPG123) {
+    return mpg123_seek(decoder.mh, sample, SEEK_SET);
+  } else if (decoder.type == DECODER_FLAC) {
+    return decoder_seek_flac(decoder, sample);
+  } else if (decoder.type == DECODER_WAV) {
+    return decoder_seek_wav(decoder, sample);
+  }
+
+  return -1;
+}
+
+/**
+ * Length of the track in seconds. For MPEG audio without a frame index this
+ * is estimated from the frame count, which is wrong for VBR files without a
+ * Xing header.
+ */
+float decoder_duration(decoder_t &decoder) {
+  if (decoder.samples > 0 && decoder.rate > 0) {
+    return (float) decoder.samples / decoder.rate;
+  } else if (decoder.type == DECODER_MPG123) {
+    return mpg123_framelength(decoder.mh) * mpg123_tpf(decoder.mh);
+  }
+
+  return 0.0f;
+}
@@ -0,0 +1,93 @@
+#ifndef ZP3_DECODER_HPP
+#define ZP3_DECODER_HPP
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include <vector>
+
+#include <mpg123.h>
+#include <FLAC/stream_decoder.h>
+
+#include "log.hpp"
+#include "music.hpp"
+#include "reader.hpp"
+
+/**
+ * Decoder
+ *
+ * One interface over the audio formats zp3 plays. The backend is picked by
+ * looking at the first bytes of the file rather than its extension, and
+ * every backend reads through the track's `reader_t` and produces
+ * interleaved signed 16-bit PCM in native byte order, so the player and the
+ * output device never see what format a song was stored in.
+ *
+ * - MPEG audio goes through mpg123, with gapless decoding and a frame index
+ *   for seeking (see `decoder_index()`).
+ * - FLAC goes through libFLAC's stream decoder. Frames are converted
+ *   straight into the caller's buffer, only the part of a frame that does
+ *   not fit is kept back for the next read.
+ * - WAV (16-bit PCM) is parsed here, samples are copied out of the reader
+ *   without conversion.
+ *
+ * `decoder_read()` returns `DECODER_OK` while there is more to read,
+ * `DECODER_DONE` at the end of the stream and `DECODER_ERROR` on failure.
+ */
+#define DECODER_NONE 0
+#define DECODER_MPG123 1
+#define DECODER_FLAC 2
+#define DECODER_WAV 3
+
+#define DECODER_OK 0
+#define DECODER_DONE 1
+#define DECODER_ERROR -1
+
+#define DECODER_BITS 16
+#define DECODER_BLOCK_SIZE 4608
+
+struct decoder_t {
+  int type = DECODER_NONE;
+  reader_t *reader = nullptr;
+
+  // Format
+  long rate = 0;
+  int channels = 0;
+  off_t samples = 0;
+
+  // MPG123
+  mpg123_handle *mh = nullptr;
+
+  // FLAC, decoded samples that did not fit into the caller's buffer
+  FLAC__StreamDecoder *flac = nullptr;
+  int flac_bits = 0;
+  unsigned char *out = nullptr;
+  size_t out_size = 0;
+  size_t out_done = 0;
+  std::vector<unsigned char> pending;
+  size_t pending_pos = 0;
+  bool failed = false;
+
+  // WAV
+  size_t data_offset = 0;
+  size_t data_size = 0;
+};
+
+void decoder_init();
+int decoder_sniff(reader_t &reader);
+const char *decoder_name(const int type);
+int decoder_open(decoder_t &decoder, reader_t &reader);
+void decoder_close(decoder_t &decoder);
+int decoder_set_index(decoder_t &decoder, const music_seek_entry_t *seek);
+int decoder_index(decoder_t &decoder,
+                  const music_seek_entry_t *seek,
+                  music_seek_entry_t &built);
+size_t decoder_block_size(decoder_t &decoder);
+int decoder_read(decoder_t &decoder,
+                 unsigned char *buf,
+                 const size_t size,
+                 size_t &done);
+off_t decoder_seek(decoder_t &decoder, const off_t sample);
+float decoder_duration(decoder_t &decoder);
+
+#endif // ZP3_DECODER_HPP
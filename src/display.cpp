@@ -3,15 +3,30 @@
 void menu_init(menu_t &menu, const std::vector<std::string> entries) {
   menu.configured = true;
   menu.entries = entries;
+  menu.nb_entries = menu.entries.size();
+  menu.get_entry = nullptr;
+}
+
+void menu_init(menu_t &menu, const size_t nb_entries, const menu_source_t &get_entry) {
+  menu.configured = true;
+  menu.entries.clear();
+  menu.nb_entries = nb_entries;
+  menu.get_entry = get_entry;
 }
 
 void menu_clear(menu_t &menu) {
   menu.configured = false;
   menu.entries.clear();
+  menu.nb_entries = 0;
+  menu.get_entry = nullptr;
+}
+
+static std::string menu_entry(const menu_t &menu, const size_t i) {
+  return (menu.get_entry) ? menu.get_entry(i) : menu.entries[i];
 }
 
 std::vector<std::string> menu_get_page(menu_t &menu, const int index) {
-  const int nb_entries = menu.entries.size();
+  const int nb_entries = menu.nb_entries;
   const int max_entries = menu.max_entries;
   const int menu_page = static_cast<int>(index / max_entries);
 
@@ -19,12 +34,35 @@ std::vector<std::string> menu_get_page(menu_t &menu, const int index) {
   const auto remaining = min(nb_entries - idx_start, max_entries);
   const auto idx_end = idx_start + remaining;
 
-  return std::vector<std::string>{menu.entries.begin() + idx_start,
-                                  menu.entries.begin() + idx_end};
+  std::vector<std::string> page;
+  page.reserve(max_entries);
+  for (int i = idx_start; i < idx_end; i++) {
+    page.push_back(menu_entry(menu, i));
+  }
+
+  return page;
 }
 
 display_t::display_t() {
   display_init();
+
+  const size_t size = width * height;
+  for (int i = 0; i < 2; i++) {
+    void *buffer = nullptr;
+    if (posix_memalign(&buffer, DISPLAY_BUFFER_ALIGN, size) != 0) {
+      FATAL("Failed to allocate display buffer!");
+    }
+    buffers[i] = (uint8_t *) buffer;
+    memset(buffers[i], 0, size);
+    canvases[i] = new NanoCanvas8(width, height, buffers[i]);
+  }
+}
+
+display_t::~display_t() {
+  for (int i = 0; i < 2; i++) {
+    delete canvases[i];
+    free(buffers[i]);
+  }
 }
 
 void display_init() {
@@ -37,11 +75,219 @@ void display_init() {
 
   // Initialize display
   ssd1351_setMode(LCD_MODE_NORMAL);
-  ssd1306_setFixedFont(ssd1306xled_font6x8);
+  ssd1306_setFixedFont(DISPLAY_FONT);
   ssd1306_clearScreen();
 }
 
-static void display_menu_entry(NanoCanvas8 &canvas,
+/**
+ * Lock the display and return a canvas over the cleared back buffer.
+ */
+NanoCanvas8 &display_begin(display_t &display) {
+  display.mutex.lock();
+  memset(display.buffers[display.back], 0, display.width * display.height);
+  display.marquee.used = false;
+  return *display.canvases[display.back];
+}
+
+/**
+ * Push the parts of the back buffer that differ from the front buffer and
+ * swap them. Changed rows are grouped into bands of consecutive rows, and
+ * each band is pushed as one rectangle spanning its leftmost to rightmost
+ * changed pixel.
+ */
+static void display_push(display_t &display) {
+  const int width = display.width;
+  const int height = display.height;
+  const uint8_t *buffer = display.buffers[display.back];
+  const uint8_t *frame = display.buffers[1 - display.back];
+
+  size_t bytes = 0;
+  int y = 0;
+  while (y < height) {
+    // Skip unchanged rows
+    if (memcmp(frame + y * width, buffer + y * width, width) == 0) {
+      y++;
+      continue;
+    }
+
+    // Extend the band over consecutive changed rows
+    int x_min = width;
+    int x_max = -1;
+    const int y_min = y;
+    for (; y < height; y++) {
+      const uint8_t *old_row = frame + y * width;
+      const uint8_t *new_row = buffer + y * width;
+      int left = 0;
+      while (left < width && old_row[left] == new_row[left]) {
+        left++;
+      }
+      if (left == width) {
+        break;
+      }
+      int right = width - 1;
+      while (old_row[right] == new_row[right]) {
+        right--;
+      }
+      x_min = min(x_min, left);
+      x_max = max(x_max, right);
+    }
+
+    // Push the band
+    const int w = x_max - x_min + 1;
+    const int h = y - y_min;
+    display.rect.resize(w * h);
+    for (int i = 0; i < h; i++) {
+      const uint8_t *src = buffer + (y_min + i) * width + x_min;
+      memcpy(display.rect.data() + i * w, src, w);
+    }
+    ssd1306_drawBufferFast8(x_min, y_min, w, h, display.rect.data());
+    bytes += w * h;
+  }
+
+  // The back buffer is now what is on screen
+  display.back = 1 - display.back;
+  display.frame_bytes = bytes;
+  display.total_bytes += bytes;
+  display.nb_frames++;
+}
+
+/**
+ * Push the frame and unlock the display. A marquee not drawn in this frame
+ * is stopped.
+ */
+void display_end(display_t &display) {
+  display.marquee.active = display.marquee.used;
+  display_push(display);
+  display.mutex.unlock();
+}
+
+/**
+ * Draw `text` into the back buffer from the text cache. With `wrap` set the
+ * text continues on the next line at `x` when it reaches the right edge, like
+ * printFixed does in CANVAS_TEXT_WRAP_LOCAL mode.
+ */
+static void display_text(display_t &display,
+                         const int x,
+                         const int y,
+                         const std::string &text,
+                         const uint16_t color,
+                         const bool wrap = false) {
+  const auto &bitmap = text_cache_get(display.text_cache,
+                                      DISPLAY_FONT,
+                                      DISPLAY_FONT_WIDTH,
+                                      DISPLAY_FONT_HEIGHT,
+                                      color,
+                                      text);
+  uint8_t *buffer = display.buffers[display.back];
+  if (wrap == false) {
+    text_blit(buffer, display.width, display.height, bitmap, 0, bitmap.width, x, y);
+    return;
+  }
+
+  const int line_chars = max((display.width - x) / DISPLAY_FONT_WIDTH, 1);
+  const int line_width = line_chars * DISPLAY_FONT_WIDTH;
+  int line_y = y;
+  for (int src_x = 0; src_x < bitmap.width; src_x += line_width) {
+    text_blit(buffer, display.width, display.height, bitmap, src_x, line_width, x, line_y);
+    line_y += DISPLAY_FONT_HEIGHT;
+  }
+}
+
+/**
+ * Scroll `text` through a `width` pixel window at (x, y). The marquee keeps
+ * its start time while the same text is drawn in the same place.
+ */
+static void display_marquee(display_t &display,
+                            const int x,
+                            const int y,
+                            const int width,
+                            const std::string &text,
+                            const uint16_t color,
+                            const uint16_t background) {
+  marquee_t &marquee = display.marquee;
+  if (marquee.active == false || marquee.text != text || marquee.x != x
+      || marquee.y != y || marquee.color != color) {
+    marquee.text = text;
+    marquee.x = x;
+    marquee.y = y;
+    marquee.width = width;
+    marquee.color = color;
+    marquee.background = background;
+    marquee.start = tic();
+  }
+  marquee.active = true;
+  marquee.used = true;
+
+  // Clear the window
+  uint8_t *buffer = display.buffers[display.back];
+  for (int row = max(y, 0); row < min(y + DISPLAY_FONT_HEIGHT, display.height); row++) {
+    memset(buffer + row * display.width + x, background, width);
+  }
+
+  // Offset into the strip, which repeats after a gap
+  const auto &bitmap = text_cache_get(display.text_cache,
+                                      DISPLAY_FONT,
+                                      DISPLAY_FONT_WIDTH,
+                                      DISPLAY_FONT_HEIGHT,
+                                      color,
+                                      text);
+  const int period = bitmap.width + DISPLAY_MARQUEE_GAP;
+  struct timespec start = marquee.start;
+  const float elapsed = toc(&start) - DISPLAY_MARQUEE_DELAY;
+  const int offset = (elapsed > 0.0f) ? (int) (elapsed * DISPLAY_MARQUEE_SPEED) % period : 0;
+
+  // Blit the part of each repeat that falls inside the window
+  for (int pos = x - offset; pos < x + width; pos += period) {
+    const int src_begin = max(x - pos, 0);
+    const int src_end = min(x + width - pos, bitmap.width);
+    if (src_end > src_begin) {
+      text_blit(buffer,
+                display.width,
+                display.height,
+                bitmap,
+                src_begin,
+                src_end - src_begin,
+                pos + src_begin,
+                y);
+    }
+  }
+}
+
+/**
+ * Advance a scrolling marquee, if any, by redrawing just its window over the
+ * frame on screen. Returns true if anything was drawn.
+ */
+bool display_tick(display_t &display) {
+  std::lock_guard<std::mutex> guard(display.mutex);
+  const marquee_t &marquee = display.marquee;
+  if (marquee.active == false) {
+    return false;
+  }
+
+  const size_t size = display.width * display.height;
+  memcpy(display.buffers[display.back], display.buffers[1 - display.back], size);
+  display_marquee(display,
+                  marquee.x,
+                  marquee.y,
+                  marquee.width,
+                  marquee.text,
+                  marquee.color,
+                  marquee.background);
+  display_push(display);
+
+  return true;
+}
+
+/**
+ * Whether there is a marquee on screen that needs `display_tick()` calls.
+ */
+bool display_animating(display_t &display) {
+  std::lock_guard<std::mutex> guard(display.mutex);
+  return display.marquee.active;
+}
+
+static void display_menu_entry(display_t &display,
+                               NanoCanvas8 &canvas,
                                const std::string &entry,
                                const int menu_idx,
                                const int rel_idx,
@@ -50,13 +296,8 @@ static void display_menu_entry(NanoCanvas8 &canvas,
                                const int scroll_idx,
                                const size_t max_chars,
                                const size_t max_entries) {
-  // // Scroll text
-  std::string text = entry;
-  // if (menu_idx == rel_idx && entry.length() > max_chars) {
-  //   text = entry.substr(scroll_idx, -1);
-  // }
-
   // Print text
+  const std::string &text = entry;
   if (menu_idx == rel_idx) {
     // Draw white background
     canvas.setColor(RGB_COLOR8(255, 255, 255));
@@ -67,23 +308,29 @@ static void display_menu_entry(NanoCanvas8 &canvas,
     const int y2 = y + 10;
     canvas.fillRect(x1, y1, x2, y2);
 
-    // Set text color to black
-    canvas.setColor(RGB_COLOR8(0, 0, 0));
+    // Draw text in black, scrolling it if it does not fit
+    if (text.length() > max_chars) {
+      display_marquee(display,
+                      x,
+                      y,
+                      screen_width - 2 * x,
+                      text,
+                      RGB_COLOR8(0, 0, 0),
+                      RGB_COLOR8(255, 255, 255));
+    } else {
+      display_text(display, x - scroll_idx, y, text, RGB_COLOR8(0, 0, 0));
+    }
   } else {
-    // Set text color to white
-    canvas.setColor(RGB_COLOR8(255, 255, 255));
+    // Draw text in white
+    display_text(display, x - scroll_idx, y, text, RGB_COLOR8(255, 255, 255));
   }
-
-  // Draw text
-  canvas.printFixed(x - scroll_idx, y, text.c_str());
 }
 
 void display_menu(display_t &display, const int selection_idx, const int scroll_idx) {
   const int max_chars = display.menu.max_chars;
   const int max_entries = display.menu.max_entries;
 
-  uint8_t buffer[display.width * display.height] = {0};
-  NanoCanvas8 canvas(display.width, display.height, buffer);
+  NanoCanvas8 &canvas = display_begin(display);
   canvas.setMode(CANVAS_MODE_TRANSPARENT);
 
   // Display menu
@@ -94,13 +341,14 @@ void display_menu(display_t &display, const int selection_idx, const int scroll_
 
   // Calculate relative index within a page of entries. This is the local index
   // within a page of entries. Where selection_idx is the global index.
-  const int idx_end = display.menu.entries.size() - 1;
+  const int idx_end = display.menu.nb_entries - 1;
   int rel_idx = (selection_idx < 0) ? 0 : selection_idx;
   rel_idx = (rel_idx > idx_end) ? idx_end : rel_idx;
   rel_idx = rel_idx % max_entries;
 
   for (const auto &entry : menu_page) {
-    display_menu_entry(canvas,
+    display_menu_entry(display,
+                       canvas,
                        entry,
                        menu_idx,
                        rel_idx,
@@ -114,7 +362,21 @@ void display_menu(display_t &display, const int selection_idx, const int scroll_
   }
 
   canvas.setColor(RGB_COLOR8(255, 255, 255));
-  canvas.blt();
+  display_end(display);
+}
+
+int display_progress_x(const display_t &display,
+                       const float song_time,
+                       const float song_length) {
+  float track_progress = song_time / song_length;
+  if (track_progress < 0 || song_length < 0.01) {
+    track_progress = 0.0;
+  } else if (track_progress > 1.0) {
+    track_progress = 1.0;
+  }
+
+  const int progress_bar_width = (display.width - 10) - 10;
+  return 10 + (progress_bar_width * track_progress);
 }
 
 void display_song(display_t &display,
@@ -123,51 +385,50 @@ void display_song(display_t &display,
                   const float song_time,
                   const float song_length) {
   // Setup canvas
-  const int track_scroll_counter = 0;
-  uint8_t buffer[display.width * display.height] = {0};
-  NanoCanvas8 canvas(display.width, display.height, buffer);
+  NanoCanvas8 &canvas = display_begin(display);
   canvas.setMode(CANVAS_TEXT_WRAP_LOCAL);
 
-  // Track name
+  // Track name, scrolling if it does not fit
   {
-    const int x = 2 - track_scroll_counter;
+    const int x = 2;
     const int y = 20;
-    canvas.setColor(RGB_COLOR8(255, 255, 255));
-    canvas.printFixed(x, y, song.title.c_str(), STYLE_NORMAL);
+    const int width = display.width - 2 * x;
+    if ((int) song.title.length() * DISPLAY_FONT_WIDTH > width) {
+      display_marquee(display,
+                      x,
+                      y,
+                      width,
+                      song.title,
+                      RGB_COLOR8(255, 255, 255),
+                      RGB_COLOR8(0, 0, 0));
+    } else {
+      display_text(display, x, y, song.title, RGB_COLOR8(255, 255, 255));
+    }
   }
 
   // Track artist
   {
-    const int x = 2 - track_scroll_counter;
+    const int x = 2;
     const int y = 35;
-    canvas.setColor(RGB_COLOR8(255, 255, 255));
-    canvas.printFixed(x, y, song.artist.c_str(), STYLE_NORMAL);
+    display_text(display, x, y, song.artist, RGB_COLOR8(255, 255, 255), true);
   }
 
   // Track album
   {
-    const int x = 2 - track_scroll_counter;
+    const int x = 2;
     const int y = 50;
-    canvas.setColor(RGB_COLOR8(255, 255, 255));
-    canvas.printFixed(x, y, song.album.c_str(), STYLE_NORMAL);
+    display_text(display, x, y, song.album, RGB_COLOR8(255, 255, 255), true);
   }
 
   // Track progress
   {
-    float track_progress = song_time / song_length;
-    if (track_progress < 0 || song_length < 0.01) {
-      track_progress = 0.0;
-    } else if (track_progress > 1.0) {
-      track_progress = 1.0;
-    }
     // -- Progress outline
     const int top_left[2] = {10, 72};
     const int bottom_right[2] = {display.width - 10, top_left[1] + 10};
     ssd1306_setColor(RGB_COLOR8(255, 255, 255));
     canvas.drawRect(top_left[0], top_left[1], bottom_right[0], bottom_right[1]);
     // -- Progress bar
-    const int progress_bar_width = (display.width - 10) - 10;
-    const int progress_x = 10 + (progress_bar_width * track_progress);
+    const int progress_x = display_progress_x(display, song_time, song_length);
     ssd1306_setColor(RGB_COLOR8(255, 255, 255));
     canvas.fillRect(top_left[0], top_left[1], progress_x, bottom_right[1]);
   }
@@ -254,12 +515,15 @@ void display_song(display_t &display,
   }
 
   // Display canvas
-  canvas.blt();
+  display_end(display);
 }
 
 void display_clear(display_t &display) {
   menu_clear(display.menu);
+  std::lock_guard<std::mutex> guard(display.mutex);
   ssd1306_clearScreen();
+  memset(display.buffers[1 - display.back], 0, display.width * display.height);
+  display.marquee.active = false;
 }
 
 void display_show_menu(display_t &display, const int index) {
@@ -286,37 +550,36 @@ void display_show_menu(display_t &display, const int index) {
 }
 
 void display_show_songs(display_t &display,
-                        const songs_t &songs,
+                        const songs_view_t &songs,
                         const int index) {
 #if ZP3_DISPLAY == DISPLAY_CONSOLE
-  int song_index = 0;
   system("clear");
-  for (const auto &song : songs) {
-    if (song_index == index) {
+  for (size_t i = 0; i < songs.size; i++) {
+    const auto row = songs_view_row(songs, i);
+    if ((int) i == index) {
       printf("%s", KGRN);
     }
-    printf("%s - [%s]", song.artist.c_str(), song.title.c_str());
-    if (song_index == index) {
+    printf("%s - [%s]",
+           music_song_artist(*songs.music, row).c_str(),
+           music_song_title(*songs.music, row));
+    if ((int) i == index) {
       printf("%s", KNRM);
     }
-    song_index++;
     printf("\n");
   }
   printf("\n");
 #elif ZP3_DISPLAY == DISPLAY_SDL || ZP3_DISPLAY == DISPLAY_HARDWARE
-  std::vector<std::string> menu_items;
-  for (const auto &song : songs) {
-    menu_items.emplace_back(song.title);
-  }
-  menu_init(display.menu, menu_items);
+  menu_init(display.menu, songs.size, [songs](const size_t i) {
+    return std::string(songs_view_title(songs, i));
+  });
   display_menu(display, index);
 #endif
 }
 
 std::string display_show_artists(display_t &display,
-                                 const artists_t &artists,
+                                 const std::vector<std::string> &artists,
                                  const int index) {
-  const auto keys = extract_keys<std::string, std::set<std::string>>(artists);
+  const auto &keys = artists;
 
 #if ZP3_DISPLAY == DISPLAY_CONSOLE
   int artist_index = 0;
@@ -334,7 +597,9 @@ std::string display_show_artists(display_t &display,
   }
   printf("\n");
 #elif ZP3_DISPLAY == DISPLAY_SDL || ZP3_DISPLAY == DISPLAY_HARDWARE
-  menu_init(display.menu, keys);
+  menu_init(display.menu, keys.size(), [&keys](const size_t i) {
+    return keys[i];
+  });
   display_menu(display, index);
 #endif
 
@@ -360,7 +625,9 @@ std::string display_show_albums(display_t &display,
   }
   printf("\n");
 #elif ZP3_DISPLAY == DISPLAY_SDL || ZP3_DISPLAY == DISPLAY_HARDWARE
-  menu_init(display.menu, albums);
+  menu_init(display.menu, albums.size(), [&albums](const size_t i) {
+    return albums[i];
+  });
   display_menu(display, index);
 #endif
 
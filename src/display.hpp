@@ -2,7 +2,10 @@
 #define ZP3_DISPLAY_HPP
 
 #include "music.hpp"
+#include "text_cache.hpp"
 
+#include <functional>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -19,43 +22,121 @@
   #define ZP3_DISPLAY DISPLAY_SDL
 #endif
 
+#define DISPLAY_FONT ssd1306xled_font6x8
+#define DISPLAY_FONT_WIDTH 6
+#define DISPLAY_FONT_HEIGHT 8
+
 #define PLAYER_PLAY 0
 #define PLAYER_STOP 1
 #define PLAYER_PAUSE 2
 
+/**
+ * Menu
+ *
+ * A menu initialised from a data source pulls entries one at a time from
+ * `get_entry(i)`, so only the visible page is ever turned into strings. The
+ * source must stay valid until the menu is next initialised or cleared. A
+ * menu initialised from a vector keeps its own copy in `entries`.
+ */
+typedef std::function<std::string(const size_t)> menu_source_t;
+
 struct menu_t {
   bool configured = false;
   const size_t max_chars = 21;
   const size_t max_entries = 12;
+  size_t nb_entries = 0;
+  menu_source_t get_entry;
   std::vector<std::string> entries;
 };
 
+/**
+ * Marquee
+ *
+ * Text too long for its line scrolls sideways. The string is rasterised once
+ * into the text cache and each frame blits a moving window of it. The
+ * offset follows the time since the marquee started, so it scrolls at
+ * `DISPLAY_MARQUEE_SPEED` however often `display_tick()` is called.
+ */
+#define DISPLAY_MARQUEE_SPEED 20.0f
+#define DISPLAY_MARQUEE_DELAY 1.0f
+#define DISPLAY_MARQUEE_GAP 24
+#define DISPLAY_MARQUEE_PERIOD_MS 100
+
+struct marquee_t {
+  bool active = false;
+  bool used = false;
+  std::string text;
+  int x = 0;
+  int y = 0;
+  int width = 0;
+  uint16_t color = 0;
+  uint16_t background = 0;
+  struct timespec start;
+};
+
+/**
+ * Display
+ *
+ * The display owns two persistent framebuffers. Frames are rendered into
+ * the back buffer through the canvas returned by `display_begin()`, and
+ * `display_end()` diffs it against the front buffer, which holds what is on
+ * the screen, pushes only the rectangles that changed over SPI and swaps the
+ * two. Advancing the progress bar by a pixel costs a few bytes instead of the
+ * whole 16 KB frame. The UI and player threads take turns through `mutex`.
+ */
+#define DISPLAY_BUFFER_ALIGN 64
+
 struct display_t {
   menu_t menu;
   const int width = ssd1306_displayWidth();
   const int height = ssd1306_displayHeight();
 
+  // Front and back framebuffers
+  std::mutex mutex;
+  uint8_t *buffers[2] = {nullptr, nullptr};
+  NanoCanvas8 *canvases[2] = {nullptr, nullptr};
+  int back = 0;
+  std::vector<uint8_t> rect;
+
+  // Rasterised strings
+  text_cache_t text_cache;
+  marquee_t marquee;
+
+  // Bytes pushed by the last frame and in total
+  size_t frame_bytes = 0;
+  size_t total_bytes = 0;
+  size_t nb_frames = 0;
+
   display_t();
+  ~display_t();
 };
 
 void menu_init(menu_t &menu, const std::vector<std::string> entries);
+void menu_init(menu_t &menu, const size_t nb_entries, const menu_source_t &get_entry);
 void menu_clear(menu_t &menu);
 std::vector<std::string> menu_get_page(menu_t &menu, const int index);
 
 void display_init();
+NanoCanvas8 &display_begin(display_t &display);
+void display_end(display_t &display);
 void display_menu(display_t &display, const int selection_idx, const int scroll_idx=0);
+int display_progress_x(const display_t &display,
+                       const float song_time,
+                       const float song_length);
 void display_song(display_t &display,
                   const int player_state,
                   const song_t &song,
                   const float song_time,
                   const float song_length);
+bool display_tick(display_t &display);
+bool display_animating(display_t &display);
 void display_clear(display_t &display);
 void display_show_menu(display_t &display, const int index);
 void display_show_songs(display_t &display,
-                        const songs_t &songs,
+                        const songs_view_t &songs,
                         const int index);
 std::string display_show_artists(display_t &display,
-                                 const artists_t &artists,
+                                 const std::vector<std::string> &artists,
                                  const int index);
 std::string display_show_albums(display_t &display,
                                 const std::vector<std::string> &albums,
@@ -0,0 +1,265 @@
+#include "event.hpp"
+
+// Terminal settings restored at exit, in case the program exits without
+// closing the event loop
+static bool event_terminal_saved = false;
+static struct termios event_terminal;
+
+static void event_restore_terminal() {
+  if (event_terminal_saved) {
+    tcsetattr(0, TCSADRAIN, &event_terminal);
+  }
+}
+
+static int event_loop_watch(event_loop_t &loop, const int fd, const uint32_t events) {
+  struct epoll_event ev = {0};
+  ev.events = events;
+  ev.data.fd = fd;
+  if (epoll_ctl(loop.epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+    LOG_ERROR("Failed to add fd [%d] to event loop!", fd);
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Open an event loop reading keys from `input_fd`. If it is a terminal it is
+ * switched to raw mode once here rather than around every read.
+ */
+int event_loop_init(event_loop_t &loop, const int input_fd) {
+  loop.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  loop.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (loop.epoll_fd == -1 || loop.timer_fd == -1) {
+    LOG_ERROR("Failed to initialize event loop!");
+    event_loop_close(loop);
+    return -1;
+  }
+
+  // Raw terminal
+  loop.input_fd = input_fd;
+  if (isatty(input_fd) && tcgetattr(input_fd, &loop.termios) == 0) {
+    struct termios raw = loop.termios;
+    raw.c_lflag &= ~ICANON;
+    raw.c_lflag &= ~ECHO;
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(input_fd, TCSANOW, &raw) == 0) {
+      loop.raw = true;
+      if (event_terminal_saved == false && input_fd == 0) {
+        event_terminal = loop.termios;
+        event_terminal_saved = true;
+        atexit(event_restore_terminal);
+      }
+    }
+  }
+
+  if (event_loop_watch(loop, input_fd, EPOLLIN) != 0
+      || event_loop_watch(loop, loop.timer_fd, EPOLLIN) != 0) {
+    event_loop_close(loop);
+    return -1;
+  }
+
+  return 0;
+}
+
+void event_loop_close(event_loop_t &loop) {
+  if (loop.raw) {
+    tcsetattr(loop.input_fd, TCSADRAIN, &loop.termios);
+    loop.raw = false;
+  }
+  gpio_input_close(loop.gpio);
+  if (loop.timer_fd != -1) {
+    close(loop.timer_fd);
+  }
+  if (loop.epoll_fd != -1) {
+    close(loop.epoll_fd);
+  }
+
+  loop.epoll_fd = -1;
+  loop.input_fd = -1;
+  loop.timer_fd = -1;
+  loop.timer_period_ms = 0;
+  loop.fds.clear();
+  loop.buttons.clear();
+  loop.pending.clear();
+}
+
+/**
+ * Report an event of `type` whenever eventfd `fd` is signalled. The loop does
+ * not take ownership of `fd`.
+ */
+int event_loop_add_fd(event_loop_t &loop, const int fd, const int type) {
+  if (event_loop_watch(loop, fd, EPOLLIN) != 0) {
+    return -1;
+  }
+  loop.fds[fd] = type;
+
+  return 0;
+}
+
+/**
+ * Report a press of the active low button on GPIO `pin` as key `key`. The
+ * pin is looked up under `loop.gpio.root`.
+ *
+ * The pin interrupts on both edges even though only presses become keys: the
+ * GPIO input only accepts a reading that differs from the last one, so it has
+ * to see the release for the next press to count.
+ */
+int event_loop_add_button(event_loop_t &loop, const int pin, const char key) {
+  const int fd = gpio_input_add(loop.gpio, pin, "both");
+  if (fd == -1) {
+    return -1;
+  }
+  if (event_loop_watch(loop, fd, EPOLLPRI | EPOLLERR) != 0) {
+    gpio_input_remove(loop.gpio, pin);
+    return -1;
+  }
+  loop.buttons[pin] = key;
+
+  return 0;
+}
+
+/**
+ * Fire a timer event every `period_ms` milliseconds, 0 stops the timer.
+ */
+int event_loop_set_timer(event_loop_t &loop, const int period_ms) {
+  if (period_ms == loop.timer_period_ms) {
+    return 0;
+  }
+
+  struct itimerspec spec = {{0, 0}, {0, 0}};
+  spec.it_interval.tv_sec = period_ms / 1000;
+  spec.it_interval.tv_nsec = (period_ms % 1000) * 1000000L;
+  spec.it_value = spec.it_interval;
+  if (timerfd_settime(loop.timer_fd, 0, &spec, NULL) == -1) {
+    LOG_ERROR("Failed to set event loop timer!");
+    return -1;
+  }
+  loop.timer_period_ms = period_ms;
+
+  return 0;
+}
+
+static void event_loop_read(event_loop_t &loop,
+                            const struct epoll_event &ev,
+                            const struct timespec &time) {
+  event_t event;
+  event.time = time;
+  const int fd = ev.data.fd;
+
+  // Key presses
+  if (fd == loop.input_fd) {
+    char keys[EVENT_READ_MAX];
+    const ssize_t len = read(fd, keys, sizeof(keys));
+    if (len == 0) {
+      LOG_WARN("Input closed, no longer reading keys");
+      epoll_ctl(loop.epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    }
+    for (ssize_t i = 0; i < len; i++) {
+      event.type = EVENT_KEY;
+      event.key = keys[i];
+      loop.pending.push_back(event);
+    }
+    return;
+  }
+
+  // Timer, several expirations are reported as one event
+  if (fd == loop.timer_fd) {
+    uint64_t expirations = 0;
+    if (read(fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+      event.type = EVENT_TIMER;
+      loop.pending.push_back(event);
+    }
+    return;
+  }
+
+  // Other threads
+  const auto source = loop.fds.find(fd);
+  if (source != loop.fds.end()) {
+    uint64_t count = 0;
+    if (read(fd, &count, sizeof(count)) == sizeof(count)) {
+      event.type = source->second;
+      loop.pending.push_back(event);
+    }
+    return;
+  }
+
+  // Buttons, the GPIO input queues its own events
+  gpio_input_read(loop.gpio, fd, time);
+}
+
+/**
+ * Turn button presses the GPIO input has accepted into key events.
+ */
+static void event_loop_read_buttons(event_loop_t &loop) {
+  gpio_event_t gpio_event;
+  while (gpio_input_next(loop.gpio, gpio_event)) {
+    const auto button = loop.buttons.find(gpio_event.pin);
+    if (button == loop.buttons.end() || gpio_event.value != LOW) {
+      continue;
+    }
+
+    event_t event;
+    event.type = EVENT_KEY;
+    event.key = button->second;
+    event.time = gpio_event.time;
+    loop.pending.push_back(event);
+  }
+}
+
+/**
+ * Wait up to `timeout_ms` milliseconds (-1 = forever) for the next event.
+ * On timeout, or waking up to settle a button that produced nothing,
+ * `event.type` is `EVENT_NONE`. Returns -1 on error.
+ */
+int event_loop_wait(event_loop_t &loop, event_t &event, const int timeout_ms) {
+  event = event_t();
+
+  if (loop.pending.empty()) {
+    // Wake up early if a button is waiting out its debounce window
+    int timeout = gpio_input_timeout(loop.gpio, tic());
+    if (timeout == -1 || (timeout_ms != -1 && timeout_ms < timeout)) {
+      timeout = timeout_ms;
+    }
+
+    struct epoll_event events[EVENT_MAX_EVENTS];
+    const int nb_events = epoll_wait(loop.epoll_fd, events, EVENT_MAX_EVENTS, timeout);
+    if (nb_events == -1) {
+      if (errno == EINTR) {
+        return 0;
+      }
+      LOG_ERROR("Failed to wait for events!");
+      return -1;
+    }
+
+    const struct timespec time = tic();
+    for (int i = 0; i < nb_events; i++) {
+      event_loop_read(loop, events[i], time);
+    }
+    gpio_input_settle(loop.gpio, time);
+    event_loop_read_buttons(loop);
+  }
+
+  if (loop.pending.empty() == false) {
+    event = loop.pending.front();
+    loop.pending.pop_front();
+  }
+
+  return 0;
+}
+
+/**
+ * Write the time since `since` to the timing log, if there is one.
+ */
+void event_loop_log_time(event_loop_t &loop,
+                         const char *label,
+                         const struct timespec &since) {
+  if (loop.timing_log == nullptr) {
+    return;
+  }
+
+  struct timespec start = since;
+  fprintf(loop.timing_log, "%s %.3f\n", label, toc(&start) * 1e3);
+  fflush(loop.timing_log);
+}
@@ -0,0 +1,80 @@
+#ifndef ZP3_EVENT_HPP
+#define ZP3_EVENT_HPP
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include <deque>
+#include <map>
+
+#include "log.hpp"
+#include "gpio.hpp"
+#include "util.hpp"
+
+/**
+ * Event loop
+ *
+ * A single epoll instance multiplexes everything the UI waits on: key presses
+ * on the terminal (kept in raw mode for as long as the loop is open), button
+ * presses on GPIO pins (debounced by the GPIO input subsystem), a timer for
+ * animation and eventfds signalled by other threads. `event_loop_wait()`
+ * returns the next event stamped with the time it was picked up, so handlers
+ * can measure their latency.
+ *
+ * If a timing log is set, `event_loop_log_time()` appends lines of the form
+ * `<label> <milliseconds>` to it.
+ */
+#define EVENT_NONE 0
+#define EVENT_KEY 1
+#define EVENT_TIMER 2
+#define EVENT_PLAYER 3
+
+#define EVENT_MAX_EVENTS 8
+#define EVENT_READ_MAX 16
+
+struct event_t {
+  int type = EVENT_NONE;
+  int key = 0;
+  struct timespec time;
+};
+
+struct event_loop_t {
+  int epoll_fd = -1;
+  int input_fd = -1;
+  int timer_fd = -1;
+  int timer_period_ms = 0;
+
+  // Terminal settings to restore on close
+  bool raw = false;
+  struct termios termios;
+
+  // Eventfd -> event type
+  std::map<int, int> fds;
+
+  // Buttons, GPIO pin -> key
+  gpio_input_t gpio;
+  std::map<int, char> buttons;
+
+  // Events read but not yet returned
+  std::deque<event_t> pending;
+
+  FILE *timing_log = nullptr;
+};
+
+int event_loop_init(event_loop_t &loop, const int input_fd);
+void event_loop_close(event_loop_t &loop);
+int event_loop_add_fd(event_loop_t &loop, const int fd, const int type);
+int event_loop_add_button(event_loop_t &loop, const int pin, const char key);
+int event_loop_set_timer(event_loop_t &loop, const int period_ms);
+int event_loop_wait(event_loop_t &loop, event_t &event, const int timeout_ms);
+void event_loop_log_time(event_loop_t &loop,
+                         const char *label,
+                         const struct timespec &since);
+
+#endif // ZP3_EVENT_HPP
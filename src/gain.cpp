@@ -0,0 +1,221 @@
+#include "gain.hpp"
+
+int16_t gain_from_linear(const float value) {
+  const float gain = value * GAIN_UNITY;
+  if (gain <= 0.0f) {
+    return 0;
+  } else if (gain >= GAIN_MAX) {
+    return GAIN_MAX;
+  }
+  return lrintf(gain);
+}
+
+int16_t gain_from_db(const float db) {
+  return gain_from_linear(powf(10.0f, db / 20.0f));
+}
+
+bool gain_has_impl(const int impl) {
+  return impl == GAIN_SCALAR || impl == GAIN_BEST;
+}
+
+const char *gain_impl_name(const int impl) {
+  if (impl == GAIN_SSE2) {
+    return "sse2";
+  } else if (impl == GAIN_NEON) {
+    return "neon";
+  }
+  return "scalar";
+}
+
+/**
+ * Linear ramp from `start` to `target` in `nb_steps` steps, the last step
+ * lands on `target` exactly.
+ */
+struct gain_ramp_t {
+  int64_t value = 0;
+  int64_t step = 0;
+  size_t steps_left = 0;
+  int16_t target = 0;
+};
+
+static void gain_ramp_init(gain_ramp_t &ramp,
+                           const int16_t start,
+                           const int16_t target,
+                           const size_t nb_samples) {
+  const size_t nb_steps = (nb_samples + GAIN_LANES - 1) / GAIN_LANES;
+  ramp.value = (int64_t) start << 16;
+  ramp.step = (nb_steps > 0) ? (((int64_t) (target - start)) << 16) / (int64_t) nb_steps : 0;
+  ramp.steps_left = nb_steps;
+  ramp.target = target;
+}
+
+static inline int16_t gain_ramp_next(gain_ramp_t &ramp) {
+  ramp.steps_left--;
+  if (ramp.steps_left == 0) {
+    return ramp.target;
+  }
+  ramp.value += ramp.step;
+  return ramp.value >> 16;
+}
+
+static inline int16_t gain_sample(const int16_t sample, const int16_t gain, const bool clip) {
+  const int32_t value = ((int32_t) sample * gain + (1 << (GAIN_SHIFT - 1))) >> GAIN_SHIFT;
+  if (clip == false) {
+    return (value > INT16_MAX) ? INT16_MAX : (value < INT16_MIN) ? INT16_MIN : value;
+  }
+
+  // Soft clip the magnitude, then put the sign back
+  const int32_t sign = value >> 31;
+  const int32_t magnitude = (value ^ sign) - sign;
+  int32_t x = magnitude - GAIN_CLIP_KNEE;
+  x = (x < 0) ? 0 : (x > GAIN_CLIP_RANGE) ? GAIN_CLIP_RANGE : x;
+  const int32_t bent = x - ((2 * x * x) >> 16);
+  const int32_t clipped = ((magnitude < GAIN_CLIP_KNEE) ? magnitude : GAIN_CLIP_KNEE) + bent;
+  return (clipped ^ sign) - sign;
+}
+
+static void gain_apply_scalar(int16_t *samples,
+                              const size_t nb_samples,
+                              gain_ramp_t &ramp,
+                              const bool clip) {
+  for (size_t i = 0; i < nb_samples; i += GAIN_LANES) {
+    const int16_t gain = gain_ramp_next(ramp);
+    const size_t end = (i + GAIN_LANES < nb_samples) ? i + GAIN_LANES : nb_samples;
+    for (size_t j = i; j < end; j++) {
+      samples[j] = gain_sample(samples[j], gain, clip);
+    }
+  }
+}
+
+#if defined(__SSE2__)
+static void gain_apply_sse2(int16_t *samples,
+                            const size_t nb_samples,
+                            gain_ramp_t &ramp,
+                            const bool clip) {
+  const __m128i round = _mm_set1_epi32(1 << (GAIN_SHIFT - 1));
+  const __m128i knee32 = _mm_set1_epi32(GAIN_CLIP_KNEE);
+  const __m128i knee = _mm_set1_epi16(GAIN_CLIP_KNEE);
+  const __m128i range = _mm_set1_epi16(GAIN_CLIP_RANGE);
+  const __m128i zero = _mm_setzero_si128();
+
+  size_t i = 0;
+  for (; i + GAIN_LANES <= nb_samples; i += GAIN_LANES) {
+    __m128i *block = (__m128i *) (samples + i);
+    const __m128i in = _mm_loadu_si128(block);
+    const __m128i gain = _mm_set1_epi16(gain_ramp_next(ramp));
+
+    // 32-bit products, rounded back to sample scale
+    const __m128i lo = _mm_mullo_epi16(in, gain);
+    const __m128i hi = _mm_mulhi_epi16(in, gain);
+    __m128i v0 = _mm_unpacklo_epi16(lo, hi);
+    __m128i v1 = _mm_unpackhi_epi16(lo, hi);
+    v0 = _mm_srai_epi32(_mm_add_epi32(v0, round), GAIN_SHIFT);
+    v1 = _mm_srai_epi32(_mm_add_epi32(v1, round), GAIN_SHIFT);
+    if (clip == false) {
+      _mm_storeu_si128(block, _mm_packs_epi32(v0, v1));
+      continue;
+    }
+
+    // Magnitudes
+    const __m128i sign0 = _mm_srai_epi32(v0, 31);
+    const __m128i sign1 = _mm_srai_epi32(v1, 31);
+    const __m128i mag0 = _mm_sub_epi32(_mm_xor_si128(v0, sign0), sign0);
+    const __m128i mag1 = _mm_sub_epi32(_mm_xor_si128(v1, sign1), sign1);
+
+    // Bend what is above the knee
+    __m128i x = _mm_packs_epi32(_mm_sub_epi32(mag0, knee32), _mm_sub_epi32(mag1, knee32));
+    x = _mm_min_epi16(_mm_max_epi16(x, zero), range);
+    const __m128i bent = _mm_sub_epi16(x, _mm_mulhi_epu16(_mm_add_epi16(x, x), x));
+    const __m128i mag = _mm_min_epi16(_mm_packs_epi32(mag0, mag1), knee);
+    const __m128i clipped = _mm_add_epi16(mag, bent);
+
+    const __m128i sign = _mm_packs_epi32(sign0, sign1);
+    _mm_storeu_si128(block, _mm_sub_epi16(_mm_xor_si128(clipped, sign), sign));
+  }
+
+  gain_apply_scalar(samples + i, nb_samples - i, ramp, clip);
+}
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+static void gain_apply_neon(int16_t *samples,
+                            const size_t nb_samples,
+                            gain_ramp_t &ramp,
+                            const bool clip) {
+  const int32x4_t knee32 = vdupq_n_s32(GAIN_CLIP_KNEE);
+  const int16x8_t knee = vdupq_n_s16(GAIN_CLIP_KNEE);
+  const int16x8_t range = vdupq_n_s16(GAIN_CLIP_RANGE);
+  const int16x8_t zero = vdupq_n_s16(0);
+
+  size_t i = 0;
+  for (; i + GAIN_LANES <= nb_samples; i += GAIN_LANES) {
+    int16_t *block = samples + i;
+    const int16x8_t in = vld1q_s16(block);
+    const int16x4_t gain = vdup_n_s16(gain_ramp_next(ramp));
+
+    // 32-bit products, rounded back to sample scale
+    const int32x4_t v0 = vrshrq_n_s32(vmull_s16(vget_low_s16(in), gain), GAIN_SHIFT);
+    const int32x4_t v1 = vrshrq_n_s32(vmull_s16(vget_high_s16(in), gain), GAIN_SHIFT);
+    if (clip == false) {
+      vst1q_s16(block, vcombine_s16(vqmovn_s32(v0), vqmovn_s32(v1)));
+      continue;
+    }
+
+    // Magnitudes
+    const int32x4_t sign0 = vshrq_n_s32(v0, 31);
+    const int32x4_t sign1 = vshrq_n_s32(v1, 31);
+    const int32x4_t mag0 = vabsq_s32(v0);
+    const int32x4_t mag1 = vabsq_s32(v1);
+
+    // Bend what is above the knee
+    int16x8_t x = vcombine_s16(vqmovn_s32(vsubq_s32(mag0, knee32)),
+                               vqmovn_s32(vsubq_s32(mag1, knee32)));
+    x = vminq_s16(vmaxq_s16(x, zero), range);
+    const uint16x8_t ux = vreinterpretq_u16_s16(x);
+    const uint16x8_t ux2 = vaddq_u16(ux, ux);
+    const uint16x8_t square = vcombine_u16(
+        vshrn_n_u32(vmull_u16(vget_low_u16(ux2), vget_low_u16(ux)), 16),
+        vshrn_n_u32(vmull_u16(vget_high_u16(ux2), vget_high_u16(ux)), 16));
+    const int16x8_t bent = vsubq_s16(x, vreinterpretq_s16_u16(square));
+    const int16x8_t mag = vminq_s16(vcombine_s16(vqmovn_s32(mag0), vqmovn_s32(mag1)), knee);
+    const int16x8_t clipped = vaddq_s16(mag, bent);
+
+    const int16x8_t sign = vcombine_s16(vmovn_s32(sign0), vmovn_s32(sign1));
+    vst1q_s16(block, vsubq_s16(veorq_s16(clipped, sign), sign));
+  }
+
+  gain_apply_scalar(samples + i, nb_samples - i, ramp, clip);
+}
+#endif
+
+/**
+ * Scale `nb_samples` interleaved samples in place, ramping from the gain the
+ * last buffer ended on to `target`.
+ */
+void gain_apply(gain_t &gain,
+                int16_t *samples,
+                const size_t nb_samples,
+                const int16_t target) {
+  const int16_t start = gain.current;
+  gain.current = target;
+  if (start == GAIN_UNITY && target == GAIN_UNITY) {
+    return;
+  }
+
+  gain_ramp_t ramp;
+  gain_ramp_init(ramp, start, target, nb_samples);
+  const bool clip = gain.soft_clip && (start > GAIN_UNITY || target > GAIN_UNITY);
+#if defined(__SSE2__)
+  if (gain.impl == GAIN_SSE2) {
+    gain_apply_sse2(samples, nb_samples, ramp, clip);
+    return;
+  }
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  if (gain.impl == GAIN_NEON) {
+    gain_apply_neon(samples, nb_samples, ramp, clip);
+    return;
+  }
+#endif
+  gain_apply_scalar(samples, nb_samples, ramp, clip);
+}
@@ -0,0 +1,71 @@
+#ifndef ZP3_GAIN_HPP
+#define ZP3_GAIN_HPP
+
+#include <math.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+/**
+ * Gain stage
+ *
+ * Scales decoded 16-bit PCM in place, after the decoder and before the
+ * samples are queued for output. Gains are Q12 fixed point
+ * (`GAIN_UNITY` = 1.0), which covers mute to just under +18 dB.
+ *
+ * A change of gain is ramped linearly across the next buffer instead of
+ * being applied as a step, which is what makes volume changes click. The
+ * ramp moves every `GAIN_LANES` samples, so a SIMD register of samples
+ * always shares one gain.
+ *
+ * Samples can only go past full scale while the gain is above unity. Then
+ * they are soft clipped: everything above `GAIN_CLIP_KNEE` is bent over a
+ * quadratic that meets full scale with zero slope, `GAIN_CLIP_RANGE` above
+ * the knee. At unity the samples are left untouched.
+ *
+ * The SSE2 and NEON implementations produce exactly the same output as the
+ * scalar one, `gain.impl` picks one and defaults to the best available.
+ */
+#define GAIN_SHIFT 12
+#define GAIN_UNITY (1 << GAIN_SHIFT)
+#define GAIN_MAX INT16_MAX
+#define GAIN_CLIP_KNEE 24575
+#define GAIN_CLIP_RANGE 16384
+#define GAIN_LANES 8
+
+#define GAIN_SCALAR 0
+#define GAIN_SSE2 1
+#define GAIN_NEON 2
+
+#if defined(__SSE2__)
+#define GAIN_BEST GAIN_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define GAIN_BEST GAIN_NEON
+#else
+#define GAIN_BEST GAIN_SCALAR
+#endif
+
+struct gain_t {
+  int impl = GAIN_BEST;
+  bool soft_clip = true;
+
+  // Gain at the end of the last buffer, the next ramp starts here
+  int16_t current = GAIN_UNITY;
+};
+
+int16_t gain_from_linear(const float value);
+int16_t gain_from_db(const float db);
+bool gain_has_impl(const int impl);
+const char *gain_impl_name(const int impl);
+void gain_apply(gain_t &gain,
+                int16_t *samples,
+                const size_t nb_samples,
+                const int16_t target);
+
+#endif // ZP3_GAIN_HPP
@@ -87,3 +87,244 @@ int gpio_write(const int pin, const int value) {
   close(fd);
   return 0;
 }
+
+static int gpio_write_file(const std::string &path, const std::string &value) {
+  int fd = open(path.c_str(), O_WRONLY);
+  if (-1 == fd) {
+    fprintf(stderr, "Failed to open [%s] for writing!\n", path.c_str());
+    return -1;
+  }
+
+  if ((ssize_t) value.length() != write(fd, value.c_str(), value.length())) {
+    fprintf(stderr, "Failed to write [%s]!\n", path.c_str());
+    close(fd);
+    return -1;
+  }
+
+  close(fd);
+  return 0;
+}
+
+static int gpio_read_fd(const int fd) {
+  char value_str[3] = {0};
+  if (lseek(fd, 0, SEEK_SET) != 0 || read(fd, value_str, 2) <= 0) {
+    return -1;
+  }
+
+  return atoi(value_str);
+}
+
+static float gpio_elapsed_ms(const struct timespec &since, const struct timespec &now) {
+  return (now.tv_sec - since.tv_sec) * 1e3 + (now.tv_nsec - since.tv_nsec) * 1e-6;
+}
+
+/**
+ * Debounce a new reading of `line`, queueing an event if it is accepted.
+ */
+static int gpio_line_update(gpio_input_t &input,
+                            gpio_line_t &line,
+                            const int value,
+                            const struct timespec &time) {
+  // Bounced back to where it was
+  if (value == line.value) {
+    line.pending = false;
+    return 0;
+  }
+
+  // Too soon after the last change, look again once the window has passed
+  if (gpio_elapsed_ms(line.changed, time) < input.debounce_ms) {
+    line.pending = true;
+    return 0;
+  }
+
+  line.value = value;
+  line.changed = time;
+  line.pending = false;
+
+  gpio_event_t event;
+  event.pin = line.pin;
+  event.value = value;
+  event.time = time;
+  input.events.push_back(event);
+
+  return 1;
+}
+
+void gpio_input_init(gpio_input_t &input,
+                     const std::string &root,
+                     const int debounce_ms) {
+  gpio_input_close(input);
+  input.root = root;
+  input.debounce_ms = debounce_ms;
+}
+
+void gpio_input_close(gpio_input_t &input) {
+  for (const auto &line : input.lines) {
+    close(line.fd);
+  }
+  input.lines.clear();
+  input.events.clear();
+}
+
+/**
+ * Export `pin` as an input that interrupts on `edge` ("rising", "falling" or
+ * "both") and keep its value file open. Returns the value fd, or -1 on
+ * failure.
+ */
+int gpio_input_add(gpio_input_t &input, const int pin, const char *edge) {
+  char path[GPIO_PATH_MAX];
+  snprintf(path, GPIO_PATH_MAX, "%s/gpio%d", input.root.c_str(), pin);
+
+  // Export
+  struct stat st;
+  if (stat(path, &st) != 0) {
+    const std::string export_path = input.root + "/export";
+    if (gpio_write_file(export_path, std::to_string(pin)) != 0) {
+      return -1;
+    }
+  }
+
+  // Configure
+  const std::string dir(path);
+  if (gpio_write_file(dir + "/direction", "in") != 0
+      || gpio_write_file(dir + "/edge", edge) != 0) {
+    return -1;
+  }
+
+  // Open the value file and read it, which also clears any pending edge
+  gpio_line_t line;
+  line.pin = pin;
+  line.fd = open((dir + "/value").c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+  if (line.fd == -1) {
+    fprintf(stderr, "Failed to open gpio value for reading!\n");
+    return -1;
+  }
+  line.value = gpio_read_fd(line.fd);
+  if (line.value == -1) {
+    fprintf(stderr, "Failed to read value!\n");
+    close(line.fd);
+    return -1;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &line.changed);
+  input.lines.push_back(line);
+
+  return line.fd;
+}
+
+/**
+ * Stop watching `pin` and close its value file. The pin stays exported.
+ */
+void gpio_input_remove(gpio_input_t &input, const int pin) {
+  for (auto it = input.lines.begin(); it != input.lines.end(); ++it) {
+    if (it->pin == pin) {
+      close(it->fd);
+      input.lines.erase(it);
+      return;
+    }
+  }
+}
+
+/**
+ * Read the pin behind value fd `fd` after its edge fired at `time`. Returns
+ * 1 if an event was queued, 0 if not and -1 on failure.
+ */
+int gpio_input_read(gpio_input_t &input, const int fd, const struct timespec &time) {
+  for (auto &line : input.lines) {
+    if (line.fd != fd) {
+      continue;
+    }
+
+    const int value = gpio_read_fd(fd);
+    if (value == -1) {
+      return -1;
+    }
+    return gpio_line_update(input, line, value, time);
+  }
+
+  return -1;
+}
+
+/**
+ * Milliseconds until a held back change has to be looked at again with
+ * `gpio_input_settle()`, or -1 if there is none.
+ */
+int gpio_input_timeout(const gpio_input_t &input, const struct timespec &now) {
+  int timeout = -1;
+  for (const auto &line : input.lines) {
+    if (line.pending == false) {
+      continue;
+    }
+
+    const float remaining = input.debounce_ms - gpio_elapsed_ms(line.changed, now);
+    const int ms = (remaining > 0.0f) ? (int) remaining + 1 : 0;
+    timeout = (timeout == -1 || ms < timeout) ? ms : timeout;
+  }
+
+  return timeout;
+}
+
+/**
+ * Read every pin whose change was held back and whose debounce window has
+ * passed.
+ */
+void gpio_input_settle(gpio_input_t &input, const struct timespec &now) {
+  for (auto &line : input.lines) {
+    if (line.pending && gpio_elapsed_ms(line.changed, now) >= input.debounce_ms) {
+      const int value = gpio_read_fd(line.fd);
+      if (value != -1) {
+        gpio_line_update(input, line, value, now);
+      }
+    }
+  }
+}
+
+/**
+ * Wait up to `timeout_ms` milliseconds (-1 = forever) for any input to
+ * change. Returns the number of events queued, or -1 on failure.
+ */
+int gpio_input_poll(gpio_input_t &input, const int timeout_ms) {
+  std::vector<struct pollfd> fds(input.lines.size());
+  for (size_t i = 0; i < input.lines.size(); i++) {
+    fds[i].fd = input.lines[i].fd;
+    fds[i].events = POLLPRI | POLLERR;
+    fds[i].revents = 0;
+  }
+
+  // Wake up early to settle held back changes
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  int timeout = gpio_input_timeout(input, now);
+  if (timeout == -1 || (timeout_ms != -1 && timeout_ms < timeout)) {
+    timeout = timeout_ms;
+  }
+
+  const size_t nb_events = input.events.size();
+  const int retval = poll(fds.data(), fds.size(), timeout);
+  if (retval == -1 && errno != EINTR) {
+    fprintf(stderr, "Failed to poll gpio inputs!\n");
+    return -1;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  for (const auto &fd : fds) {
+    if (fd.revents & (POLLPRI | POLLERR)) {
+      gpio_input_read(input, fd.fd, now);
+    }
+  }
+  gpio_input_settle(input, now);
+
+  return input.events.size() - nb_events;
+}
+
+/**
+ * Pop the oldest queued event. Returns false if there is none.
+ */
+bool gpio_input_next(gpio_input_t &input, gpio_event_t &event) {
+  if (input.events.empty()) {
+    return false;
+  }
+
+  event = input.events.front();
+  input.events.pop_front();
+  return true;
+}
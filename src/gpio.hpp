@@ -3,11 +3,19 @@
 
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <deque>
+#include <string>
+#include <vector>
+
 #define GPIO_BUFFER_MAX 3
 #define GPIO_VALUE_MAX 30
 #define GPIO_DIRECTION_MAX 35
@@ -27,4 +35,53 @@ int gpio_direction(const int pin, const int dir);
 int gpio_read(const int pin);
 int gpio_write(const int pin, const int value);
 
+/**
+ * GPIO input
+ *
+ * Input pins are exported from the sysfs tree at `root` with an `edge`
+ * configured, and their value files are kept open. The kernel flags a value
+ * fd with POLLPRI when its edge fires, so inputs are waited on with `poll()`
+ * (or the fds handed to an epoll loop) instead of being sampled.
+ *
+ * Changes are debounced in software: a change less than `debounce_ms` after
+ * the last accepted one is held back, and the pin is read again once the
+ * window has passed. Accepted changes are queued as timestamped events.
+ */
+#define GPIO_SYSFS_ROOT "/sys/class/gpio"
+#define GPIO_PATH_MAX 256
+#define GPIO_DEBOUNCE_MS 20
+
+struct gpio_event_t {
+  int pin = -1;
+  int value = 0;
+  struct timespec time;
+};
+
+struct gpio_line_t {
+  int pin = -1;
+  int fd = -1;
+  int value = 0;
+  bool pending = false;
+  struct timespec changed;
+};
+
+struct gpio_input_t {
+  std::string root = GPIO_SYSFS_ROOT;
+  int debounce_ms = GPIO_DEBOUNCE_MS;
+  std::vector<gpio_line_t> lines;
+  std::deque<gpio_event_t> events;
+};
+
+void gpio_input_init(gpio_input_t &input,
+                     const std::string &root=GPIO_SYSFS_ROOT,
+                     const int debounce_ms=GPIO_DEBOUNCE_MS);
+void gpio_input_close(gpio_input_t &input);
+int gpio_input_add(gpio_input_t &input, const int pin, const char *edge="both");
+void gpio_input_remove(gpio_input_t &input, const int pin);
+int gpio_input_read(gpio_input_t &input, const int fd, const struct timespec &time);
+int gpio_input_timeout(const gpio_input_t &input, const struct timespec &now);
+void gpio_input_settle(gpio_input_t &input, const struct timespec &now);
+int gpio_input_poll(gpio_input_t &input, const int timeout_ms);
+bool gpio_input_next(gpio_input_t &input, gpio_event_t &event);
+
 #endif // ZP3_GPIO_HPP
@@ -0,0 +1,298 @@
+#include "id3.hpp"
+
+static uint32_t id3_syncsafe(const uint8_t *data) {
+  return ((data[0] & 0x7f) << 21)
+         | ((data[1] & 0x7f) << 14)
+         | ((data[2] & 0x7f) << 7)
+         | (data[3] & 0x7f);
+}
+
+static uint32_t id3_uint(const uint8_t *data, const size_t nb_bytes) {
+  uint32_t value = 0;
+  for (size_t i = 0; i < nb_bytes; i++) {
+    value = (value << 8) | data[i];
+  }
+  return value;
+}
+
+static void id3_strip(std::string &value, const std::string &chars) {
+  const auto end = value.find_last_not_of(chars);
+  value.erase((end == std::string::npos) ? 0 : end + 1);
+  value.erase(0, value.find_first_not_of(chars));
+}
+
+/**
+ * Append unicode code point `c` to `out` as Latin-1 (which is what
+ * TagLib::String::toCString() returns). Fails on anything wider.
+ */
+static int id3_put_char(std::string &out, const uint32_t c) {
+  if (c > 0xff) {
+    return -1;
+  }
+  out.push_back((char) c);
+  return 0;
+}
+
+static int id3_decode_utf16(std::string &out,
+                            const uint8_t *data,
+                            const size_t size,
+                            bool big_endian,
+                            size_t &pos) {
+  for (; pos + 1 < size; pos += 2) {
+    const uint16_t c = big_endian ? (data[pos] << 8) | data[pos + 1]
+                                  : (data[pos + 1] << 8) | data[pos];
+    if (c == 0) {
+      pos += 2;
+      break;
+    }
+    if (id3_put_char(out, c) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static int id3_decode_utf8(std::string &out,
+                           const uint8_t *data,
+                           const size_t size,
+                           size_t &pos) {
+  while (pos < size) {
+    const uint8_t c = data[pos];
+    if (c == 0) {
+      pos++;
+      break;
+    } else if (c < 0x80) {
+      out.push_back(c);
+      pos++;
+    } else if ((c & 0xe0) == 0xc0 && pos + 1 < size) {
+      const uint32_t cp = ((c & 0x1f) << 6) | (data[pos + 1] & 0x3f);
+      if (id3_put_char(out, cp) != 0) {
+        return -1;
+      }
+      pos += 2;
+    } else {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Decode a text information frame body into Latin-1. Only single valued
+ * frames are supported.
+ */
+static int id3_decode_text(std::string &out,
+                           const uint8_t *data,
+                           const size_t size) {
+  if (size < 1) {
+    return -1;
+  }
+
+  const uint8_t encoding = data[0];
+  size_t pos = 1;
+  int retval = 0;
+  out.clear();
+
+  switch (encoding) {
+    case 0: // Latin-1
+      while (pos < size && data[pos] != 0) {
+        out.push_back(data[pos++]);
+      }
+      pos++;
+      break;
+    case 1: // UTF-16 with BOM
+      if (size < 3) {
+        return -1;
+      }
+      pos = 3;
+      retval = id3_decode_utf16(out, data, size, data[1] == 0xfe, pos);
+      break;
+    case 2: // UTF-16BE
+      retval = id3_decode_utf16(out, data, size, true, pos);
+      break;
+    case 3: // UTF-8
+      retval = id3_decode_utf8(out, data, size, pos);
+      break;
+    default:
+      return -1;
+  }
+  if (retval != 0) {
+    return -1;
+  }
+
+  // Multiple values are joined differently by TagLib, leave those to it
+  for (; pos < size; pos++) {
+    if (data[pos] != 0) {
+      return -1;
+    }
+  }
+
+  out.erase(out.find_last_not_of('\0') + 1);
+  return 0;
+}
+
+int id3v2_parse(id3_tag_t &tag, const uint8_t *data, const size_t size) {
+  // Header
+  if (size < 10 || data[0] != 'I' || data[1] != 'D' || data[2] != '3') {
+    return -1;
+  }
+  const uint8_t version = data[3];
+  const uint8_t flags = data[5];
+  const size_t tag_size = id3_syncsafe(data + 6);
+  if (version < 2 || version > 4 || (flags & 0x80)) {
+    // Unsupported version or whole tag unsynchronised
+    return -1;
+  }
+  // Frames that do not fit in what was read could hold any of the fields
+  const bool truncated = (10 + tag_size > size);
+  const size_t end = truncated ? size : 10 + tag_size;
+  size_t pos = 10;
+
+  // Skip extended header
+  if (version > 2 && (flags & 0x40)) {
+    if (pos + 4 > end) {
+      return -1;
+    }
+    if (version == 3) {
+      pos += 4 + id3_uint(data + pos, 4);
+    } else {
+      pos += id3_syncsafe(data + pos);
+    }
+  }
+
+  // Frames
+  const size_t id_len = (version == 2) ? 3 : 4;
+  const size_t header_len = (version == 2) ? 6 : 10;
+  while (pos + header_len <= end) {
+    const uint8_t *frame = data + pos;
+    if (frame[0] == 0) {
+      return 0; // Padding
+    }
+
+    size_t frame_size = 0;
+    uint8_t frame_flags = 0;
+    if (version == 2) {
+      frame_size = id3_uint(frame + 3, 3);
+    } else if (version == 3) {
+      frame_size = id3_uint(frame + 4, 4);
+      frame_flags = frame[9];
+    } else {
+      frame_size = id3_syncsafe(frame + 4);
+      frame_flags = frame[9];
+    }
+    if (pos + header_len + frame_size > end) {
+      break; // Frame extends past the tag, or past what was read
+    }
+
+    // Only text frames we care about
+    const std::string id((const char *) frame, id_len);
+    std::string *text = nullptr;
+    int *number = nullptr;
+    if (id == "TIT2" || id == "TT2") {
+      text = &tag.title;
+    } else if (id == "TPE1" || id == "TP1") {
+      text = &tag.artist;
+    } else if (id == "TALB" || id == "TAL") {
+      text = &tag.album;
+    } else if (id == "TDRC" || id == "TYER" || id == "TYE") {
+      number = &tag.year;
+    } else if (id == "TRCK" || id == "TRK") {
+      number = &tag.track_number;
+    }
+
+    if (text || number) {
+      // Compressed, encrypted, unsynchronised or with a data length
+      // indicator: let TagLib deal with it
+      const uint8_t unsupported = (version == 3) ? 0xe0 : 0x4f;
+      if (frame_flags & unsupported) {
+        return -1;
+      }
+
+      std::string value;
+      if (id3_decode_text(value, frame + header_len, frame_size) != 0) {
+        return -1;
+      }
+      if (text) {
+        *text = value;
+      } else {
+        *number = atoi(value.c_str());
+      }
+    }
+
+    pos += header_len + frame_size;
+  }
+
+  // Cut short, only trust it if nothing is left to find
+  const bool complete = tag.title != "" && tag.artist != "" && tag.album != ""
+                        && tag.year != 0 && tag.track_number != 0;
+  return (truncated && complete == false) ? -1 : 0;
+}
+
+int id3v1_parse(id3_tag_t &tag, const uint8_t *data, const size_t size) {
+  if (size < ID3V1_SIZE || data[0] != 'T' || data[1] != 'A' || data[2] != 'G') {
+    return -1;
+  }
+
+  // Fields are fixed width Latin-1, only fill in what ID3v2 did not provide
+  std::string title((const char *) data + 3, 30);
+  std::string artist((const char *) data + 33, 30);
+  std::string album((const char *) data + 63, 30);
+  std::string year((const char *) data + 93, 4);
+  title.erase(std::min(title.find('\0'), title.size()));
+  artist.erase(std::min(artist.find('\0'), artist.size()));
+  album.erase(std::min(album.find('\0'), album.size()));
+  id3_strip(title, " \t\n\r");
+  id3_strip(artist, " \t\n\r");
+  id3_strip(album, " \t\n\r");
+
+  tag.title = (tag.title == "") ? title : tag.title;
+  tag.artist = (tag.artist == "") ? artist : tag.artist;
+  tag.album = (tag.album == "") ? album : tag.album;
+  tag.year = (tag.year == 0) ? atoi(year.c_str()) : tag.year;
+
+  // ID3v1.1 keeps the track number at the end of the comment
+  if (tag.track_number == 0 && data[125] == 0 && data[126] != 0) {
+    tag.track_number = data[126];
+  }
+
+  return 0;
+}
+
+int id3_read(id3_tag_t &tag, const std::string &path) {
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return -1;
+  }
+
+  // ID3v2 lives at the start of the file
+  uint8_t buf[ID3_READ_SIZE];
+  ssize_t nb_read = pread(fd, buf, ID3_READ_SIZE, 0);
+  int retval = -1;
+  if (nb_read > 0) {
+    retval = id3v2_parse(tag, buf, nb_read);
+    if (retval != 0 && nb_read >= 10 && memcmp(buf, "ID3", 3) == 0) {
+      // ID3v2 tag present but not something we can decode
+      close(fd);
+      return -1;
+    }
+  }
+
+  // ID3v1 lives in the last 128 bytes, it fills in any field still missing
+  if (tag.title == "" || tag.artist == "" || tag.album == ""
+      || tag.year == 0 || tag.track_number == 0) {
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size >= ID3V1_SIZE) {
+      nb_read = pread(fd, buf, ID3V1_SIZE, st.st_size - ID3V1_SIZE);
+      if (nb_read == ID3V1_SIZE && id3v1_parse(tag, buf, nb_read) == 0) {
+        retval = 0;
+      }
+    }
+  }
+  close(fd);
+
+  if (retval != 0 || tag.title == "" || tag.artist == "") {
+    return -1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,41 @@
+#ifndef ZP3_ID3_HPP
+#define ZP3_ID3_HPP
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <string>
+
+/**
+ * Lightweight ID3 tag reader
+ *
+ * Decodes only the fields the music library uses from the head of an ID3v2
+ * tag (v2.2, v2.3 and v2.4) and the 128 byte ID3v1 tail. Anything it cannot
+ * represent faithfully (unsynchronised or compressed frames, text outside of
+ * Latin-1, multi-valued text frames) is reported as a failure so the caller
+ * can fall back to TagLib, and so is a tag that runs past the first
+ * `ID3_READ_SIZE` bytes (typically because of embedded cover art) unless the
+ * fields were all found before that point. Like TagLib, year and track
+ * number are 0 when not present.
+ */
+#define ID3_READ_SIZE 8192
+#define ID3V1_SIZE 128
+
+struct id3_tag_t {
+  std::string title;
+  std::string artist;
+  std::string album;
+  int year = 0;
+  int track_number = 0;
+};
+
+int id3v2_parse(id3_tag_t &tag, const uint8_t *data, const size_t size);
+int id3v1_parse(id3_tag_t &tag, const uint8_t *data, const size_t size);
+int id3_read(id3_tag_t &tag, const std::string &path);
+
+#endif // ZP3_ID3_HPP
@@ -0,0 +1,137 @@
+#include "loudness.hpp"
+
+/**
+ * Set up the K-weighting filters for `rate`, the coefficients are derived
+ * from the analog prototypes in BS.1770 so any sample rate works.
+ */
+int loudness_meter_init(loudness_meter_t &meter, const long rate, const int channels) {
+  meter = loudness_meter_t();
+  if (rate <= 0 || channels <= 0 || channels > LOUDNESS_MAX_CHANNELS) {
+    return -1;
+  }
+  meter.rate = rate;
+  meter.channels = channels;
+  meter.subblock_size = rate / 10;
+  for (int c = 0; c < LOUDNESS_MAX_CHANNELS; c++) {
+    for (int i = 0; i < 4; i++) {
+      meter.state[c][i] = 0.0;
+    }
+  }
+
+  // High shelf, +4 dB above about 1.7 kHz
+  double f0 = 1681.974450955533;
+  double Q = 0.7071752369554196;
+  double K = tan(M_PI * f0 / rate);
+  const double Vh = pow(10.0, 3.999843853973347 / 20.0);
+  const double Vb = pow(Vh, 0.4996667741545416);
+  double a0 = 1.0 + K / Q + K * K;
+  meter.shelf.b[0] = (Vh + Vb * K / Q + K * K) / a0;
+  meter.shelf.b[1] = 2.0 * (K * K - Vh) / a0;
+  meter.shelf.b[2] = (Vh - Vb * K / Q + K * K) / a0;
+  meter.shelf.a[0] = 1.0;
+  meter.shelf.a[1] = 2.0 * (K * K - 1.0) / a0;
+  meter.shelf.a[2] = (1.0 - K / Q + K * K) / a0;
+
+  // High pass at about 38 Hz
+  f0 = 38.13547087602444;
+  Q = 0.5003270373238773;
+  K = tan(M_PI * f0 / rate);
+  a0 = 1.0 + K / Q + K * K;
+  meter.highpass.b[0] = 1.0;
+  meter.highpass.b[1] = -2.0;
+  meter.highpass.b[2] = 1.0;
+  meter.highpass.a[0] = 1.0;
+  meter.highpass.a[1] = 2.0 * (K * K - 1.0) / a0;
+  meter.highpass.a[2] = (1.0 - K / Q + K * K) / a0;
+
+  return 0;
+}
+
+/**
+ * Run one sample through a biquad in direct form II, `z` is its state.
+ */
+static inline double loudness_filter(const loudness_biquad_t &f, double *z, const double x) {
+  const double w = x - f.a[1] * z[0] - f.a[2] * z[1];
+  const double y = f.b[0] * w + f.b[1] * z[0] + f.b[2] * z[1];
+  z[1] = z[0];
+  z[0] = w;
+  return y;
+}
+
+/**
+ * Feed `nb_frames` frames of interleaved samples to the meter.
+ */
+void loudness_meter_add(loudness_meter_t &meter,
+                        const int16_t *samples,
+                        const size_t nb_frames) {
+  int peak = meter.peak * 32768.0f;
+  for (size_t i = 0; i < nb_frames; i++) {
+    const int16_t *frame = samples + i * meter.channels;
+    for (int c = 0; c < meter.channels; c++) {
+      const int magnitude = (frame[c] < 0) ? -frame[c] : frame[c];
+      peak = (magnitude > peak) ? magnitude : peak;
+
+      double x = frame[c] / 32768.0;
+      x = loudness_filter(meter.shelf, meter.state[c], x);
+      x = loudness_filter(meter.highpass, meter.state[c] + 2, x);
+      meter.subblock_sum += x * x;
+    }
+
+    // End of a sub-block, every one from the fourth on completes a block
+    meter.subblock_fill++;
+    if (meter.subblock_fill < meter.subblock_size) {
+      continue;
+    }
+    meter.subblocks[meter.nb_subblocks % LOUDNESS_SUBBLOCKS] =
+        meter.subblock_sum / meter.subblock_size;
+    meter.nb_subblocks++;
+    meter.subblock_sum = 0.0;
+    meter.subblock_fill = 0;
+    if (meter.nb_subblocks >= LOUDNESS_SUBBLOCKS) {
+      double sum = 0.0;
+      for (int j = 0; j < LOUDNESS_SUBBLOCKS; j++) {
+        sum += meter.subblocks[j];
+      }
+      meter.blocks.push_back(sum / LOUDNESS_SUBBLOCKS);
+    }
+  }
+  meter.peak = peak / 32768.0f;
+}
+
+static double loudness_lufs(const double mean_square) {
+  return -0.691 + 10.0 * log10(mean_square);
+}
+
+/**
+ * Gated loudness in LUFS of the blocks in `blocks`. Returns
+ * `LOUDNESS_ABSOLUTE_GATE` if nothing is above it, e.g. silence.
+ */
+double loudness_integrated(const std::vector<double> &blocks) {
+  // Absolute gate
+  const double absolute = pow(10.0, (LOUDNESS_ABSOLUTE_GATE + 0.691) / 10.0);
+  double sum = 0.0;
+  size_t count = 0;
+  for (const auto block : blocks) {
+    if (block > absolute) {
+      sum += block;
+      count++;
+    }
+  }
+  if (count == 0) {
+    return LOUDNESS_ABSOLUTE_GATE;
+  }
+
+  // Relative gate, below the loudness of what passed the absolute gate
+  const double relative = (sum / count) * pow(10.0, LOUDNESS_RELATIVE_GATE / 10.0);
+  const double gate = (relative > absolute) ? relative : absolute;
+  sum = 0.0;
+  count = 0;
+  for (const auto block : blocks) {
+    if (block > gate) {
+      sum += block;
+      count++;
+    }
+  }
+
+  return loudness_lufs(sum / count);
+}
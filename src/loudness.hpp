@@ -0,0 +1,60 @@
+#ifndef ZP3_LOUDNESS_HPP
+#define ZP3_LOUDNESS_HPP
+
+#include <math.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+/**
+ * Loudness meter
+ *
+ * Measures integrated loudness as specified by EBU R128 / ITU-R BS.1770:
+ * samples are K-weighted (a high shelf followed by a high pass), the mean
+ * square is taken over 400 ms blocks overlapping by 75%, and the blocks
+ * below an absolute gate of -70 LUFS and a relative gate 10 LU under the
+ * ungated loudness are dropped. Channels are weighted equally, which is
+ * exact for mono and stereo.
+ *
+ * `blocks` keeps the mean square of every block, so the loudness of an
+ * album is that of the blocks of all its tracks taken together. The sample
+ * peak is kept in `peak`, relative to full scale.
+ */
+#define LOUDNESS_SUBBLOCKS 4
+#define LOUDNESS_ABSOLUTE_GATE -70.0
+#define LOUDNESS_RELATIVE_GATE -10.0
+#define LOUDNESS_MAX_CHANNELS 8
+
+struct loudness_biquad_t {
+  double b[3] = {0.0, 0.0, 0.0};
+  double a[3] = {0.0, 0.0, 0.0};
+};
+
+struct loudness_meter_t {
+  long rate = 0;
+  int channels = 0;
+
+  // K-weighting, and the filter state per channel
+  loudness_biquad_t shelf;
+  loudness_biquad_t highpass;
+  double state[LOUDNESS_MAX_CHANNELS][4];
+
+  // 100 ms sub-blocks, four of which make a block
+  size_t subblock_size = 0;
+  size_t subblock_fill = 0;
+  double subblock_sum = 0.0;
+  double subblocks[LOUDNESS_SUBBLOCKS];
+  size_t nb_subblocks = 0;
+
+  std::vector<double> blocks;
+  float peak = 0.0f;
+};
+
+int loudness_meter_init(loudness_meter_t &meter, const long rate, const int channels);
+void loudness_meter_add(loudness_meter_t &meter,
+                        const int16_t *samples,
+                        const size_t nb_frames);
+double loudness_integrated(const std::vector<double> &blocks);
+
+#endif // ZP3_LOUDNESS_HPP
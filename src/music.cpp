@@ -1,5 +1,7 @@
 #include "music.hpp"
 
+const std::vector<std::string> music_file_exts = {"mp3", "flac", "wav"};
+
 bool song_comparator(const song_t &s1, const song_t &s2) {
   if (s1.artist != s2.artist) {
     return (s1.artist < s2.artist);
@@ -12,6 +14,61 @@ bool song_comparator(const song_t &s1, const song_t &s2) {
   return (s1.track_number < s2.track_number);
 }
 
+/**
+ * Copy-on-write: make `ptr` point to a copy of what it points to if anything
+ * else refers to it, so it can be modified without affecting other copies.
+ */
+template <typename T>
+static T &music_unshare(std::shared_ptr<T> &ptr) {
+  if (ptr.use_count() > 1) {
+    ptr = std::make_shared<T>(*ptr);
+  }
+  return *ptr;
+}
+
+str_id_t string_pool_intern(string_pool_t &pool, const std::string &value) {
+  if (pool.shards.empty()) {
+    for (size_t i = 0; i < STRING_POOL_SHARDS; i++) {
+      pool.shards.push_back(std::make_shared<string_shard_t>());
+    }
+  }
+
+  auto &shard = pool.shards[std::hash<std::string>()(value) % STRING_POOL_SHARDS];
+  const auto it = shard->find(value);
+  if (it != shard->end()) {
+    return it->second;
+  }
+
+  const str_id_t id = pool.size++;
+  if (id % STRING_POOL_CHUNK == 0) {
+    pool.chunks.push_back(std::make_shared<string_chunk_t>());
+    pool.chunks.back()->reserve(STRING_POOL_CHUNK);
+  }
+  music_unshare(pool.chunks.back()).push_back(value);
+  music_unshare(shard).emplace(value, id);
+
+  return id;
+}
+
+bool string_pool_find(const string_pool_t &pool, const std::string &value, str_id_t &id) {
+  if (pool.shards.empty()) {
+    return false;
+  }
+
+  const auto &shard = *pool.shards[std::hash<std::string>()(value) % STRING_POOL_SHARDS];
+  const auto it = shard.find(value);
+  if (it == shard.end()) {
+    return false;
+  }
+  id = it->second;
+
+  return true;
+}
+
+const std::string &string_pool_get(const string_pool_t &pool, const str_id_t id) {
+  return (*pool.chunks[id / STRING_POOL_CHUNK])[id % STRING_POOL_CHUNK];
+}
+
 void song_print(const song_t &song) {
   printf("title: %s\n", song.title.c_str());
   printf("artist: %s\n", song.artist.c_str());
@@ -20,8 +77,8 @@ void song_print(const song_t &song) {
   printf("track number: %d\n", song.track_number);
 }
 
-int song_parse_metadata(song_t &song, const std::string &song_path) {
-  TagLib::FileRef meta(song_path.c_str());
+int song_parse_metadata_taglib(song_t &song, const std::string &song_path) {
+  TagLib::FileRef meta(song_path.c_str(), false);
   if (!meta.isNull() && meta.tag()) {
     TagLib::Tag *tag = meta.tag();
     song.file_path = song_path;
@@ -41,84 +98,1224 @@ int song_parse_metadata(song_t &song, const std::string &song_path) {
   return 0;
 }
 
+int song_parse_metadata(song_t &song, const std::string &song_path) {
+  // Try the fast ID3 reader first, it only reads the tag header and footer
+  id3_tag_t tag;
+  if (id3_read(tag, song_path) == 0) {
+    song.file_path = song_path;
+    song.title = tag.title;
+    song.artist = tag.artist;
+    song.album = tag.album;
+    song.year = tag.year;
+    song.track_number = tag.track_number;
+    return 0;
+  }
+
+  return song_parse_metadata_taglib(song, song_path);
+}
+
+/**
+ * Read the ReplayGain adjustment of the song at `song_path` in dB from its
+ * REPLAYGAIN_TRACK_GAIN tag, or REPLAYGAIN_ALBUM_GAIN if `album` is set.
+ * Returns -1 if the song has no such tag.
+ */
+int song_parse_replaygain(const std::string &song_path,
+                          const bool album,
+                          float &gain_db) {
+  TagLib::FileRef meta(song_path.c_str(), false);
+  if (meta.isNull() || meta.file() == nullptr) {
+    return -1;
+  }
+
+  const TagLib::PropertyMap properties = meta.file()->properties();
+  const auto it = properties.find(album ? "REPLAYGAIN_ALBUM_GAIN" : "REPLAYGAIN_TRACK_GAIN");
+  if (it == properties.end() || it->second.size() == 0) {
+    return -1;
+  }
+
+  // Stored as text, e.g. "-6.54 dB"
+  gain_db = strtof(it->second.front().toCString(), NULL);
+
+  return 0;
+}
+
 int songs_parse_metadata(std::vector<song_t> &songs,
-                         const std::vector<std::string> &song_paths) {
-  for (const auto &song_path: song_paths) {
-    song_t song;
-    if (song_parse_metadata(song, song_path) == 0) {
-      songs.push_back(song);
+                         const std::vector<std::string> &song_paths,
+                         const size_t nb_threads) {
+  // Each worker writes into its own slot, so no locking is needed and the
+  // result order is the same as the input order regardless of thread count
+  std::vector<song_t> parsed(song_paths.size());
+  std::vector<char> valid(song_paths.size(), 0);
+  parallel_for(song_paths.size(), nb_threads, [&](const size_t i) {
+    valid[i] = (song_parse_metadata(parsed[i], song_paths[i]) == 0);
+  });
+
+  for (size_t i = 0; i < parsed.size(); i++) {
+    if (valid[i]) {
+      songs.push_back(std::move(parsed[i]));
     }
   }
 
   return 0;
 }
 
-int music_load_library(music_t &music, const std::string &path) {
-  // Parse all songs
-  std::vector<std::string> file_list;
-  walkdir(path, file_list, "mp3");
-  music.songs.clear();
-  songs_parse_metadata(music.songs, file_list);
-  std::sort(music.songs.begin(), music.songs.end(), song_comparator);
-  if (music.songs.size() == 0) {
-    LOG_ERROR("No songs found at [%s]!", path.c_str());
+static void index_put(std::string &buf, const void *data, const size_t len) {
+  buf.append((const char *) data, len);
+}
+
+static void index_put_int(std::string &buf, const int64_t value) {
+  index_put(buf, &value, sizeof(int64_t));
+}
+
+static void index_put_float(std::string &buf, const float value) {
+  index_put(buf, &value, sizeof(float));
+}
+
+static void index_put_str(std::string &buf, const std::string &value) {
+  const uint32_t len = value.length();
+  index_put(buf, &len, sizeof(uint32_t));
+  index_put(buf, value.data(), len);
+}
+
+struct index_reader_t {
+  const std::string &data;
+  size_t pos = 0;
+
+  index_reader_t(const std::string &data_) : data{data_} {}
+};
+
+static bool index_get(index_reader_t &reader, void *dst, const size_t len) {
+  if (reader.pos + len > reader.data.size()) {
+    return false;
+  }
+  memcpy(dst, reader.data.data() + reader.pos, len);
+  reader.pos += len;
+  return true;
+}
+
+static bool index_get_int(index_reader_t &reader, int64_t &value) {
+  return index_get(reader, &value, sizeof(int64_t));
+}
+
+static bool index_get_float(index_reader_t &reader, float &value) {
+  return index_get(reader, &value, sizeof(float));
+}
+
+static bool index_get_str(index_reader_t &reader, std::string &value) {
+  uint32_t len = 0;
+  if (index_get(reader, &len, sizeof(uint32_t)) == false) {
+    return false;
+  }
+  if (reader.pos + len > reader.data.size()) {
+    return false;
+  }
+  value.assign(reader.data.data() + reader.pos, len);
+  reader.pos += len;
+  return true;
+}
+
+/**
+ * Read the whole of `path` into `data` in one go.
+ */
+static int index_read_file(const std::string &path, std::string &data) {
+  FILE *fp = fopen(path.c_str(), "rb");
+  if (fp == NULL) {
     return -1;
   }
+  char chunk[4096];
+  size_t nb_read = 0;
+  while ((nb_read = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+    data.append(chunk, nb_read);
+  }
+  fclose(fp);
 
-  // Get all artists
-  music.artists.clear();
-  for (const auto &song : music.songs) {
-    music.artists[song.artist].insert(song.album);
+  return 0;
+}
+
+/**
+ * Write `data` to a temporary file and rename it over `path`, so a power cut
+ * mid-write never leaves a half written index behind.
+ */
+static int index_write_file(const std::string &data, const std::string &path) {
+  const std::string tmp_path = path + ".tmp";
+  FILE *fp = fopen(tmp_path.c_str(), "wb");
+  if (fp == NULL) {
+    LOG_ERROR("Failed to open [%s] for writing!", tmp_path.c_str());
+    return -1;
+  }
+  const bool ok = (fwrite(data.data(), 1, data.size(), fp) == data.size());
+  if (fclose(fp) != 0 || ok == false) {
+    LOG_ERROR("Failed to write index [%s]!", tmp_path.c_str());
+    unlink(tmp_path.c_str());
+    return -1;
+  }
+  if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+    LOG_ERROR("Failed to rename [%s]!", tmp_path.c_str());
+    unlink(tmp_path.c_str());
+    return -1;
   }
 
-  // Get all albums
-  music.albums.clear();
-  for (const auto &song : music.songs) {
-    music.albums[song.album].push_back(song);
+  return 0;
+}
+
+int music_index_load(music_index_t &index, const std::string &index_path) {
+  index.clear();
+
+  // Read the whole index in one go
+  std::string data;
+  if (index_read_file(index_path, data) != 0) {
+    return -1;
+  }
+
+  // Check header. The index is a device-local cache written in native byte
+  // order, anything unexpected simply means a full rescan.
+  index_reader_t reader{data};
+  char magic[4] = {0};
+  int64_t version = 0;
+  int64_t nb_entries = 0;
+  if (index_get(reader, magic, 4) == false
+      || memcmp(magic, MUSIC_INDEX_MAGIC, 4) != 0
+      || index_get_int(reader, version) == false
+      || version != MUSIC_INDEX_VERSION
+      || index_get_int(reader, nb_entries) == false) {
+    LOG_WARN("Ignoring invalid library index [%s]", index_path.c_str());
+    return -1;
+  }
+
+  // Parse entries
+  for (int64_t i = 0; i < nb_entries; i++) {
+    std::string file_path;
+    music_index_entry_t entry;
+    int64_t valid = 0;
+    int64_t year = 0;
+    int64_t track_number = 0;
+    int64_t analysed = 0;
+    auto &replaygain = entry.song.replaygain;
+
+    bool ok = index_get_str(reader, file_path);
+    ok = ok && index_get_int(reader, entry.mtime);
+    ok = ok && index_get_int(reader, entry.size);
+    ok = ok && index_get_int(reader, valid);
+    ok = ok && index_get_str(reader, entry.song.title);
+    ok = ok && index_get_str(reader, entry.song.artist);
+    ok = ok && index_get_str(reader, entry.song.album);
+    ok = ok && index_get_int(reader, year);
+    ok = ok && index_get_int(reader, track_number);
+    ok = ok && index_get_int(reader, analysed);
+    ok = ok && index_get_float(reader, replaygain.track_gain);
+    ok = ok && index_get_float(reader, replaygain.track_peak);
+    ok = ok && index_get_float(reader, replaygain.album_gain);
+    ok = ok && index_get_float(reader, replaygain.album_peak);
+    if (ok == false) {
+      LOG_WARN("Ignoring truncated library index [%s]", index_path.c_str());
+      index.clear();
+      return -1;
+    }
+
+    entry.valid = valid;
+    entry.song.file_path = file_path;
+    entry.song.year = year;
+    entry.song.track_number = track_number;
+    replaygain.analysed = analysed;
+    index.emplace(file_path, entry);
+  }
+
+  return 0;
+}
+
+int music_index_save(const music_index_t &index, const std::string &index_path) {
+  // Serialize index
+  std::string data;
+  index_put(data, MUSIC_INDEX_MAGIC, 4);
+  index_put_int(data, MUSIC_INDEX_VERSION);
+  index_put_int(data, index.size());
+  for (const auto &kv : index) {
+    const auto &entry = kv.second;
+    index_put_str(data, kv.first);
+    index_put_int(data, entry.mtime);
+    index_put_int(data, entry.size);
+    index_put_int(data, entry.valid);
+    index_put_str(data, entry.song.title);
+    index_put_str(data, entry.song.artist);
+    index_put_str(data, entry.song.album);
+    index_put_int(data, entry.song.year);
+    index_put_int(data, entry.song.track_number);
+    index_put_int(data, entry.song.replaygain.analysed);
+    index_put_float(data, entry.song.replaygain.track_gain);
+    index_put_float(data, entry.song.replaygain.track_peak);
+    index_put_float(data, entry.song.replaygain.album_gain);
+    index_put_float(data, entry.song.replaygain.album_peak);
+  }
+
+  return index_write_file(data, index_path);
+}
+
+int music_seek_index_load(music_seek_index_t &index, const std::string &index_path) {
+  index.clear();
+
+  std::string data;
+  if (index_read_file(index_path, data) != 0) {
+    return -1;
+  }
+
+  // Check header
+  index_reader_t reader{data};
+  char magic[4] = {0};
+  int64_t version = 0;
+  int64_t nb_entries = 0;
+  if (index_get(reader, magic, 4) == false
+      || memcmp(magic, MUSIC_SEEK_INDEX_MAGIC, 4) != 0
+      || index_get_int(reader, version) == false
+      || version != MUSIC_SEEK_INDEX_VERSION
+      || index_get_int(reader, nb_entries) == false) {
+    LOG_WARN("Ignoring invalid seek index [%s]", index_path.c_str());
+    return -1;
+  }
+
+  // Parse entries
+  for (int64_t i = 0; i < nb_entries; i++) {
+    std::string file_path;
+    music_seek_entry_t entry;
+    int64_t nb_offsets = 0;
+
+    bool ok = index_get_str(reader, file_path);
+    ok = ok && index_get_int(reader, entry.mtime);
+    ok = ok && index_get_int(reader, entry.size);
+    ok = ok && index_get_int(reader, entry.rate);
+    ok = ok && index_get_int(reader, entry.samples);
+    ok = ok && index_get_int(reader, entry.step);
+    ok = ok && index_get_int(reader, nb_offsets);
+    ok = ok && nb_offsets >= 0
+         && reader.pos + nb_offsets * sizeof(int64_t) <= data.size();
+    if (ok) {
+      entry.offsets.resize(nb_offsets);
+      ok = index_get(reader, entry.offsets.data(), nb_offsets * sizeof(int64_t));
+    }
+    if (ok == false) {
+      LOG_WARN("Ignoring truncated seek index [%s]", index_path.c_str());
+      index.clear();
+      return -1;
+    }
+
+    index.emplace(file_path, std::move(entry));
   }
 
   return 0;
 }
 
-std::vector<song_t> music_filter_songs(const music_t &music,
-                                       const std::string &target_artist,
-                                       const std::string &target_album) {
-  std::vector<song_t> songs;
+int music_seek_index_save(const music_seek_index_t &index,
+                          const std::string &index_path) {
+  std::string data;
+  index_put(data, MUSIC_SEEK_INDEX_MAGIC, 4);
+  index_put_int(data, MUSIC_SEEK_INDEX_VERSION);
+  index_put_int(data, index.size());
+  for (const auto &kv : index) {
+    const auto &entry = kv.second;
+    index_put_str(data, kv.first);
+    index_put_int(data, entry.mtime);
+    index_put_int(data, entry.size);
+    index_put_int(data, entry.rate);
+    index_put_int(data, entry.samples);
+    index_put_int(data, entry.step);
+    index_put_int(data, entry.offsets.size());
+    index_put(data, entry.offsets.data(), entry.offsets.size() * sizeof(int64_t));
+  }
 
-  if (target_artist == "" && target_album == "") {
-    songs = music.songs;
+  return index_write_file(data, index_path);
+}
 
-  } else {
-    for (const auto &song : music.songs) {
-      bool add = true;
-      if (target_artist != "" && target_artist != song.artist) {
-        add = false;
-      }
-      if (target_album != "" && target_album != song.album) {
-        add = false;
+/**
+ * Look up the seek index of `file_path`. Returns nullptr if there is none or
+ * the file changed since it was built.
+ */
+const music_seek_entry_t *music_seek_index_get(const music_seek_index_t &index,
+                                               const std::string &file_path) {
+  const auto it = index.find(file_path);
+  struct stat st;
+  if (it == index.end() || stat(file_path.c_str(), &st) != 0
+      || it->second.mtime != st.st_mtime || it->second.size != st.st_size) {
+    return nullptr;
+  }
+
+  return &it->second;
+}
+
+/**
+ * Record a freshly built seek index for `file_path`, stamped with the file's
+ * current mtime and size.
+ */
+int music_seek_index_put(music_seek_index_t &index,
+                         const std::string &file_path,
+                         music_seek_entry_t entry) {
+  struct stat st;
+  if (stat(file_path.c_str(), &st) != 0) {
+    return -1;
+  }
+  entry.mtime = st.st_mtime;
+  entry.size = st.st_size;
+  index[file_path] = std::move(entry);
+
+  return 0;
+}
+
+/**
+ * Load the seek index at `index_path` into `store`, which is saved back to
+ * the same path.
+ */
+int music_seek_store_load(music_seek_store_t &store, const std::string &index_path) {
+  std::lock_guard<std::mutex> guard(store.mutex);
+  store.path = index_path;
+  store.dirty = false;
+  return music_seek_index_load(store.index, index_path);
+}
+
+/**
+ * Write `store` back to its file if entries were added since it was loaded
+ * or last saved.
+ */
+int music_seek_store_save(music_seek_store_t &store) {
+  std::lock_guard<std::mutex> guard(store.mutex);
+  if (store.dirty == false || store.path == "") {
+    return 0;
+  }
+  if (music_seek_index_save(store.index, store.path) != 0) {
+    return -1;
+  }
+  store.dirty = false;
+
+  return 0;
+}
+
+/**
+ * Whether `store` has an up to date entry for `file_path`.
+ */
+bool music_seek_store_has(music_seek_store_t &store, const std::string &file_path) {
+  std::lock_guard<std::mutex> guard(store.mutex);
+  return music_seek_index_get(store.index, file_path) != nullptr;
+}
+
+/**
+ * Copy the up to date entry for `file_path` into `entry`. Returns false if
+ * there is none.
+ */
+bool music_seek_store_get(music_seek_store_t &store,
+                          const std::string &file_path,
+                          music_seek_entry_t &entry) {
+  std::lock_guard<std::mutex> guard(store.mutex);
+  const auto found = music_seek_index_get(store.index, file_path);
+  if (found == nullptr) {
+    return false;
+  }
+  entry = *found;
+
+  return true;
+}
+
+int music_seek_store_put(music_seek_store_t &store,
+                         const std::string &file_path,
+                         music_seek_entry_t entry) {
+  std::lock_guard<std::mutex> guard(store.mutex);
+  if (music_seek_index_put(store.index, file_path, std::move(entry)) != 0) {
+    return -1;
+  }
+  store.dirty = true;
+
+  return 0;
+}
+
+/**
+ * Chunk that holds row `row` of the table, `local` is set to the row within
+ * the chunk. The end of the table is in the last chunk.
+ */
+static size_t table_find_chunk(const song_table_t &table, const size_t row, size_t &local) {
+  const auto it = std::upper_bound(table.starts.begin(), table.starts.end(), row);
+  const size_t idx = (it == table.starts.begin()) ? 0 : it - table.starts.begin() - 1;
+  local = row - table.starts[idx];
+  return idx;
+}
+
+static const song_chunk_t &table_chunk(const song_table_t &table,
+                                       const size_t row,
+                                       size_t &local) {
+  return *table.chunks[table_find_chunk(table, row, local)];
+}
+
+static uint32_t chunk_put_text(song_chunk_t &chunk, const char *value) {
+  const uint32_t offset = chunk.text.size();
+  chunk.text.insert(chunk.text.end(), value, value + strlen(value) + 1);
+  return offset;
+}
+
+// Append row `row` of chunk `src` to `dst`
+static void chunk_copy_row(song_chunk_t &dst, const song_chunk_t &src, const size_t row) {
+  dst.titles.push_back(chunk_put_text(dst, &src.text[src.titles[row]]));
+  dst.file_names.push_back(chunk_put_text(dst, &src.text[src.file_names[row]]));
+  dst.dirs.push_back(src.dirs[row]);
+  dst.artists.push_back(src.artists[row]);
+  dst.albums.push_back(src.albums[row]);
+  dst.years.push_back(src.years[row]);
+  dst.track_numbers.push_back(src.track_numbers[row]);
+  dst.replaygains.push_back(src.replaygains[row]);
+}
+
+// Copy rows [begin, end) of `src` into a new chunk without unused text
+static std::shared_ptr<song_chunk_t> chunk_slice(const song_chunk_t &src,
+                                                 const size_t begin,
+                                                 const size_t end) {
+  auto chunk = std::make_shared<song_chunk_t>();
+  for (size_t row = begin; row < end; row++) {
+    chunk_copy_row(*chunk, src, row);
+  }
+  return chunk;
+}
+
+static song_paths_shard_t &music_paths_shard(music_t &music, const std::string &path) {
+  if (music.paths.empty()) {
+    for (size_t i = 0; i < SONG_PATHS_SHARDS; i++) {
+      music.paths.push_back(std::make_shared<song_paths_shard_t>());
+    }
+  }
+  auto &shard = music.paths[std::hash<std::string>()(path) % SONG_PATHS_SHARDS];
+  return music_unshare(shard);
+}
+
+static void table_insert(music_t &music, const size_t row, const song_t &song) {
+  auto &table = music.songs;
+  if (table.chunks.empty()) {
+    table.chunks.push_back(std::make_shared<song_chunk_t>());
+    table.starts.push_back(0);
+  }
+  size_t local = 0;
+  const size_t idx = table_find_chunk(table, row, local);
+  auto &chunk = music_unshare(table.chunks[idx]);
+
+  // Directories are shared by every song in them, only intern those
+  const auto sep = song.file_path.rfind('/') + 1;
+  const std::string dir = song.file_path.substr(0, sep);
+  const char *file_name = song.file_path.c_str() + sep;
+
+  chunk.titles.insert(chunk.titles.begin() + local,
+                      chunk_put_text(chunk, song.title.c_str()));
+  chunk.file_names.insert(chunk.file_names.begin() + local,
+                          chunk_put_text(chunk, file_name));
+  chunk.dirs.insert(chunk.dirs.begin() + local,
+                    string_pool_intern(music.strings, dir));
+  chunk.artists.insert(chunk.artists.begin() + local,
+                       string_pool_intern(music.strings, song.artist));
+  chunk.albums.insert(chunk.albums.begin() + local,
+                      string_pool_intern(music.strings, song.album));
+  chunk.years.insert(chunk.years.begin() + local, song.year);
+  chunk.track_numbers.insert(chunk.track_numbers.begin() + local,
+                             song.track_number);
+  chunk.replaygains.insert(chunk.replaygains.begin() + local, song.replaygain);
+
+  song_key_t key;
+  key.artist = chunk.artists[local];
+  key.album = chunk.albums[local];
+  key.track_number = song.track_number;
+  music_paths_shard(music, song.file_path)[song.file_path] = key;
+
+  table.nb_rows++;
+  for (size_t i = idx + 1; i < table.starts.size(); i++) {
+    table.starts[i]++;
+  }
+
+  // Split chunks that grew too large in two
+  if (chunk.size() >= 2 * SONG_TABLE_CHUNK) {
+    const size_t half = chunk.size() / 2;
+    auto tail = chunk_slice(chunk, half, chunk.size());
+    table.chunks[idx] = chunk_slice(chunk, 0, half);
+    table.chunks.insert(table.chunks.begin() + idx + 1, tail);
+    table.starts.insert(table.starts.begin() + idx + 1, table.starts[idx] + half);
+  }
+}
+
+static void table_erase(music_t &music, const size_t row) {
+  auto &table = music.songs;
+  size_t local = 0;
+  const size_t idx = table_find_chunk(table, row, local);
+  auto &chunk = music_unshare(table.chunks[idx]);
+
+  const std::string path = string_pool_get(music.strings, chunk.dirs[local])
+                           + &chunk.text[chunk.file_names[local]];
+  music_paths_shard(music, path).erase(path);
+
+  chunk.text_garbage += strlen(&chunk.text[chunk.titles[local]]) + 1;
+  chunk.text_garbage += strlen(&chunk.text[chunk.file_names[local]]) + 1;
+
+  chunk.titles.erase(chunk.titles.begin() + local);
+  chunk.file_names.erase(chunk.file_names.begin() + local);
+  chunk.dirs.erase(chunk.dirs.begin() + local);
+  chunk.artists.erase(chunk.artists.begin() + local);
+  chunk.albums.erase(chunk.albums.begin() + local);
+  chunk.years.erase(chunk.years.begin() + local);
+  chunk.track_numbers.erase(chunk.track_numbers.begin() + local);
+  chunk.replaygains.erase(chunk.replaygains.begin() + local);
+
+  table.nb_rows--;
+  for (size_t i = idx + 1; i < table.starts.size(); i++) {
+    table.starts[i]--;
+  }
+
+  if (chunk.size() == 0) {
+    table.chunks.erase(table.chunks.begin() + idx);
+    table.starts.erase(table.starts.begin() + idx);
+  } else if (chunk.text_garbage > chunk.text.size() / 2) {
+    table.chunks[idx] = chunk_slice(chunk, 0, chunk.size());
+  }
+}
+
+/**
+ * Compare row `row` of the song table against `song`, in the same order as
+ * `song_comparator()`.
+ */
+static int music_compare(const music_t &music, const size_t row, const song_t &song) {
+  int retval = music_song_artist(music, row).compare(song.artist);
+  if (retval != 0) {
+    return retval;
+  }
+
+  retval = music_song_album(music, row).compare(song.album);
+  if (retval != 0) {
+    return retval;
+  }
+
+  size_t local = 0;
+  const auto &chunk = table_chunk(music.songs, row, local);
+  const int track_number = chunk.track_numbers[local];
+  return (track_number > song.track_number) - (track_number < song.track_number);
+}
+
+/**
+ * Build the artist and album ranges from the sorted song table. This is a
+ * single pass over integer ids, only the album name index compares strings.
+ * Used when a library is created, later changes update the ranges in place
+ * (see `music_index_insert()` and `music_index_erase()`).
+ */
+static void music_reindex(music_t &music) {
+  music.artists.clear();
+  music.albums.clear();
+
+  uint32_t row = 0;
+  for (const auto &chunk : music.songs.chunks) {
+    for (size_t i = 0; i < chunk->size(); i++, row++) {
+      const str_id_t artist_id = chunk->artists[i];
+      const str_id_t album_id = chunk->albums[i];
+      const bool new_artist = music.artists.empty()
+                              || music.artists.back().name != artist_id;
+      const bool new_album = new_artist || music.albums.back().name != album_id;
+
+      if (new_album) {
+        album_t album;
+        album.name = album_id;
+        album.artist = artist_id;
+        album.songs.begin = row;
+        music.albums.push_back(album);
       }
-      if (add) {
-        songs.push_back(song);
+
+      if (new_artist) {
+        artist_t artist;
+        artist.name = artist_id;
+        artist.songs.begin = row;
+        artist.albums.begin = music.albums.size() - 1;
+        music.artists.push_back(artist);
       }
+
+      music.albums.back().songs.end = row + 1;
+      music.artists.back().songs.end = row + 1;
+      music.artists.back().albums.end = music.albums.size();
+    }
+  }
+
+  // Albums are already sorted by artist then name, a stable sort on name
+  // gives name then artist
+  music.albums_by_name.resize(music.albums.size());
+  for (uint32_t i = 0; i < music.albums.size(); i++) {
+    music.albums_by_name[i] = i;
+  }
+  std::stable_sort(music.albums_by_name.begin(),
+                   music.albums_by_name.end(),
+                   [&](const uint32_t a, const uint32_t b) {
+                     return string_pool_get(music.strings, music.albums[a].name)
+                            < string_pool_get(music.strings, music.albums[b].name);
+                   });
+}
+
+// Index of the artist or album whose songs include `row`
+template <typename T>
+static size_t music_range_find(const std::vector<T> &items, const size_t row) {
+  const auto it = std::upper_bound(items.begin(),
+                                   items.end(),
+                                   row,
+                                   [](const size_t r, const T &item) {
+                                     return r < item.songs.begin;
+                                   });
+  return it - items.begin() - 1;
+}
+
+// Index of the first artist or album whose songs start at or after `row`
+template <typename T>
+static size_t music_range_lower(const std::vector<T> &items, const size_t row) {
+  const auto it = std::lower_bound(items.begin(),
+                                   items.end(),
+                                   row,
+                                   [](const T &item, const size_t r) {
+                                     return item.songs.begin < r;
+                                   });
+  return it - items.begin();
+}
+
+// Album name index order, by name then artist
+static bool music_album_less(const music_t &music, const uint32_t a, const uint32_t b) {
+  const auto &name_a = string_pool_get(music.strings, music.albums[a].name);
+  const auto &name_b = string_pool_get(music.strings, music.albums[b].name);
+  return (name_a != name_b) ? (name_a < name_b) : (a < b);
+}
+
+/**
+ * Update the artist and album ranges after a song was inserted at `row` of
+ * the song table. The song either extends the artist and album of one of
+ * its neighbours or starts new ones, the ranges after it shift by a row.
+ */
+static void music_index_insert(music_t &music, const size_t row) {
+  const auto &table = music.songs;
+  size_t local = 0;
+  const auto &chunk = table_chunk(table, row, local);
+  const str_id_t artist_id = chunk.artists[local];
+  const str_id_t album_id = chunk.albums[local];
+
+  // Neighbours are rows `row - 1` and `row` of the ranges before the insert
+  bool prev_artist = false;
+  bool prev_album = false;
+  if (row > 0) {
+    const auto &prev = table_chunk(table, row - 1, local);
+    prev_artist = (prev.artists[local] == artist_id);
+    prev_album = prev_artist && (prev.albums[local] == album_id);
+  }
+  bool next_artist = false;
+  bool next_album = false;
+  if (row + 1 < table.size()) {
+    const auto &next = table_chunk(table, row + 1, local);
+    next_artist = (next.artists[local] == artist_id);
+    next_album = next_artist && (next.albums[local] == album_id);
+  }
+
+  // Album
+  const bool new_album = (prev_album == false && next_album == false);
+  size_t album_idx = 0;
+  if (prev_album) {
+    album_idx = music_range_find(music.albums, row - 1);
+  } else if (next_album) {
+    album_idx = music_range_find(music.albums, row);
+  } else {
+    album_idx = music_range_lower(music.albums, row);
+    album_t album;
+    album.name = album_id;
+    album.artist = artist_id;
+    album.songs.begin = row;
+    album.songs.end = row;
+    music.albums.insert(music.albums.begin() + album_idx, album);
+  }
+  music.albums[album_idx].songs.end++;
+  for (size_t i = album_idx + 1; i < music.albums.size(); i++) {
+    music.albums[i].songs.begin++;
+    music.albums[i].songs.end++;
+  }
+
+  // Artist
+  size_t artist_idx = 0;
+  if (prev_artist) {
+    artist_idx = music_range_find(music.artists, row - 1);
+  } else if (next_artist) {
+    artist_idx = music_range_find(music.artists, row);
+  } else {
+    artist_idx = music_range_lower(music.artists, row);
+    artist_t artist;
+    artist.name = artist_id;
+    artist.songs.begin = row;
+    artist.songs.end = row;
+    artist.albums.begin = album_idx;
+    artist.albums.end = album_idx;
+    music.artists.insert(music.artists.begin() + artist_idx, artist);
+  }
+  music.artists[artist_idx].songs.end++;
+  music.artists[artist_idx].albums.end += new_album;
+  for (size_t i = artist_idx + 1; i < music.artists.size(); i++) {
+    music.artists[i].songs.begin++;
+    music.artists[i].songs.end++;
+    music.artists[i].albums.begin += new_album;
+    music.artists[i].albums.end += new_album;
+  }
+
+  // Album name index
+  if (new_album) {
+    auto &by_name = music.albums_by_name;
+    for (auto &idx : by_name) {
+      idx += (idx >= album_idx);
+    }
+    const auto it = std::lower_bound(by_name.begin(),
+                                     by_name.end(),
+                                     album_idx,
+                                     [&](const uint32_t a, const uint32_t b) {
+                                       return music_album_less(music, a, b);
+                                     });
+    by_name.insert(it, album_idx);
+  }
+}
+
+/**
+ * Update the artist and album ranges before the song at `row` of the song
+ * table is erased. Artists and albums left without songs are removed.
+ */
+static void music_index_erase(music_t &music, const size_t row) {
+  // Album
+  const size_t album_idx = music_range_find(music.albums, row);
+  music.albums[album_idx].songs.end--;
+  for (size_t i = album_idx + 1; i < music.albums.size(); i++) {
+    music.albums[i].songs.begin--;
+    music.albums[i].songs.end--;
+  }
+
+  const auto &songs = music.albums[album_idx].songs;
+  const bool album_gone = (songs.begin == songs.end);
+  if (album_gone) {
+    auto &by_name = music.albums_by_name;
+    const auto it = std::lower_bound(by_name.begin(),
+                                     by_name.end(),
+                                     album_idx,
+                                     [&](const uint32_t a, const uint32_t b) {
+                                       return music_album_less(music, a, b);
+                                     });
+    by_name.erase(it);
+    for (auto &idx : by_name) {
+      idx -= (idx > album_idx);
+    }
+    music.albums.erase(music.albums.begin() + album_idx);
+  }
+
+  // Artist
+  const size_t artist_idx = music_range_find(music.artists, row);
+  auto &artist = music.artists[artist_idx];
+  artist.songs.end--;
+  artist.albums.end -= album_gone;
+  for (size_t i = artist_idx + 1; i < music.artists.size(); i++) {
+    music.artists[i].songs.begin--;
+    music.artists[i].songs.end--;
+    music.artists[i].albums.begin -= album_gone;
+    music.artists[i].albums.end -= album_gone;
+  }
+  if (artist.songs.begin == artist.songs.end) {
+    music.artists.erase(music.artists.begin() + artist_idx);
+  }
+}
+
+void music_init(music_t &music, songs_t &songs) {
+  std::sort(songs.begin(), songs.end(), song_comparator);
+
+  music = music_t();
+  for (const auto &song : songs) {
+    table_insert(music, music.songs.size(), song);
+  }
+
+  music_reindex(music);
+}
+
+song_t music_get_song(const music_t &music, const size_t idx) {
+  size_t row = 0;
+  const auto &chunk = table_chunk(music.songs, idx, row);
+
+  song_t song;
+  song.file_path = string_pool_get(music.strings, chunk.dirs[row])
+                   + &chunk.text[chunk.file_names[row]];
+  song.title = &chunk.text[chunk.titles[row]];
+  song.artist = string_pool_get(music.strings, chunk.artists[row]);
+  song.album = string_pool_get(music.strings, chunk.albums[row]);
+  song.year = chunk.years[row];
+  song.track_number = chunk.track_numbers[row];
+  song.replaygain = chunk.replaygains[row];
+
+  return song;
+}
+
+const char *music_song_title(const music_t &music, const size_t idx) {
+  size_t row = 0;
+  const auto &chunk = table_chunk(music.songs, idx, row);
+  return &chunk.text[chunk.titles[row]];
+}
+
+const std::string &music_song_artist(const music_t &music, const size_t idx) {
+  size_t row = 0;
+  const auto &chunk = table_chunk(music.songs, idx, row);
+  return string_pool_get(music.strings, chunk.artists[row]);
+}
+
+const std::string &music_song_album(const music_t &music, const size_t idx) {
+  size_t row = 0;
+  const auto &chunk = table_chunk(music.songs, idx, row);
+  return string_pool_get(music.strings, chunk.albums[row]);
+}
+
+std::string music_song_path(const music_t &music, const size_t idx) {
+  size_t row = 0;
+  const auto &chunk = table_chunk(music.songs, idx, row);
+  return string_pool_get(music.strings, chunk.dirs[row])
+         + &chunk.text[chunk.file_names[row]];
+}
+
+int music_find_artist(const music_t &music, const std::string &artist) {
+  const auto it = std::lower_bound(music.artists.begin(),
+                                   music.artists.end(),
+                                   artist,
+                                   [&](const artist_t &a, const std::string &name) {
+                                     return string_pool_get(music.strings, a.name) < name;
+                                   });
+  if (it == music.artists.end() || string_pool_get(music.strings, it->name) != artist) {
+    return -1;
+  }
+
+  return it - music.artists.begin();
+}
+
+int music_find_album(const music_t &music,
+                     const std::string &artist,
+                     const std::string &album) {
+  const int artist_idx = music_find_artist(music, artist);
+  if (artist_idx == -1) {
+    return -1;
+  }
+
+  const auto &range = music.artists[artist_idx].albums;
+  const auto begin = music.albums.begin() + range.begin;
+  const auto end = music.albums.begin() + range.end;
+  const auto it = std::lower_bound(begin,
+                                   end,
+                                   album,
+                                   [&](const album_t &a, const std::string &name) {
+                                     return string_pool_get(music.strings, a.name) < name;
+                                   });
+  if (it == end || string_pool_get(music.strings, it->name) != album) {
+    return -1;
+  }
+
+  return it - music.albums.begin();
+}
+
+std::vector<uint32_t> music_find_albums(const music_t &music,
+                                        const std::string &album) {
+  const auto begin = music.albums_by_name.begin();
+  const auto end = music.albums_by_name.end();
+  const auto it = std::lower_bound(begin,
+                                   end,
+                                   album,
+                                   [&](const uint32_t idx, const std::string &name) {
+                                     return string_pool_get(music.strings, music.albums[idx].name) < name;
+                                   });
+
+  std::vector<uint32_t> albums;
+  for (auto i = it; i != end; i++) {
+    if (string_pool_get(music.strings, music.albums[*i].name) != album) {
+      break;
+    }
+    albums.push_back(*i);
+  }
+
+  return albums;
+}
+
+/**
+ * Row a song belongs at: after the last row that is not greater than it, so
+ * songs that compare equal keep the order they were added in.
+ */
+static size_t music_insert_row(const music_t &music, const song_t &song) {
+  size_t lo = 0;
+  size_t hi = music.songs.size();
+  while (lo < hi) {
+    const size_t mid = lo + (hi - lo) / 2;
+    if (music_compare(music, mid, song) <= 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
     }
   }
 
-  return songs;
+  return lo;
+}
+
+int music_add_song(music_t &music, const song_t &song) {
+  const size_t row = music_insert_row(music, song);
+  table_insert(music, row, song);
+  music_index_insert(music, row);
+
+  return 0;
+}
+
+/**
+ * Row of `song`, found by its sort key and then its file path. Returns -1 if
+ * it is not in the library.
+ */
+static long music_find_row(const music_t &music, const song_t &song) {
+  // Find the first row that is not less than the song
+  size_t lo = 0;
+  size_t hi = music.songs.size();
+  while (lo < hi) {
+    const size_t mid = lo + (hi - lo) / 2;
+    if (music_compare(music, mid, song) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  // Song is somewhere within the rows that compare equal
+  for (size_t row = lo; row < music.songs.size(); row++) {
+    if (music_compare(music, row, song) != 0) {
+      break;
+    }
+    if (music_song_path(music, row) == song.file_path) {
+      return row;
+    }
+  }
+
+  return -1;
+}
+
+/**
+ * Row of the song at `file_path`, or -1 if there is none.
+ */
+static long music_find_path(const music_t &music, const std::string &file_path) {
+  if (music.paths.empty()) {
+    return -1;
+  }
+
+  const auto &shard = *music.paths[std::hash<std::string>()(file_path) % SONG_PATHS_SHARDS];
+  const auto it = shard.find(file_path);
+  if (it == shard.end()) {
+    return -1;
+  }
+
+  song_t song;
+  song.file_path = file_path;
+  song.artist = string_pool_get(music.strings, it->second.artist);
+  song.album = string_pool_get(music.strings, it->second.album);
+  song.track_number = it->second.track_number;
+  return music_find_row(music, song);
+}
+
+int music_remove_song(music_t &music, const song_t &song) {
+  const long row = music_find_row(music, song);
+  if (row == -1) {
+    return -1;
+  }
+  music_index_erase(music, row);
+  table_erase(music, row);
+
+  return 0;
+}
+
+/**
+ * Replace the ReplayGain values of the song at `file_path`. Returns -1 if it
+ * is not in the library.
+ */
+int music_set_replaygain(music_t &music,
+                         const std::string &file_path,
+                         const replaygain_t &replaygain) {
+  const long row = music_find_path(music, file_path);
+  if (row == -1) {
+    return -1;
+  }
+
+  size_t local = 0;
+  const size_t idx = table_find_chunk(music.songs, row, local);
+  music_unshare(music.songs.chunks[idx]).replaygains[local] = replaygain;
+
+  return 0;
+}
+
+/**
+ * Apply a batch of changes to the library: remove the songs at the `removed`
+ * file paths, then add the `added` songs. Removed songs are looked up by
+ * path, so the cost is in proportion to the batch. Returns the number of
+ * songs removed and added.
+ */
+size_t music_update(music_t &music,
+                    const std::set<std::string> &removed,
+                    const songs_t &added) {
+  std::vector<size_t> rows;
+  for (const auto &path : removed) {
+    const long row = music_find_path(music, path);
+    if (row != -1) {
+      rows.push_back(row);
+    }
+  }
+  std::sort(rows.begin(), rows.end());
+
+  // Erase back to front so the rows left to erase do not move
+  for (auto it = rows.rbegin(); it != rows.rend(); ++it) {
+    music_index_erase(music, *it);
+    table_erase(music, *it);
+  }
+  for (const auto &song : added) {
+    const size_t row = music_insert_row(music, song);
+    table_insert(music, row, song);
+    music_index_insert(music, row);
+  }
+
+  return rows.size() + added.size();
+}
+
+int music_load_library(music_t &music,
+                       const std::string &path,
+                       const std::string &index_path,
+                       const size_t nb_threads) {
+  // Find all songs
+  std::vector<std::string> file_list;
+  walkdir(path, file_list, music_file_exts);
+
+  // Load library index, if there is one only new or modified files have to
+  // have their tags parsed
+  music_index_t index;
+  if (index_path != "") {
+    music_index_load(index, index_path);
+  }
+
+  music_index_t updated;
+  std::vector<music_index_entry_t *> stale;
+  for (const auto &file_path : file_list) {
+    struct stat st;
+    if (stat(file_path.c_str(), &st) != 0) {
+      continue;
+    }
+
+    music_index_entry_t entry;
+    entry.mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    entry.size = st.st_size;
+
+    const auto it = index.find(file_path);
+    if (it != index.end()
+        && it->second.mtime == entry.mtime
+        && it->second.size == entry.size) {
+      updated.emplace(file_path, it->second);
+      continue;
+    }
+
+    entry.song.file_path = file_path;
+    stale.push_back(&updated.emplace(file_path, entry).first->second);
+  }
+
+  // Parse new or modified songs
+  parallel_for(stale.size(), nb_threads, [&](const size_t i) {
+    music_index_entry_t &entry = *stale[i];
+    const std::string file_path = entry.song.file_path;
+    entry.valid = (song_parse_metadata(entry.song, file_path) == 0);
+  });
+  const size_t nb_parsed = stale.size();
+
+  // Only rewrite the index if something was added, changed or removed
+  if (index_path != "" && (nb_parsed || updated.size() != index.size())) {
+    music_index_save(updated, index_path);
+  }
+
+  // Collect all songs
+  songs_t songs;
+  for (const auto &kv : updated) {
+    if (kv.second.valid) {
+      songs.push_back(kv.second.song);
+    }
+  }
+  music_init(music, songs);
+  if (music.songs.size() == 0) {
+    LOG_ERROR("No songs found at [%s]!", path.c_str());
+    return -1;
+  }
+
+  return 0;
+}
+
+size_t songs_view_row(const songs_view_t &view, const size_t idx) {
+  size_t offset = idx;
+  for (const auto &range : view.ranges) {
+    const size_t len = range.end - range.begin;
+    if (offset < len) {
+      return range.begin + offset;
+    }
+    offset -= len;
+  }
+
+  FATAL("Index [%zu] out of range [%zu]!", idx, view.size);
+}
+
+const char *songs_view_title(const songs_view_t &view, const size_t idx) {
+  return music_song_title(*view.music, songs_view_row(view, idx));
+}
+
+song_t songs_view_get(const songs_view_t &view, const size_t idx) {
+  return music_get_song(*view.music, songs_view_row(view, idx));
+}
+
+songs_view_t music_filter_songs(const music_t &music,
+                                const std::string &target_artist,
+                                const std::string &target_album) {
+  songs_view_t view;
+  view.music = &music;
+
+  if (target_artist != "" && target_album != "") {
+    const int album_idx = music_find_album(music, target_artist, target_album);
+    if (album_idx != -1) {
+      view.ranges.push_back(music.albums[album_idx].songs);
+    }
+
+  } else if (target_artist != "") {
+    const int artist_idx = music_find_artist(music, target_artist);
+    if (artist_idx != -1) {
+      view.ranges.push_back(music.artists[artist_idx].songs);
+    }
+
+  } else if (target_album != "") {
+    // The same album name can belong to several artists
+    for (const auto idx : music_find_albums(music, target_album)) {
+      view.ranges.push_back(music.albums[idx].songs);
+    }
+
+  } else {
+    range_t all;
+    all.end = music.songs.size();
+    view.ranges.push_back(all);
+  }
+
+  for (const auto &range : view.ranges) {
+    view.size += range.end - range.begin;
+  }
+
+  return view;
+}
+
+std::vector<std::string> music_filter_artists(const music_t &music) {
+  std::vector<std::string> artists;
+  for (const auto &artist : music.artists) {
+    artists.push_back(string_pool_get(music.strings, artist.name));
+  }
+
+  return artists;
 }
 
 std::vector<std::string> music_filter_albums(const music_t &music,
                                              const std::string &target_artist) {
-  auto keys = extract_keys<std::string, std::vector<song_t>>(music.albums);
   std::vector<std::string> albums;
 
   if (target_artist == "") {
-    albums = keys;
+    for (const auto idx : music.albums_by_name) {
+      const auto &name = string_pool_get(music.strings, music.albums[idx].name);
+      if (albums.empty() || albums.back() != name) {
+        albums.push_back(name);
+      }
+    }
 
   } else {
-    for (const auto &album: keys) {
-      const auto song = music.albums.at(album).at(0);
-      if (target_artist == song.artist) {
-        albums.push_back(album);
+    const int artist_idx = music_find_artist(music, target_artist);
+    if (artist_idx != -1) {
+      const auto &range = music.artists[artist_idx].albums;
+      for (size_t i = range.begin; i < range.end; i++) {
+        albums.push_back(string_pool_get(music.strings, music.albums[i].name));
       }
     }
   }
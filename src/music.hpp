@@ -1,17 +1,46 @@
 #ifndef ZP3_MUSIC_HPP
 #define ZP3_MUSIC_HPP
 
+#include <limits.h>
+#include <sys/stat.h>
+
 #include <map>
+#include <memory>
+#include <mutex>
 #include <set>
+#include <string>
 #include <vector>
+#include <algorithm>
+#include <unordered_map>
 
 #include <taglib/tag.h>
 #include <taglib/fileref.h>
 #include <taglib/tpropertymap.h>
 
+#include "id3.hpp"
 #include "log.hpp"
 #include "util.hpp"
 
+// File extensions picked up by the library
+extern const std::vector<std::string> music_file_exts;
+
+/**
+ * ReplayGain
+ *
+ * Track and album gain in dB towards `MUSIC_REPLAYGAIN_TARGET` LUFS, and
+ * sample peaks relative to full scale, as measured by the loudness scanner.
+ * `analysed` is false until the song has been scanned.
+ */
+#define MUSIC_REPLAYGAIN_TARGET -18.0f
+
+struct replaygain_t {
+  bool analysed = false;
+  float track_gain = 0.0f;
+  float track_peak = 1.0f;
+  float album_gain = 0.0f;
+  float album_peak = 1.0f;
+};
+
 struct song_t {
   std::string file_path;
   std::string title;
@@ -19,28 +48,274 @@ struct song_t {
   std::string album;
   int year = -1;
   int track_number = -1;
+  replaygain_t replaygain;
+};
+
+/**
+ * String pool
+ *
+ * Interns strings that repeat across songs (artists, albums and directories)
+ * so each distinct value is stored once and songs refer to it by id.
+ *
+ * Strings are kept in chunks of `STRING_POOL_CHUNK` and their ids in
+ * `STRING_POOL_SHARDS` hash shards. Copies of the pool share both, and a
+ * chunk or shard is only copied when a pool that shares it is modified, so
+ * interning a string in a copy costs one chunk and one shard.
+ */
+#define STRING_POOL_CHUNK 256
+#define STRING_POOL_SHARDS 64
+
+typedef uint32_t str_id_t;
+typedef std::vector<std::string> string_chunk_t;
+typedef std::unordered_map<std::string, str_id_t> string_shard_t;
+
+struct string_pool_t {
+  size_t size = 0;
+  std::vector<std::shared_ptr<string_chunk_t>> chunks;
+  std::vector<std::shared_ptr<string_shard_t>> shards;
+};
+
+/**
+ * Song table
+ *
+ * Struct-of-arrays song store with one row per song, sorted by artist, album
+ * and track number (see `song_comparator()`). Titles and file names are
+ * packed NUL terminated into a character buffer, artists, albums and
+ * directories are ids into the library's string pool.
+ *
+ * Rows are split into chunks of `SONG_TABLE_CHUNK` to twice that many rows,
+ * `starts[i]` being the first row of chunk `i`. Like the string pool, copies
+ * of the table share chunks and adding or removing a song copies only the
+ * chunk it lands in if it is shared, so applying a few changes to a copy of
+ * the library costs little more than the changes themselves.
+ */
+#define SONG_TABLE_CHUNK 256
+
+struct song_chunk_t {
+  std::vector<char> text;
+  size_t text_garbage = 0;
+
+  std::vector<uint32_t> titles;
+  std::vector<uint32_t> file_names;
+  std::vector<str_id_t> dirs;
+  std::vector<str_id_t> artists;
+  std::vector<str_id_t> albums;
+  std::vector<int16_t> years;
+  std::vector<int16_t> track_numbers;
+  std::vector<replaygain_t> replaygains;
+
+  size_t size() const { return titles.size(); }
+};
+
+struct song_table_t {
+  std::vector<std::shared_ptr<song_chunk_t>> chunks;
+  std::vector<uint32_t> starts;
+  size_t nb_rows = 0;
+
+  size_t size() const { return nb_rows; }
+};
+
+/**
+ * Song paths
+ *
+ * Where the song at each file path sorts in the song table, so a song can
+ * be found from its path with a binary search instead of a pass over the
+ * table. Sharded like the string pool, copies of the library share the
+ * shards a change does not touch.
+ */
+#define SONG_PATHS_SHARDS 64
+
+struct song_key_t {
+  str_id_t artist = 0;
+  str_id_t album = 0;
+  int16_t track_number = 0;
+};
+
+typedef std::unordered_map<std::string, song_key_t> song_paths_shard_t;
+typedef std::vector<std::shared_ptr<song_paths_shard_t>> song_paths_t;
+
+// Half open range [begin, end)
+struct range_t {
+  uint32_t begin = 0;
+  uint32_t end = 0;
+};
+
+struct artist_t {
+  str_id_t name = 0;
+  range_t songs;   // Rows in the song table
+  range_t albums;  // Entries in music_t::albums
+};
+
+struct album_t {
+  str_id_t name = 0;
+  str_id_t artist = 0;
+  range_t songs;  // Rows in the song table
 };
 
 typedef std::vector<song_t> songs_t;
-typedef std::map<std::string, std::set<std::string>> artists_t;
-typedef std::map<std::string, std::vector<song_t>> albums_t;
+typedef std::vector<artist_t> artists_t;
+typedef std::vector<album_t> albums_t;
+
+struct music_t;
+
+/**
+ * Songs view
+ *
+ * A filtered list of songs expressed as ranges of rows in a library's song
+ * table. Creating or copying a view never copies song data, the library it
+ * refers to must outlive it.
+ */
+struct songs_view_t {
+  const music_t *music = nullptr;
+  std::vector<range_t> ranges;
+  size_t size = 0;
+};
+
+/**
+ * Library index
+ *
+ * On-disk cache of parsed song metadata keyed by file path. An entry is only
+ * trusted while the file's mtime and size match what was recorded, otherwise
+ * the file is re-parsed. Files that failed to parse are cached too (with
+ * `valid = false`) so they are not re-parsed on every boot either. The
+ * loudness scanner stores its results in the same entries, so a modified
+ * file loses them and is analysed again.
+ */
+#define MUSIC_INDEX_MAGIC "ZP3I"
+#define MUSIC_INDEX_VERSION 2
+
+struct music_index_entry_t {
+  int64_t mtime = 0;
+  int64_t size = 0;
+  bool valid = false;
+  song_t song;
+};
 
+typedef std::map<std::string, music_index_entry_t> music_index_t;
+
+/**
+ * Seek index
+ *
+ * Frame index and exact length of a song, built by scanning the file once
+ * and kept in a file of its own next to the library index. `offsets[i]` is
+ * the byte offset of frame `i * step`. Like library index entries, an entry
+ * is only used while the file's mtime and size match.
+ */
+#define MUSIC_SEEK_INDEX_MAGIC "ZP3S"
+#define MUSIC_SEEK_INDEX_VERSION 1
+
+struct music_seek_entry_t {
+  int64_t mtime = 0;
+  int64_t size = 0;
+  int64_t rate = 0;
+  int64_t samples = 0;
+  int64_t step = 0;
+  std::vector<int64_t> offsets;
+};
+
+typedef std::map<std::string, music_seek_entry_t> music_seek_index_t;
+
+/**
+ * Seek index shared between threads: the loudness scanner builds entries in
+ * the background and the player uses them, or adds one it had to build
+ * itself. Entries are copied in and out under the lock, and the store is
+ * only written back to `path` if it changed.
+ */
+struct music_seek_store_t {
+  std::mutex mutex;
+  music_seek_index_t index;
+  std::string path;
+  bool dirty = false;
+};
+
+/**
+ * Music library
+ *
+ * Artists and albums are contiguous ranges of the sorted song table and are
+ * kept in the same order as it, so an album is a slice of the table rather
+ * than a copy of its songs. Since both are sorted by name, looking up an
+ * artist, or an album of an artist, is a binary search. Adding or removing a
+ * song updates the ranges and the album name index in place.
+ */
 struct music_t {
-  songs_t songs;
+  string_pool_t strings;
+  song_table_t songs;
+  song_paths_t paths;
   artists_t artists;
   albums_t albums;
+
+  // Indices into `albums` sorted by album name then artist, for looking up
+  // albums by name across artists
+  std::vector<uint32_t> albums_by_name;
 };
 
+str_id_t string_pool_intern(string_pool_t &pool, const std::string &value);
+bool string_pool_find(const string_pool_t &pool, const std::string &value, str_id_t &id);
+const std::string &string_pool_get(const string_pool_t &pool, const str_id_t id);
+
 bool song_comparator(const song_t &s1, const song_t &s2);
 void song_print(const song_t &song);
+int song_parse_metadata_taglib(song_t &song, const std::string &song_path);
 int song_parse_metadata(song_t &song, const std::string &song_path);
+int song_parse_replaygain(const std::string &song_path,
+                          const bool album,
+                          float &gain_db);
 int songs_parse_metadata(std::vector<song_t> &songs,
-                         const std::vector<std::string> &song_paths);
+                         const std::vector<std::string> &song_paths,
+                         const size_t nb_threads = 0);
+
+int music_index_load(music_index_t &index, const std::string &index_path);
+int music_index_save(const music_index_t &index, const std::string &index_path);
+int music_seek_index_load(music_seek_index_t &index, const std::string &index_path);
+int music_seek_index_save(const music_seek_index_t &index,
+                          const std::string &index_path);
+const music_seek_entry_t *music_seek_index_get(const music_seek_index_t &index,
+                                               const std::string &file_path);
+int music_seek_index_put(music_seek_index_t &index,
+                         const std::string &file_path,
+                         music_seek_entry_t entry);
+int music_seek_store_load(music_seek_store_t &store, const std::string &index_path);
+int music_seek_store_save(music_seek_store_t &store);
+bool music_seek_store_has(music_seek_store_t &store, const std::string &file_path);
+bool music_seek_store_get(music_seek_store_t &store,
+                          const std::string &file_path,
+                          music_seek_entry_t &entry);
+int music_seek_store_put(music_seek_store_t &store,
+                         const std::string &file_path,
+                         music_seek_entry_t entry);
+
+void music_init(music_t &music, songs_t &songs);
+song_t music_get_song(const music_t &music, const size_t idx);
+const char *music_song_title(const music_t &music, const size_t idx);
+const std::string &music_song_artist(const music_t &music, const size_t idx);
+const std::string &music_song_album(const music_t &music, const size_t idx);
+std::string music_song_path(const music_t &music, const size_t idx);
+int music_find_artist(const music_t &music, const std::string &artist);
+int music_find_album(const music_t &music,
+                     const std::string &artist,
+                     const std::string &album);
+std::vector<uint32_t> music_find_albums(const music_t &music,
+                                        const std::string &album);
+int music_add_song(music_t &music, const song_t &song);
+int music_remove_song(music_t &music, const song_t &song);
+int music_set_replaygain(music_t &music,
+                         const std::string &file_path,
+                         const replaygain_t &replaygain);
+size_t music_update(music_t &music,
+                    const std::set<std::string> &removed,
+                    const songs_t &added);
+int music_load_library(music_t &music,
+                       const std::string &path,
+                       const std::string &index_path = "",
+                       const size_t nb_threads = 0);
+size_t songs_view_row(const songs_view_t &view, const size_t idx);
+const char *songs_view_title(const songs_view_t &view, const size_t idx);
+song_t songs_view_get(const songs_view_t &view, const size_t idx);
 
-int music_load_library(music_t &music, const std::string &path);
-songs_t music_filter_songs(const music_t &zp3,
-                           const std::string &target_artist = "",
-                           const std::string &target_album = "");
+songs_view_t music_filter_songs(const music_t &music,
+                                const std::string &target_artist = "",
+                                const std::string &target_album = "");
+std::vector<std::string> music_filter_artists(const music_t &music);
 std::vector<std::string> music_filter_albums(const music_t &music,
                                              const std::string &target_artist = "");
 
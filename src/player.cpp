@@ -1,129 +1,736 @@
 #include "player.hpp"
 
+// Equal-power crossfade curve, sin() over a quarter turn in Q15
+static int16_t player_fade_curve[PLAYER_CROSSFADE_STEPS + 1];
+
 void player_init() {
-  mpg123_init();  // Do this only once!
+  // Do this only once!
+  decoder_init();
+  ao_initialize();
+  for (int i = 0; i <= PLAYER_CROSSFADE_STEPS; i++) {
+    const double angle = M_PI / 2.0 * i / PLAYER_CROSSFADE_STEPS;
+    player_fade_curve[i] = lrint(sin(angle) * INT16_MAX);
+  }
+}
+
+int output_open(output_t &output,
+                const long rate,
+                const int channels,
+                const int bits) {
+  // Keep the device open if the format has not changed
+  if (output.is_open && output.format.rate == rate
+      && output.format.channels == channels && output.format.bits == bits) {
+    return 0;
+  }
+  output_close(output);
+
+  output.format.bits = bits;
+  output.format.rate = rate;
+  output.format.channels = channels;
+  output.format.byte_format = AO_FMT_NATIVE;
+  output.format.matrix = 0;
+  if (output.capture == false) {
+    if (output.driver == -1) {
+      output.driver = ao_default_driver_id();
+    }
+    output.dev = ao_open_live(output.driver, &output.format, NULL);
+    if (output.dev == nullptr) {
+      LOG_ERROR("Failed to open audio device!");
+      return -1;
+    }
+  }
+  output.is_open = true;
+  output.nb_opens++;
+
+  return 0;
+}
+
+int output_play(output_t &output, const unsigned char *data, const size_t size) {
+  if (output.capture) {
+    output.captured.insert(output.captured.end(), data, data + size);
+    return 0;
+  }
+
+  if (ao_play(output.dev, (char *) data, size) == 0) {
+    LOG_ERROR("Failed to play audio!");
+    return -1;
+  }
+
+  return 0;
+}
+
+void output_close(output_t &output) {
+  if (output.dev != nullptr) {
+    ao_close(output.dev);
+    output.dev = nullptr;
+  }
+  output.is_open = false;
+}
+
+/**
+ * Decode the next block of `track` into its buffer.
+ */
+static void track_decode(track_t &track) {
+  track.status = decoder_read(track.decoder,
+                              track.buffer.data(),
+                              track.buffer.size(),
+                              track.buffered);
+  track.position += track.buffered / (track.decoder.channels * DECODER_BITS / 8);
+}
+
+int track_open(track_t &track,
+               const song_t &song,
+               const size_t read_ahead,
+               const music_seek_entry_t *seek) {
+  track_close(track);
+  track.song = song;
+  if (reader_open(track.reader, song.file_path, read_ahead) != 0
+      || decoder_open(track.decoder, track.reader) != 0) {
+    track_close(track);
+    return -1;
+  }
+
+  // Exact length from the frame index if there is one, an estimate for MPEG
+  // audio until the first seek builds it
+  track.indexed = (decoder_set_index(track.decoder, seek) == 0);
+  track.length = decoder_duration(track.decoder);
+
+  // Decode the first block
+  track.buffer.resize(decoder_block_size(track.decoder));
+  track_decode(track);
+
+  return 0;
+}
+
+void track_close(track_t &track) {
+  decoder_close(track.decoder);
+  reader_close(track.reader);
+  track.length = 0.0f;
+  track.replay_gain = 1.0f;
+  track.seek = music_seek_entry_t();
+  track.indexed = false;
+  track.scanned = false;
+  track.buffered = 0;
+  track.mixed = 0;
+  track.position = 0;
+  track.status = DECODER_OK;
+}
+
+/**
+ * Seek `track` to `sample`. A track without a frame index is scanned for one
+ * first. Returns the sample decoding continues from, or -1.
+ */
+off_t track_seek(track_t &track, const off_t sample) {
+  if (track.indexed == false) {
+    track.scanned = (decoder_index(track.decoder, nullptr, track.seek) == 1);
+    track.indexed = true;
+    track.length = decoder_duration(track.decoder);
+  }
+
+  return decoder_seek(track.decoder, sample);
+}
+
+/**
+ * Open the first playable song in the queue at or after `index`, skipping
+ * songs that fail to open. Returns -1 if the end of the queue is reached.
+ */
+static int player_open_track(player_t &player, track_t &track, size_t &index) {
+  for (; index < player.song_queue.size; index++) {
+    const song_t song = songs_view_get(player.song_queue, index);
+    music_seek_entry_t seek;
+    const bool has_seek = player.seek_store != nullptr
+                          && music_seek_store_get(*player.seek_store, song.file_path, seek);
+    if (track_open(track, song, player.read_ahead, has_seek ? &seek : nullptr) != 0) {
+      continue;
+    }
+
+    // ReplayGain from the loudness scan, limited so the peak stays below
+    // full scale, otherwise from the tags
+    const bool album = (player.replaygain == PLAYER_REPLAYGAIN_ALBUM);
+    const auto &replaygain = song.replaygain;
+    float gain_db = 0.0f;
+    if (player.replaygain != PLAYER_REPLAYGAIN_OFF && replaygain.analysed) {
+      const float gain = album ? replaygain.album_gain : replaygain.track_gain;
+      const float peak = album ? replaygain.album_peak : replaygain.track_peak;
+      track.replay_gain = powf(10.0f, gain / 20.0f);
+      if (peak > 0.0f && track.replay_gain * peak > 1.0f) {
+        track.replay_gain = 1.0f / peak;
+      }
+    } else if (player.replaygain != PLAYER_REPLAYGAIN_OFF
+               && song_parse_replaygain(song.file_path, album, gain_db) == 0) {
+      track.replay_gain = powf(10.0f, gain_db / 20.0f);
+    }
+    return 0;
+  }
+
+  return -1;
+}
+
+/**
+ * Wait on the player condition variable until `pred` holds. While playing
+ * the wait is bounded, since the ring buffers are updated without holding
+ * the mutex, while paused it is not.
+ */
+template <typename PRED>
+static void player_wait(player_t &player, PRED pred) {
+  std::unique_lock<std::mutex> lock(player.mutex);
+  if (player.player_state == PLAYER_PAUSE) {
+    player.cond.wait(lock, [&]() {
+      return player.player_state != PLAYER_PAUSE || pred();
+    });
+  } else {
+    player.cond.wait_for(lock, std::chrono::microseconds(PLAYER_WAIT_US), pred);
+  }
+}
+
+/**
+ * Write all of `data` into `rb`, waiting for the output thread to make room.
+ * Returns -1 if the player is stopped or given a command while waiting.
+ */
+static int player_push(player_t &player,
+                       ring_buffer_t &rb,
+                       const unsigned char *data,
+                       const size_t size) {
+  const auto interrupted = [&]() {
+    return player.player_state == PLAYER_STOP || player.seek_time >= 0.0f
+           || player.skip;
+  };
+
+  size_t written = 0;
+  while (written < size) {
+    written += ring_buffer_write(rb, data + written, size - written);
+    if (written < size) {
+      if (interrupted()) {
+        return -1;
+      }
+      player_wait(player, [&]() {
+        return ring_buffer_space(rb) > 0 || interrupted();
+      });
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Mark the start of `track` at `offset` in the decoded stream.
+ */
+static int player_push_mark(player_t &player,
+                            const track_t &track,
+                            const size_t song_index,
+                            const uint64_t offset,
+                            const float start_time) {
+  player_mark_t mark;
+  mark.offset = offset;
+  mark.song_index = song_index;
+  mark.song_length = track.length;
+  mark.start_time = start_time;
+  mark.rate = track.decoder.rate;
+  mark.channels = track.decoder.channels;
+  mark.bits = DECODER_BITS;
+
+  return player_push(player, player.marks, (unsigned char *) &mark, sizeof(mark));
+}
+
+/**
+ * Run a decoded block through the gain stage, ramping to the current volume.
+ */
+static void player_gain(player_t &player, track_t &track) {
+  const int16_t target = gain_from_linear(player.volume * track.replay_gain);
+  gain_apply(player.gain, (int16_t *) track.buffer.data(), track.buffered / 2, target);
+}
+
+/**
+ * Crossfade from one track into the next: `start` is the frame of the
+ * outgoing track where it begins and `frames` its length, `ratio` brings the
+ * incoming track's ReplayGain to the outgoing one's, since the mix goes
+ * through the gain stage at the outgoing track's gain.
+ */
+struct player_fade_t {
+  off_t start = 0;
+  off_t frames = 0;
+  int16_t ratio = GAIN_UNITY;
+  bool mixed = false;
+};
+
+/**
+ * Length of `track` in frames. For MPEG audio that has not been indexed yet
+ * this is the estimate from the frame count, if it is too long the track
+ * ends before the fade and the next one simply follows it.
+ */
+static off_t track_frames(const track_t &track) {
+  if (track.decoder.samples > 0) {
+    return track.decoder.samples;
+  }
+  return track.length * track.decoder.rate;
+}
+
+static void player_plan_crossfade(player_t &player,
+                                  const track_t &track,
+                                  const track_t &next,
+                                  player_fade_t &fade) {
+  fade = player_fade_t();
+  const float seconds = player.crossfade;
+  const off_t track_length = track_frames(track);
+  const off_t next_length = track_frames(next);
+  if (seconds <= 0.0f
+      || track.decoder.rate != next.decoder.rate
+      || track.decoder.channels != next.decoder.channels
+      || track_length <= 0
+      || next_length <= 0) {
+    return;
+  }
+
+  const off_t frames = seconds * track.decoder.rate;
+  fade.frames = min(frames, min(track_length, next_length) / 2);
+  fade.start = track_length - fade.frames;
+  fade.ratio = gain_from_linear(next.replay_gain / track.replay_gain);
+}
+
+/**
+ * Mix the start of `next` into the part of `track`'s buffer that falls in
+ * the crossfade. `next` is consumed from its own buffer, and decoded a block
+ * at a time as that runs out.
+ */
+static void player_crossfade(player_fade_t &fade, track_t &track, track_t &next) {
+  const int channels = track.decoder.channels;
+  const size_t frame_size = channels * DECODER_BITS / 8;
+  const size_t nb_frames = track.buffered / frame_size;
+  const off_t first = track.position - nb_frames;
+  int16_t *out = (int16_t *) track.buffer.data();
+
+  for (off_t i = max(fade.start - first, (off_t) 0); i < (off_t) nb_frames; i++) {
+    if (next.mixed == next.buffered && next.status == DECODER_OK) {
+      track_decode(next);
+      next.mixed = 0;
+    }
+    const int16_t *in = nullptr;
+    if (next.mixed < next.buffered) {
+      in = (const int16_t *) (next.buffer.data() + next.mixed);
+      next.mixed += frame_size;
+    }
+
+    // Past the end of the fade only the incoming track is left
+    const off_t t = first + i - fade.start;
+    const int step = (t < fade.frames) ? t * PLAYER_CROSSFADE_STEPS / fade.frames
+                                       : PLAYER_CROSSFADE_STEPS;
+    const int32_t gain_out = player_fade_curve[PLAYER_CROSSFADE_STEPS - step];
+    const int32_t gain_in = player_fade_curve[step];
+    for (int c = 0; c < channels; c++) {
+      int32_t value = (out[i * channels + c] * gain_out) >> 15;
+      if (in != nullptr) {
+        value += (((in[c] * gain_in) >> 15) * fade.ratio) >> GAIN_SHIFT;
+      }
+      value = (value > INT16_MAX) ? INT16_MAX : (value < INT16_MIN) ? INT16_MIN : value;
+      out[i * channels + c] = value;
+    }
+    fade.mixed = true;
+  }
+}
+
+/**
+ * Drop everything buffered. The decoder asks and waits, the output thread
+ * clears both rings while the decoder is not writing.
+ */
+static void player_flush(player_t &player) {
+  std::unique_lock<std::mutex> lock(player.mutex);
+  player.flush = true;
+  player.cond.notify_all();
+  player.cond.wait(lock, [&]() {
+    return player.flush == false || player.player_state == PLAYER_STOP;
+  });
+}
+
+/**
+ * Tell whoever is listening on the player's eventfd that something changed.
+ */
+static void player_notify(player_t &player) {
+  if (player.event_fd == -1) {
+    return;
+  }
+
+  const uint64_t value = 1;
+  if (write(player.event_fd, &value, sizeof(value)) != sizeof(value)) {
+    LOG_ERROR("Failed to signal player event!");
+  }
+}
+
+/**
+ * Change the player state and wake both player threads.
+ */
+static void player_set_state(player_t &player, const int state) {
+  std::lock_guard<std::mutex> guard(player.mutex);
+  player.player_state = state;
+  player.cond.notify_all();
+}
+
+static void player_output_thread(player_t *player) {
+  std::vector<unsigned char> chunk(PLAYER_OUTPUT_CHUNK);
+  const size_t prebuffer = ring_buffer_capacity(player->buffer) / 2;
+  uint64_t played = 0;
+  uint64_t track_start = 0;
+  float start_time = 0.0f;
+  float bytes_per_sec = 1.0f;
+  bool started = false;
+  bool starved = false;
+  player_mark_t mark;
+  bool has_mark = false;
+
+  while (player->player_state != PLAYER_STOP) {
+    // Pause?
+    if (player->player_state == PLAYER_PAUSE) {
+      std::unique_lock<std::mutex> lock(player->mutex);
+      player->cond.wait(lock, [&]() {
+        return player->player_state != PLAYER_PAUSE || player->flush;
+      });
+    }
+
+    // Flush?
+    if (player->flush) {
+      ring_buffer_clear(player->buffer);
+      ring_buffer_clear(player->marks);
+      played = 0;
+      has_mark = false;
+      started = false;
+      starved = false;
+
+      std::lock_guard<std::mutex> guard(player->mutex);
+      player->flush = false;
+      player->cond.notify_all();
+      continue;
+    }
+    if (player->player_state != PLAYER_PLAY) {
+      continue;
+    }
+
+    // Read the decoder state before the fill level, once the decoder is done
+    // everything it wrote is visible
+    const bool done = player->decoder_done;
+    const size_t available = ring_buffer_size(player->buffer);
+    if (started == false && available < prebuffer && done == false) {
+      player_wait(*player, [&]() {
+        return ring_buffer_size(player->buffer) >= prebuffer || player->flush;
+      });
+      continue;
+    }
+    started = true;
+
+    // Start of the next track?
+    if (has_mark == false && ring_buffer_size(player->marks) >= sizeof(mark)) {
+      ring_buffer_read(player->marks, (unsigned char *) &mark, sizeof(mark));
+      has_mark = true;
+    }
+    if (has_mark && mark.offset == played) {
+      if (output_open(player->output, mark.rate, mark.channels, mark.bits) != 0) {
+        player_set_state(*player, PLAYER_STOP);
+        break;
+      }
+      player->song_index = mark.song_index;
+      player->song_length = mark.song_length;
+      player->song_time = mark.start_time;
+      player_notify(*player);
+      track_start = played;
+      start_time = mark.start_time;
+      bytes_per_sec = mark.rate * mark.channels * mark.bits / 8;
+      has_mark = false;
+      continue;
+    }
+
+    // Play up to the next track boundary
+    size_t size = min(available, chunk.size());
+    if (has_mark) {
+      size = min(size, (size_t) (mark.offset - played));
+    }
+    if (size == 0) {
+      if (done) {
+        break;
+      }
+      if (starved == false) {
+        player->underruns++;
+        starved = true;
+      }
+      player_wait(*player, [&]() {
+        return ring_buffer_size(player->buffer) > 0 || player->flush;
+      });
+      continue;
+    }
+    starved = false;
+
+    ring_buffer_read(player->buffer, chunk.data(), size);
+    player->cond.notify_all();
+    if (done == false && available - size < player->min_buffer_fill) {
+      player->min_buffer_fill = available - size;
+    }
+    output_play(player->output, chunk.data(), size);
+    played += size;
+    player->song_time = start_time + (played - track_start) / bytes_per_sec;
+  }
+
+  // Wake the decoder if it is waiting on us
+  player->cond.notify_all();
+}
+
+static void player_display_thread(player_t *player) {
+  const auto period = std::chrono::microseconds(1000000 / player->display_fps);
+  size_t shown_index = player->song_queue.size;
+  int shown_state = -1;
+  int shown_progress = -1;
+  song_t song;
+
+  while (player->refreshing) {
+    // Redraw only if something visible changed
+    const size_t index = player->song_index;
+    const int state = player->player_state;
+    const int progress = display_progress_x(*player->display,
+                                            player->song_time,
+                                            player->song_length);
+    if (index < player->song_queue.size
+        && (index != shown_index || state != shown_state
+            || progress != shown_progress)) {
+      if (index != shown_index) {
+        song = songs_view_get(player->song_queue, index);
+      }
+      display_song(*player->display,
+                   state,
+                   song,
+                   player->song_time,
+                   player->song_length);
+      player->redraws++;
+      shown_index = index;
+      shown_state = state;
+      shown_progress = progress;
+    } else if (display_tick(*player->display)) {
+      player->redraws++;
+    }
+
+    // Wait for the next frame, or a state change
+    std::unique_lock<std::mutex> lock(player->mutex);
+    const auto changed = [&]() {
+      return player->player_state != state || player->refreshing == false;
+    };
+    if (state == PLAYER_PAUSE) {
+      player->cond.wait(lock, changed);
+    } else {
+      player->cond.wait_for(lock, period, changed);
+    }
+  }
 }
 
 void *player_thread(void *arg) {
-play_song:
   player_t *player = (player_t *) arg;
-  player->player_state = PLAYER_PLAY;
 
   // Check song queue
-  if (player->song_index >= player->song_queue.size()) {
+  if (player->song_index >= player->song_queue.size) {
     LOG_ERROR("No songs in play queue!");
     return nullptr;
   }
 
-  // Initialize AO
-  ao_initialize();
-  int driver = ao_default_driver_id();
-
-  // Initialize MPG123
-  int err = 0;
-  mpg123_handle *mh = mpg123_new(NULL, &err);
-  size_t buffer_size = mpg123_outblock(mh);
-  auto buffer = (unsigned char *) malloc(buffer_size * sizeof(unsigned char));
-
-  // Open the file and get the decoding format
-  const auto song = player->song_queue.at(player->song_index);
-  mpg123_open(mh, song.file_path.c_str());
-
-  // Get song format
-  int channels = 0;
-  int encoding = 0;
-  long rate = 0;
-  mpg123_getformat(mh, &rate, &channels, &encoding);
-
-  // Set the output format and open the output device
-  ao_sample_format format;
-  format.bits = mpg123_encsize(encoding) * 8;  // 8 is number of bits
-  format.rate = rate;
-  format.channels = channels;
-  format.byte_format = AO_FMT_NATIVE;
-  format.matrix = 0;
-  ao_device *dev = ao_open_live(driver, &format, NULL);
-
-  // Play
-  mpg123_volume(mh, player->volume);
-  player->song_length = mpg123_framelength(mh) * mpg123_tpf(mh);
+  // The next track is opened while the current one is playing
+  track_t tracks[2];
+  track_t *track = &tracks[0];
+  track_t *next = &tracks[1];
+  size_t decode_index = player->song_index;
+  if (player_open_track(*player, *track, decode_index) != 0) {
+    LOG_ERROR("No playable songs in play queue!");
+    player->player_is_dead = true;
+    player_notify(*player);
+    return nullptr;
+  }
 
+  // Start the output thread
+  ring_buffer_init(player->buffer, player->buffer_size);
+  ring_buffer_init(player->marks, PLAYER_MAX_MARKS * sizeof(player_mark_t));
+  player->decoder_done = false;
+  player->flush = false;
+  player->underruns = 0;
+  player->min_buffer_fill = ring_buffer_capacity(player->buffer);
+  player->redraws = 0;
+  player->decode_blocks = 0;
+  player->decode_time = 0.0f;
+  player->decode_time_max = 0.0f;
+  player->io_wait = 0.0f;
+  player->io_wait_max = 0.0f;
+  player->gain.current = gain_from_linear(player->volume * track->replay_gain);
+  std::thread output_thread(player_output_thread, player);
+  std::thread display_thread;
   if (player->display != nullptr) {
-    display_song(*player->display,
-                 PLAYER_PLAY,
-                 song,
-                 0.0,
-                 player->song_length);
+    player->refreshing = true;
+    display_thread = std::thread(player_display_thread, player);
   }
 
-  // const size_t frame_length = mpg123_framelength(mh);
-  size_t done;
-  while (mpg123_read(mh, buffer, buffer_size, &done) == MPG123_OK) {
-    // Update song time
-    player->song_time = (mpg123_tell(mh) / mpg123_spf(mh)) * mpg123_tpf(mh);
-    if (player->display != nullptr) {
-      display_song(*player->display,
-                   player->player_state,
-                   song,
-                   player->song_time,
-                   player->song_length);
+  uint64_t written = 0;
+  size_t next_index = 0;
+  float track_start_time = 0.0f;
+  while (true) {
+    // Mark where the track starts in the stream, if interrupted the commands
+    // are handled below
+    if (player_push_mark(*player, *track, decode_index, written, track_start_time) != 0
+        && player->player_state == PLAYER_STOP) {
+      break;
     }
 
-    // Pause?
-    while (player->player_state == PLAYER_PAUSE);
+    bool next_prepared = false;
+    bool has_next = false;
+    player_fade_t fade;
+    while (track->status == DECODER_OK) {
+      // Stop or skip?
+      if (player->player_state == PLAYER_STOP || player->skip) {
+        break;
+      }
+
+      // Seek? Drop what is buffered and restart from the new position
+      const float seek_time = player->seek_time.exchange(-1.0f);
+      if (seek_time >= 0.0f) {
+        player_flush(*player);
+        written = 0;
+        const long rate = track->decoder.rate;
+        const bool indexed = track->indexed;
+        const off_t offset = track_seek(*track, seek_time * rate);
+        const float start_time = (offset > 0) ? (float) offset / rate : 0.0f;
+        track->position = (offset > 0) ? offset : 0;
+
+        // Keep a frame index built by the seek for next time
+        if (indexed == false && track->scanned && player->seek_store != nullptr) {
+          music_seek_store_put(*player->seek_store, track->song.file_path, track->seek);
+        }
+
+        // A crossfade under way starts over with a fresh next track
+        if (fade.mixed) {
+          track_close(*next);
+          next_prepared = false;
+          fade = player_fade_t();
+        }
+        if (player_push_mark(*player, *track, decode_index, written, start_time) != 0) {
+          continue;
+        }
+        track_decode(*track);
+        continue;
+      }
+
+      // Keep playing, this blocks while the buffer is full or paused and
+      // returns early on a command, in which case the block is dropped
+      if (fade.frames > 0) {
+        player_crossfade(fade, *track, *next);
+      }
+      player_gain(*player, *track);
+      if (player_push(*player,
+                      player->buffer,
+                      track->buffer.data(),
+                      track->buffered) != 0) {
+        continue;
+      }
+      written += track->buffered;
+
+      // Prepare the next track once this one is under way
+      if (next_prepared == false) {
+        next_index = decode_index + 1;
+        has_next = (player_open_track(*player, *next, next_index) == 0);
+        next_prepared = true;
+        if (has_next) {
+          player_plan_crossfade(*player, *track, *next, fade);
+        }
+      }
+
+      // Decode
+      struct timespec decode_start = tic();
+      track_decode(*track);
+      const float decode_time = toc(&decode_start);
+      player->decode_blocks++;
+      player->decode_time = player->decode_time + decode_time;
+      if (decode_time > player->decode_time_max) {
+        player->decode_time_max = decode_time;
+      }
+    }
+
+    // Time the decoder spent waiting on the card for this track
+    player->io_wait = player->io_wait + track->reader.io_wait;
+    if (track->reader.io_wait > player->io_wait_max) {
+      player->io_wait_max = track->reader.io_wait;
+    }
+    track_close(*track);
 
-    // Stop?
+    // Skip? Drop the rest of this track
+    if (player->skip.exchange(false)) {
+      player_flush(*player);
+      written = 0;
+    }
+
+    // Decode next song if song queue is not finished
     if (player->player_state == PLAYER_STOP) {
       break;
     }
+    if (next_prepared == false) {
+      next_index = decode_index + 1;
+      has_next = (player_open_track(*player, *next, next_index) == 0);
+    }
+    if (has_next == false) {
+      break;
+    }
+    decode_index = next_index;
 
-    // Keep playing
-    ao_play(dev, (char *) buffer, done);
+    // After a crossfade the next track carries on from where the mix left
+    // it, at the gain the mix ended on
+    track_start_time = 0.0f;
+    if (fade.mixed) {
+      const size_t frame_size = next->decoder.channels * DECODER_BITS / 8;
+      const size_t left = next->buffered - next->mixed;
+      memmove(next->buffer.data(), next->buffer.data() + next->mixed, left);
+      next->buffered = left;
+      next->mixed = 0;
+      track_start_time = (float) (next->position - left / frame_size) / next->decoder.rate;
+      player->gain.current = gain_from_linear(player->volume * next->replay_gain);
+    }
+    std::swap(track, next);
+  }
 
-    // Set volume
-    mpg123_volume(mh, player->volume);
+  // Let the output thread play out what is buffered
+  player->decoder_done = true;
+  player->cond.notify_all();
+  output_thread.join();
+  if (display_thread.joinable()) {
+    {
+      std::lock_guard<std::mutex> guard(player->mutex);
+      player->refreshing = false;
+      player->cond.notify_all();
+    }
+    display_thread.join();
   }
 
   // Print 100%
-  if (player->display != nullptr) {
+  if (player->display != nullptr && player->song_index < player->song_queue.size) {
     display_song(*player->display,
-                  player->player_state,
-                  song,
-                  player->song_length,
-                  player->song_length);
+                 player->player_state,
+                 songs_view_get(player->song_queue, player->song_index),
+                 player->song_length,
+                 player->song_length);
   }
 
   // Clean up
-  free(buffer);
-  ao_close(dev);
-  mpg123_close(mh);
-  mpg123_delete(mh);
-  mpg123_exit();
-  ao_shutdown();
+  track_close(tracks[0]);
+  track_close(tracks[1]);
+  output_close(player->output);
+  if (player->seek_store != nullptr) {
+    music_seek_store_save(*player->seek_store);
+  }
 
   // Reset player
-  // player->song_path = "";
-  // player->player_state = PLAYER_STOP;
   player->player_is_dead = true;
   player->song_length = 0.0f;
   player->song_time = 0.0f;
-
-  // Play next song if song queue is not finished
-  if (player->player_state != PLAYER_STOP) {
-    if ((player->song_index + 1) != player->song_queue.size()) {
-      player->song_index++;
-      goto play_song;
-    }
-  }
+  player_notify(*player);
 
   return nullptr;
 }
 
 int player_play(player_t &player) {
-  if (player.player_state != PLAYER_STOP) {
-    player.player_state = PLAYER_STOP;
-    player.thread.join();
-  }
+  player_stop(player);
+
+  // Set the state before the thread starts so a pause straight after this
+  // is not lost
+  player.player_state = PLAYER_PLAY;
+  player.player_is_dead = false;
+  player.seek_time = -1.0f;
+  player.skip = false;
   std::thread t(player_thread, &player);
   player.thread = std::move(t);
 
@@ -131,24 +738,67 @@ int player_play(player_t &player) {
 }
 
 void player_stop(player_t &player) {
-  player.player_state = PLAYER_STOP;
-  sleep(1);
+  player_set_state(player, PLAYER_STOP);
+  if (player.thread.joinable()) {
+    player.thread.join();
+  }
 }
 
 void player_toggle_pause_play(player_t &player) {
+  std::lock_guard<std::mutex> guard(player.mutex);
   if (player.player_state == PLAYER_PLAY) {
     player.player_state = PLAYER_PAUSE;
   } else if (player.player_state == PLAYER_PAUSE) {
     player.player_state = PLAYER_PLAY;
   }
+  player.cond.notify_all();
+}
+
+void player_seek(player_t &player, const float song_time) {
+  std::lock_guard<std::mutex> guard(player.mutex);
+  player.seek_time = (song_time < 0.0f) ? 0.0f : song_time;
+  player.cond.notify_all();
+}
+
+/**
+ * Seek `offset` seconds from the current position, or from the target of a
+ * seek that has not been picked up yet, so repeated presses add up.
+ */
+void player_seek_relative(player_t &player, const float offset) {
+  const float pending = player.seek_time;
+  const float from = (pending >= 0.0f) ? pending : player.song_time.load();
+  const float length = player.song_length;
+  float song_time = max(from + offset, 0.0f);
+  if (length > 0.0f) {
+    song_time = min(song_time, length);
+  }
+  player_seek(player, song_time);
+}
+
+void player_next(player_t &player) {
+  std::lock_guard<std::mutex> guard(player.mutex);
+  player.skip = true;
+  player.cond.notify_all();
+}
+
+void player_set_volume(player_t &player, const float volume) {
+  float value = volume;
+  value = (value > player.max_volume) ? player.max_volume : value;
+  value = (value < player.min_volume) ? player.min_volume : value;
+  player.volume = value;
+}
+
+void player_set_crossfade(player_t &player, const float seconds) {
+  float value = seconds;
+  value = (value > PLAYER_CROSSFADE_MAX) ? PLAYER_CROSSFADE_MAX : value;
+  value = (value < 0.0f) ? 0.0f : value;
+  player.crossfade = value;
 }
 
 void player_volume_up(player_t &player) {
-  player.volume += player.volume_delta;
-  player.volume = (player.volume > 1.0) ? 1.0 : player.volume;
+  player_set_volume(player, player.volume + player.volume_delta);
 }
 
 void player_volume_down(player_t &player) {
-  player.volume -= player.volume_delta;
-  player.volume = (player.volume < 0.0) ? 0.0 : player.volume;
+  player_set_volume(player, player.volume - player.volume_delta);
 }
@@ -1,36 +1,233 @@
 #ifndef ZP3_PLAYER_HPP
 #define ZP3_PLAYER_HPP
 
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <vector>
 
 #include <ao/ao.h>
-#include <mpg123.h>
 
 #include "music.hpp"
+#include "reader.hpp"
+#include "decoder.hpp"
+#include "gain.hpp"
 #include "display.hpp"
+#include "ring_buffer.hpp"
 
 #define PLAYER_PLAY 0
 #define PLAYER_STOP 1
 #define PLAYER_PAUSE 2
 
+/**
+ * Audio output
+ *
+ * The output device stays open across tracks and is only reopened when the
+ * sample format changes, so consecutive tracks of an album are written to
+ * the same device without a gap. With `capture` set the samples are appended
+ * to `captured` instead of being played.
+ */
+struct output_t {
+  int driver = -1;
+  ao_device *dev = nullptr;
+  ao_sample_format format;
+  bool is_open = false;
+  size_t nb_opens = 0;
+
+  bool capture = false;
+  std::vector<unsigned char> captured;
+};
+
+int output_open(output_t &output,
+                const long rate,
+                const int channels,
+                const int bits);
+int output_play(output_t &output, const unsigned char *data, const size_t size);
+void output_close(output_t &output);
+
+/**
+ * Track
+ *
+ * An open decoder for one song. MPEG audio is decoded gaplessly so the
+ * encoder delay and padding recorded in the LAME header are trimmed, and
+ * the first block is decoded on open so the next track can be prepared while
+ * the current one is still playing. The decoder reads the file through a
+ * `reader_t` rather than opening it itself.
+ *
+ * MPEG decoders are given the frame index in `seek` on open if there is one,
+ * so the length is exact and seeks land on the right frame straight away.
+ * The loudness scanner builds these in the background (see
+ * `music_scanner_t`). A song it has not got to yet has its length estimated
+ * from the frame count and is only scanned for an index on the first seek
+ * (see `track_seek()`), which keeps a full read of the file off the track
+ * change. The scan makes the length exact, sets `scanned` and leaves the new
+ * index in `seek` for the caller to keep.
+ *
+ * `position` counts the frames decoded so far, up to the end of `buffer`.
+ * While a track is being crossfaded in, `mixed` is how much of `buffer` the
+ * previous track has already taken.
+ */
+struct track_t {
+  song_t song;
+  reader_t reader;
+  decoder_t decoder;
+  float length = 0.0f;
+  float replay_gain = 1.0f;
+
+  // Frame index built on the first seek, if there was none to start from
+  music_seek_entry_t seek;
+  bool indexed = false;
+  bool scanned = false;
+
+  // Decoded but not yet played
+  std::vector<unsigned char> buffer;
+  size_t buffered = 0;
+  size_t mixed = 0;
+  off_t position = 0;
+  int status = DECODER_OK;
+};
+
+int track_open(track_t &track,
+               const song_t &song,
+               const size_t read_ahead=READER_WINDOW,
+               const music_seek_entry_t *seek=nullptr);
+void track_close(track_t &track);
+off_t track_seek(track_t &track, const off_t sample);
+
+/**
+ * Decode / output pipeline
+ *
+ * `player_thread` decodes into a lock-free ring buffer of PCM and a separate
+ * output thread drains it into the device, so a slow read or display update
+ * on the decoder side is absorbed by the buffer instead of starving the sound
+ * card. The default depth holds about 370 ms of 44.1 kHz 16-bit stereo.
+ *
+ * Track boundaries travel through a second ring of `player_mark_t`, which
+ * lets the output thread switch format and report the current song exactly
+ * when the first sample of a track is played.
+ */
+#define PLAYER_BUFFER_SIZE (64 * 1024)
+#define PLAYER_OUTPUT_CHUNK 4096
+#define PLAYER_MAX_MARKS 16
+#define PLAYER_WAIT_US 2000
+
+/**
+ * Display refresh
+ *
+ * The now playing screen is drawn by its own thread rather than the decoder.
+ * It samples the player at `display_fps` and only redraws when something
+ * visible changed: the song, the play/pause icon or the progress bar moving
+ * by a pixel. While paused it sleeps until the state changes.
+ */
+#define PLAYER_DISPLAY_FPS 10
+
+struct player_mark_t {
+  uint64_t offset = 0;
+  size_t song_index = 0;
+  float song_length = 0.0f;
+  float start_time = 0.0f;
+  long rate = 0;
+  int channels = 0;
+  int bits = 0;
+};
+
+/**
+ * Player control
+ *
+ * The UI controls the player through the functions below rather than by
+ * writing to it directly. Play, pause, stop and volume take effect
+ * immediately through atomics, seek and next are picked up by the decoder
+ * between blocks. Both player threads sleep on `cond` while paused or waiting
+ * for a command, so a paused player uses no CPU. The seek keys move
+ * `seek_step` seconds at a time.
+ */
+#define PLAYER_SEEK_STEP 10.0f
+
+/**
+ * Volume
+ *
+ * Every decoded block goes through the player's gain stage, which ramps to
+ * `volume` times the track's ReplayGain over the block. ReplayGain comes
+ * from the library's loudness scan (see `music_scanner_t`), or the song's
+ * tags if it has not been scanned yet, per track or per album depending on
+ * `replaygain`, and is off by default.
+ */
+#define PLAYER_REPLAYGAIN_OFF 0
+#define PLAYER_REPLAYGAIN_TRACK 1
+#define PLAYER_REPLAYGAIN_ALBUM 2
+
+/**
+ * Crossfade
+ *
+ * With `crossfade` set (0 to `PLAYER_CROSSFADE_MAX` seconds) the last
+ * seconds of a track are mixed with the start of the next one, which is
+ * decoded ahead into its own buffer while the current track plays. The
+ * tracks are weighted with an equal-power curve, read from a table of
+ * `PLAYER_CROSSFADE_STEPS` steps built by `player_init()`, and the mix is
+ * done in place in the current track's buffer so nothing is allocated while
+ * playing. The fade is at most half of either track, and tracks of
+ * different sample formats are played back to back instead.
+ */
+#define PLAYER_CROSSFADE_MAX 10.0f
+#define PLAYER_CROSSFADE_STEPS 1024
 
 struct player_t {
   // Settings
   float min_volume = 0.0f;
   float max_volume = 1.0f;
   float volume_delta = 0.05f;
+  size_t buffer_size = PLAYER_BUFFER_SIZE;
+  size_t read_ahead = READER_WINDOW;
+  float seek_step = PLAYER_SEEK_STEP;
+  int display_fps = PLAYER_DISPLAY_FPS;
+  int replaygain = PLAYER_REPLAYGAIN_OFF;
+  std::atomic<float> crossfade{0.0f};
 
   // State
   std::thread thread;
+  output_t output;
   display_t *display = nullptr;
-  std::vector<song_t> song_queue;
-  size_t song_index = 0;
-  int player_state = PLAYER_STOP;
-  bool player_is_dead = false;
-  float song_length = 0.0f;
-  float song_time = 0.0f;
-  float volume = 0.3f;
+  std::shared_ptr<const music_t> library;
+  songs_view_t song_queue;
+  std::atomic<size_t> song_index{0};
+  std::atomic<int> player_state{PLAYER_STOP};
+  std::atomic<bool> player_is_dead{false};
+  std::atomic<float> song_length{0.0f};
+  std::atomic<float> song_time{0.0f};
+  std::atomic<float> volume{0.3f};
+
+  // Frame indexes, shared with the loudness scanner, if set. Saved when
+  // playback ends if a seek added one.
+  music_seek_store_t *seek_store = nullptr;
+
+  // Eventfd signalled when the track changes or playback ends, if set
+  int event_fd = -1;
+
+  // Commands
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::atomic<float> seek_time{-1.0f};
+  std::atomic<bool> skip{false};
+  std::atomic<bool> flush{false};
+
+  // Pipeline
+  gain_t gain;
+  ring_buffer_t buffer;
+  ring_buffer_t marks;
+  std::atomic<bool> decoder_done{false};
+  std::atomic<size_t> underruns{0};
+  std::atomic<size_t> min_buffer_fill{0};
+  std::atomic<bool> refreshing{false};
+
+  // Instrumentation
+  std::atomic<size_t> redraws{0};
+  std::atomic<size_t> decode_blocks{0};
+  std::atomic<float> decode_time{0.0f};
+  std::atomic<float> decode_time_max{0.0f};
+  std::atomic<float> io_wait{0.0f};
+  std::atomic<float> io_wait_max{0.0f};
 };
 
 void player_init();
@@ -38,6 +235,11 @@ void *player_thread(void *arg);
 int player_play(player_t &player);
 void player_stop(player_t &player);
 void player_toggle_pause_play(player_t &player);
+void player_seek(player_t &player, const float song_time);
+void player_seek_relative(player_t &player, const float offset);
+void player_next(player_t &player);
+void player_set_volume(player_t &player, const float volume);
+void player_set_crossfade(player_t &player, const float seconds);
 void player_volume_up(player_t &player);
 void player_volume_down(player_t &player);
 
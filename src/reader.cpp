@@ -0,0 +1,164 @@
+#include "reader.hpp"
+
+/**
+ * Ask the kernel to read the window starting at the read position into the
+ * page cache, once less than half of the previous window is left.
+ */
+static void reader_prefetch(reader_t &reader) {
+  if (reader.prefetched >= reader.size
+      || reader.prefetched > reader.pos + reader.window / 2) {
+    return;
+  }
+
+  const size_t end = std::min(reader.pos + reader.window, reader.size);
+  if (posix_fadvise(reader.fd, reader.pos, end - reader.pos, POSIX_FADV_WILLNEED) != 0) {
+    LOG_WARN("Failed to prefetch [%s]", reader.path.c_str());
+  }
+  reader.prefetched = end;
+  reader.nb_prefetches++;
+}
+
+/**
+ * Read up to `count` bytes at `offset` straight from the file. Reading
+ * nothing before the size the file had when it was opened means it has been
+ * truncated since, which is an error rather than the end of the file.
+ */
+static ssize_t reader_fill(reader_t &reader, void *buf, size_t count, const size_t offset) {
+  ssize_t retval = 0;
+  do {
+    retval = pread(reader.fd, buf, count, offset);
+  } while (retval == -1 && errno == EINTR);
+
+  if (retval == -1 || (retval == 0 && count > 0 && offset < reader.size)) {
+    LOG_ERROR("Failed to read [%s], was it truncated?", reader.path.c_str());
+    return -1;
+  }
+
+  return retval;
+}
+
+int reader_open(reader_t &reader, const std::string &path, const size_t window) {
+  reader_close(reader);
+  reader.path = path;
+  reader.window = window;
+
+  reader.fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (reader.fd == -1 || fstat(reader.fd, &st) != 0 || st.st_size == 0) {
+    LOG_ERROR("Failed to open [%s]!", path.c_str());
+    reader_close(reader);
+    return -1;
+  }
+  reader.size = st.st_size;
+  reader.buffer.resize(READER_BUFFER);
+
+  // Read sequentially, starting with the first window
+  posix_fadvise(reader.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  reader_prefetch(reader);
+
+  return 0;
+}
+
+void reader_close(reader_t &reader) {
+  if (reader.fd != -1) {
+    close(reader.fd);
+    reader.fd = -1;
+  }
+
+  reader.size = 0;
+  reader.pos = 0;
+  reader.buffer_offset = 0;
+  reader.buffered = 0;
+  reader.prefetched = 0;
+  reader.nb_reads = 0;
+  reader.nb_prefetches = 0;
+  reader.io_wait = 0.0f;
+  reader.io_wait_max = 0.0f;
+}
+
+/**
+ * Read up to `count` bytes at `offset`, stopping at the end of the file.
+ * Reads that fall outside the buffer refill it from `offset`, reads larger
+ * than the buffer go straight to the caller. Returns the number of bytes
+ * read or -1.
+ */
+ssize_t reader_pread(reader_t &reader, void *buf, size_t count, const size_t offset) {
+  if (reader.fd == -1) {
+    return -1;
+  }
+
+  count = (offset < reader.size) ? std::min(count, reader.size - offset) : 0;
+  unsigned char *dst = (unsigned char *) buf;
+  size_t done = 0;
+  while (done < count) {
+    const size_t at = offset + done;
+    if (at >= reader.buffer_offset && at < reader.buffer_offset + reader.buffered) {
+      const size_t skip = at - reader.buffer_offset;
+      const size_t len = std::min(count - done, reader.buffered - skip);
+      memcpy(dst + done, reader.buffer.data() + skip, len);
+      done += len;
+      continue;
+    }
+
+    ssize_t retval = 0;
+    if (count - done >= reader.buffer.size()) {
+      retval = reader_fill(reader, dst + done, count - done, at);
+      done += (retval > 0) ? retval : 0;
+    } else {
+      retval = reader_fill(reader, reader.buffer.data(), reader.buffer.size(), at);
+      reader.buffer_offset = at;
+      reader.buffered = (retval > 0) ? retval : 0;
+    }
+    if (retval <= 0) {
+      return (done > 0) ? (ssize_t) done : retval;
+    }
+  }
+
+  return done;
+}
+
+ssize_t reader_read(void *handle, void *buf, size_t count) {
+  reader_t &reader = *(reader_t *) handle;
+  if (reader.fd == -1) {
+    return -1;
+  }
+
+  struct timespec start = tic();
+  const ssize_t size = reader_pread(reader, buf, count, reader.pos);
+  if (size > 0) {
+    reader.pos += size;
+  }
+  reader_prefetch(reader);
+
+  const float elapsed = toc(&start);
+  reader.nb_reads++;
+  reader.io_wait += elapsed;
+  reader.io_wait_max = std::max(reader.io_wait_max, elapsed);
+
+  return size;
+}
+
+off_t reader_lseek(void *handle, off_t offset, int whence) {
+  reader_t &reader = *(reader_t *) handle;
+
+  off_t pos = offset;
+  if (whence == SEEK_CUR) {
+    pos += reader.pos;
+  } else if (whence == SEEK_END) {
+    pos += reader.size;
+  } else if (whence != SEEK_SET) {
+    return -1;
+  }
+  if (pos < 0 || pos > (off_t) reader.size) {
+    return -1;
+  }
+
+  // Start a fresh window from the new position
+  reader.pos = pos;
+  if (reader.pos > reader.prefetched || reader.pos + reader.window < reader.prefetched) {
+    reader.prefetched = reader.pos;
+  }
+  reader_prefetch(reader);
+
+  return pos;
+}
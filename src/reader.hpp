@@ -0,0 +1,75 @@
+#ifndef ZP3_READER_HPP
+#define ZP3_READER_HPP
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "log.hpp"
+#include "util.hpp"
+
+/**
+ * Track reader
+ *
+ * Reads a file with `pread()` into a buffer of `READER_BUFFER` bytes and
+ * serves the decoder's reads out of it, so the decoder never issues reads
+ * against the card itself. The kernel is asked to read `window` bytes ahead
+ * of the read position into the page cache, and a new window is requested
+ * when half of the last one has been consumed. A track that is opened ahead
+ * of time has its first window loading while the current track plays.
+ *
+ * The file is read rather than memory mapped so a file that is truncated
+ * while it plays (rewritten or removed from the card) makes `reader_read()`
+ * fail, which the decoder reports as `DECODER_ERROR`, instead of raising
+ * SIGBUS on the next access to the mapping.
+ *
+ * `reader_read()` and `reader_lseek()` have the signatures mpg123 expects
+ * from `mpg123_replace_reader_handle()`, with the reader as the handle.
+ * `reader_pread()` reads at an offset without moving the read position, for
+ * parsing headers.
+ *
+ * Time spent in `reader_read()` is mostly waiting on the card, it is
+ * recorded in `io_wait` (total) and `io_wait_max` (worst single read).
+ */
+#define READER_WINDOW (512 * 1024)
+#define READER_BUFFER (64 * 1024)
+
+struct reader_t {
+  std::string path;
+  int fd = -1;
+  size_t size = 0;
+  size_t pos = 0;
+
+  // File contents from `buffer_offset` on
+  std::vector<unsigned char> buffer;
+  size_t buffer_offset = 0;
+  size_t buffered = 0;
+
+  // Read-ahead
+  size_t window = READER_WINDOW;
+  size_t prefetched = 0;
+
+  // Instrumentation
+  size_t nb_reads = 0;
+  size_t nb_prefetches = 0;
+  float io_wait = 0.0f;
+  float io_wait_max = 0.0f;
+};
+
+int reader_open(reader_t &reader,
+                const std::string &path,
+                const size_t window=READER_WINDOW);
+void reader_close(reader_t &reader);
+ssize_t reader_pread(reader_t &reader, void *buf, size_t count, const size_t offset);
+ssize_t reader_read(void *handle, void *buf, size_t count);
+off_t reader_lseek(void *handle, off_t offset, int whence);
+
+#endif // ZP3_READER_HPP
@@ -0,0 +1,71 @@
+#include "ring_buffer.hpp"
+
+void ring_buffer_init(ring_buffer_t &rb, const size_t capacity) {
+  size_t size = 1;
+  while (size < capacity) {
+    size <<= 1;
+  }
+  rb.data.assign(size, 0);
+  rb.mask = size - 1;
+  ring_buffer_clear(rb);
+}
+
+void ring_buffer_clear(ring_buffer_t &rb) {
+  // Only safe while neither side is running
+  rb.head.store(0);
+  rb.tail.store(0);
+}
+
+size_t ring_buffer_capacity(const ring_buffer_t &rb) {
+  return rb.data.size();
+}
+
+size_t ring_buffer_size(const ring_buffer_t &rb) {
+  const size_t tail = rb.tail.load(std::memory_order_acquire);
+  const size_t head = rb.head.load(std::memory_order_acquire);
+  return head - tail;
+}
+
+size_t ring_buffer_space(const ring_buffer_t &rb) {
+  return ring_buffer_capacity(rb) - ring_buffer_size(rb);
+}
+
+size_t ring_buffer_write(ring_buffer_t &rb,
+                         const unsigned char *data,
+                         const size_t size) {
+  const size_t head = rb.head.load(std::memory_order_relaxed);
+  const size_t tail = rb.tail.load(std::memory_order_acquire);
+  const size_t space = rb.data.size() - (head - tail);
+  const size_t n = (size < space) ? size : space;
+
+  // Copy in at most two pieces, the second one wraps around
+  const size_t offset = head & rb.mask;
+  const size_t first = std::min(n, rb.data.size() - offset);
+  memcpy(rb.data.data() + offset, data, first);
+  memcpy(rb.data.data(), data + first, n - first);
+  rb.head.store(head + n, std::memory_order_release);
+
+  return n;
+}
+
+size_t ring_buffer_peek(const ring_buffer_t &rb,
+                        unsigned char *data,
+                        const size_t size) {
+  const size_t tail = rb.tail.load(std::memory_order_relaxed);
+  const size_t head = rb.head.load(std::memory_order_acquire);
+  const size_t n = std::min(size, head - tail);
+
+  const size_t offset = tail & rb.mask;
+  const size_t first = std::min(n, rb.data.size() - offset);
+  memcpy(data, rb.data.data() + offset, first);
+  memcpy(data + first, rb.data.data(), n - first);
+
+  return n;
+}
+
+size_t ring_buffer_read(ring_buffer_t &rb, unsigned char *data, const size_t size) {
+  const size_t n = ring_buffer_peek(rb, data, size);
+  rb.tail.store(rb.tail.load(std::memory_order_relaxed) + n,
+                std::memory_order_release);
+  return n;
+}
@@ -0,0 +1,43 @@
+#ifndef ZP3_RING_BUFFER_HPP
+#define ZP3_RING_BUFFER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+/**
+ * Lock-free single producer / single consumer byte ring buffer
+ *
+ * Exactly one thread may write and exactly one other thread may read. The
+ * producer only stores `head` and the consumer only stores `tail`, both are
+ * free running byte counts, so neither side ever takes a lock or blocks the
+ * other. Capacity is rounded up to a power of two.
+ */
+#define RING_BUFFER_CACHE_LINE 64
+
+struct ring_buffer_t {
+  std::vector<unsigned char> data;
+  size_t mask = 0;
+
+  alignas(RING_BUFFER_CACHE_LINE) std::atomic<size_t> head{0};
+  alignas(RING_BUFFER_CACHE_LINE) std::atomic<size_t> tail{0};
+};
+
+void ring_buffer_init(ring_buffer_t &rb, const size_t capacity);
+void ring_buffer_clear(ring_buffer_t &rb);
+size_t ring_buffer_capacity(const ring_buffer_t &rb);
+size_t ring_buffer_size(const ring_buffer_t &rb);
+size_t ring_buffer_space(const ring_buffer_t &rb);
+size_t ring_buffer_write(ring_buffer_t &rb,
+                         const unsigned char *data,
+                         const size_t size);
+size_t ring_buffer_peek(const ring_buffer_t &rb,
+                        unsigned char *data,
+                        const size_t size);
+size_t ring_buffer_read(ring_buffer_t &rb, unsigned char *data, const size_t size);
+
+#endif // ZP3_RING_BUFFER_HPP
@@ -0,0 +1,308 @@
+#include "scanner.hpp"
+
+// ioprio_set() has no glibc wrapper
+#define SCANNER_IOPRIO_WHO_PROCESS 1
+#define SCANNER_IOPRIO_CLASS_IDLE 3
+#define SCANNER_IOPRIO_CLASS_SHIFT 13
+
+typedef std::vector<music_index_entry_t *> scanner_album_t;
+
+static void scanner_sleep(const float seconds) {
+  if (seconds <= 0.0f) {
+    return;
+  }
+  struct timespec ts;
+  ts.tv_sec = (time_t) seconds;
+  ts.tv_nsec = (seconds - ts.tv_sec) * 1e9;
+  nanosleep(&ts, NULL);
+}
+
+/**
+ * Gain in dB that brings `blocks` to the ReplayGain target, 0 if there is
+ * nothing above the absolute gate to measure (silence, or a song too short
+ * to fill a block).
+ */
+static float scanner_gain(const std::vector<double> &blocks) {
+  const double loudness = loudness_integrated(blocks);
+  if (loudness <= LOUDNESS_ABSOLUTE_GATE) {
+    return 0.0f;
+  }
+  return MUSIC_REPLAYGAIN_TARGET - loudness;
+}
+
+/**
+ * Decode `file_path` and feed it to `meter`. After every block the caller
+ * sleeps long enough to be busy at most `duty` of the time and to read at
+ * most `io_rate` bytes per second (0 = unlimited). Returns -1 if the song
+ * could not be decoded or `stopping` was set part way through.
+ */
+int music_scan_song(const std::string &file_path,
+                    loudness_meter_t &meter,
+                    const float duty,
+                    const size_t io_rate,
+                    const std::atomic<bool> *stopping) {
+  reader_t reader;
+  decoder_t decoder;
+  if (reader_open(reader, file_path, MUSIC_SCANNER_WINDOW) != 0
+      || decoder_open(decoder, reader) != 0
+      || loudness_meter_init(meter, decoder.rate, decoder.channels) != 0) {
+    decoder_close(decoder);
+    reader_close(reader);
+    return -1;
+  }
+
+  std::vector<unsigned char> block(decoder_block_size(decoder));
+  const size_t frame_size = decoder.channels * DECODER_BITS / 8;
+  const float idle = (duty > 0.0f && duty < 1.0f) ? (1.0f - duty) / duty : 0.0f;
+  struct timespec start = tic();
+  int status = DECODER_OK;
+  while (status == DECODER_OK) {
+    if (stopping != nullptr && *stopping) {
+      status = DECODER_ERROR;
+      break;
+    }
+
+    struct timespec busy = tic();
+    size_t done = 0;
+    status = decoder_read(decoder, block.data(), block.size(), done);
+    if (status == DECODER_ERROR) {
+      break;
+    }
+    loudness_meter_add(meter, (const int16_t *) block.data(), done / frame_size);
+
+    // Throttle, whichever of CPU and I/O needs the longer pause wins
+    float pause = toc(&busy) * idle;
+    if (io_rate > 0) {
+      pause = std::max(pause, (float) reader.pos / io_rate - toc(&start));
+    }
+    scanner_sleep(pause);
+  }
+  decoder_close(decoder);
+  reader_close(reader);
+
+  return (status == DECODER_ERROR) ? -1 : 0;
+}
+
+/**
+ * Measure every song of `album` into `results`. Songs that fail to decode
+ * are left at unity gain so they are not retried on every scan. Returns -1
+ * if the scan was stopped.
+ */
+static int scanner_scan_album(music_scanner_t &scanner,
+                              const scanner_album_t &album,
+                              const size_t io_rate,
+                              std::vector<replaygain_t> &results) {
+  results.assign(album.size(), replaygain_t());
+  std::vector<double> blocks;
+  float peak = 0.0f;
+  for (size_t i = 0; i < album.size(); i++) {
+    const std::string &file_path = album[i]->song.file_path;
+    results[i].analysed = true;
+
+    loudness_meter_t meter;
+    if (music_scan_song(file_path, meter, scanner.duty, io_rate, &scanner.stopping) != 0) {
+      if (scanner.stopping) {
+        return -1;
+      }
+      LOG_WARN("Failed to scan [%s], leaving it at unity gain", file_path.c_str());
+      continue;
+    }
+
+    results[i].track_gain = scanner_gain(meter.blocks);
+    results[i].track_peak = meter.peak;
+    blocks.insert(blocks.end(), meter.blocks.begin(), meter.blocks.end());
+    peak = std::max(peak, meter.peak);
+  }
+
+  // Album values from the blocks of all songs together
+  const float album_gain = scanner_gain(blocks);
+  for (auto &result : results) {
+    result.album_gain = album_gain;
+    result.album_peak = peak;
+  }
+
+  return 0;
+}
+
+/**
+ * Build frame indexes for the MPEG songs in `index` that have none in
+ * `scanner.seek_store` yet, so the player knows their exact length without
+ * scanning them itself. mpg123 reads a file in one go when indexing, so the
+ * scan is paced between songs rather than blocks. Returns the number of
+ * songs indexed.
+ */
+static size_t scanner_index_songs(music_scanner_t &scanner, const music_index_t &index) {
+  static const std::vector<std::string> mpeg_exts = {"mp3"};
+  const float duty = scanner.duty;
+  const float idle = (duty > 0.0f && duty < 1.0f) ? (1.0f - duty) / duty : 0.0f;
+  struct timespec start = tic();
+  struct timespec checkpoint = tic();
+  size_t nb_read = 0;
+  size_t nb_indexed = 0;
+
+  for (const auto &kv : index) {
+    const std::string &file_path = kv.first;
+    if (scanner.stopping) {
+      break;
+    }
+    if (kv.second.valid == false
+        || has_ext(file_path.c_str(), file_path.length(), mpeg_exts) == false
+        || music_seek_store_has(*scanner.seek_store, file_path)) {
+      continue;
+    }
+
+    struct timespec busy = tic();
+    reader_t reader;
+    decoder_t decoder;
+    music_seek_entry_t entry;
+    if (reader_open(reader, file_path, MUSIC_SCANNER_WINDOW) == 0
+        && decoder_open(decoder, reader) == 0
+        && decoder_index(decoder, nullptr, entry) == 1
+        && music_seek_store_put(*scanner.seek_store, file_path, entry) == 0) {
+      nb_indexed++;
+    }
+    nb_read += reader.pos;
+    decoder_close(decoder);
+    reader_close(reader);
+
+    // Throttle like the loudness scan, in slices so stopping is not held up
+    float pause = toc(&busy) * idle;
+    if (scanner.io_rate > 0) {
+      pause = std::max(pause, (float) nb_read / scanner.io_rate - toc(&start));
+    }
+    for (; pause > 0.0f && scanner.stopping == false; pause -= 0.1f) {
+      scanner_sleep(std::min(pause, 0.1f));
+    }
+
+    if (toc(&checkpoint) > MUSIC_SCANNER_CHECKPOINT_S) {
+      music_seek_store_save(*scanner.seek_store);
+      checkpoint = tic();
+    }
+  }
+  music_seek_store_save(*scanner.seek_store);
+
+  return nb_indexed;
+}
+
+static bool scanner_album_pending(const scanner_album_t &album) {
+  for (const auto entry : album) {
+    if (entry->song.replaygain.analysed == false) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Index the MPEG songs in the index at `scanner.index_path` that have no
+ * frame index yet, if there is a seek store, then scan the albums that still
+ * have songs to analyse. Blocks until they are all done or
+ * `scanner.stopping` is set.
+ */
+int music_scanner_run(music_scanner_t &scanner) {
+  music_index_t index;
+  if (music_index_load(index, scanner.index_path) != 0) {
+    LOG_ERROR("Failed to load library index [%s]!", scanner.index_path.c_str());
+    return -1;
+  }
+
+  // Frame indexes first, they take a fraction of the time of the loudness
+  // scan and give the player exact lengths
+  if (scanner.seek_store != nullptr) {
+    const size_t nb_indexed = scanner_index_songs(scanner, index);
+    if (nb_indexed > 0) {
+      LOG_INFO("Indexed [%zu] songs for seeking", nb_indexed);
+    }
+  }
+
+  // Group songs by artist and album, keep albums with songs left to analyse
+  std::map<std::pair<std::string, std::string>, scanner_album_t> grouped;
+  for (auto &kv : index) {
+    if (kv.second.valid) {
+      const auto &song = kv.second.song;
+      grouped[{song.artist, song.album}].push_back(&kv.second);
+    }
+  }
+  std::vector<scanner_album_t> albums;
+  for (auto &kv : grouped) {
+    if (scanner_album_pending(kv.second)) {
+      albums.push_back(std::move(kv.second));
+    }
+  }
+  scanner.nb_albums = albums.size();
+  scanner.nb_scanned = 0;
+  if (albums.empty()) {
+    return 0;
+  }
+  LOG_INFO("Scanning loudness of [%zu] albums", albums.size());
+
+  // Scan, results are written back and checkpointed under the lock
+  std::mutex mutex;
+  struct timespec checkpoint = tic();
+  size_t nb_workers = scanner.nb_threads;
+  if (nb_workers == 0) {
+    nb_workers = std::thread::hardware_concurrency();
+  }
+  nb_workers = std::max(nb_workers, (size_t) 1);
+  const size_t io_rate = scanner.io_rate / nb_workers;
+  parallel_for(albums.size(), nb_workers, [&](const size_t i) {
+    std::vector<replaygain_t> results;
+    if (scanner.stopping || scanner_scan_album(scanner, albums[i], io_rate, results) != 0) {
+      return;
+    }
+
+    std::lock_guard<std::mutex> guard(mutex);
+    std::map<std::string, replaygain_t> replaygains;
+    for (size_t j = 0; j < albums[i].size(); j++) {
+      albums[i][j]->song.replaygain = results[j];
+      replaygains[albums[i][j]->song.file_path] = results[j];
+    }
+    if (scanner.library != nullptr) {
+      music_watcher_set_replaygain(*scanner.library, replaygains);
+    }
+    scanner.nb_scanned++;
+    if (toc(&checkpoint) > MUSIC_SCANNER_CHECKPOINT_S) {
+      music_index_save(index, scanner.index_path);
+      checkpoint = tic();
+    }
+  });
+
+  if (scanner.nb_scanned > 0 && music_index_save(index, scanner.index_path) != 0) {
+    return -1;
+  }
+  LOG_INFO("Scanned loudness of [%zu/%zu] albums",
+           scanner.nb_scanned.load(),
+           scanner.nb_albums.load());
+
+  return 0;
+}
+
+static void scanner_thread(music_scanner_t *scanner) {
+  // Lowest CPU priority and idle I/O class, worker threads inherit both
+  const pid_t tid = syscall(SYS_gettid);
+  if (setpriority(PRIO_PROCESS, tid, MUSIC_SCANNER_NICE) != 0) {
+    LOG_WARN("Failed to lower loudness scanner CPU priority!");
+  }
+  const int ioprio = SCANNER_IOPRIO_CLASS_IDLE << SCANNER_IOPRIO_CLASS_SHIFT;
+  if (syscall(SYS_ioprio_set, SCANNER_IOPRIO_WHO_PROCESS, tid, ioprio) != 0) {
+    LOG_WARN("Failed to lower loudness scanner I/O priority!");
+  }
+
+  music_scanner_run(*scanner);
+}
+
+int music_scanner_start(music_scanner_t &scanner, const std::string &index_path) {
+  music_scanner_stop(scanner);
+  scanner.index_path = index_path;
+  scanner.stopping = false;
+  scanner.thread = std::thread(scanner_thread, &scanner);
+
+  return 0;
+}
+
+void music_scanner_stop(music_scanner_t &scanner) {
+  if (scanner.thread.joinable()) {
+    scanner.stopping = true;
+    scanner.thread.join();
+  }
+}
@@ -0,0 +1,79 @@
+#ifndef ZP3_SCANNER_HPP
+#define ZP3_SCANNER_HPP
+
+#include <sys/resource.h>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "log.hpp"
+#include "util.hpp"
+#include "music.hpp"
+#include "reader.hpp"
+#include "decoder.hpp"
+#include "loudness.hpp"
+#include "watcher.hpp"
+
+/**
+ * Loudness scanner
+ *
+ * Background job that decodes every song in the library index that has not
+ * been analysed yet, measures its loudness (see `loudness_meter_t`) and
+ * stores track and album ReplayGain values back in the index. Albums are
+ * the unit of work since album gain depends on all of an album's songs: an
+ * album is scanned as a whole if any of its songs is missing its values.
+ * Albums are shared out between `nb_threads` workers (0 = one per core).
+ *
+ * If `seek_store` is set, MPEG songs without a frame index get one first
+ * (see `music_seek_store_t`), so the player has their exact length and does
+ * not have to scan them on a seek.
+ *
+ * The scan keeps out of playback's way. Its threads run at the lowest CPU
+ * priority and in the idle I/O class, each worker sleeps after every
+ * decoded block so it is busy at most `duty` of the time, and reads are
+ * paced to `io_rate` bytes per second across all workers.
+ *
+ * The index is saved at most every `MUSIC_SCANNER_CHECKPOINT_S` seconds and
+ * when the scan ends or is stopped, so an interrupted scan resumes from the
+ * last checkpoint the next time it runs. If `library` is set, each album's
+ * results are also published to the running library as soon as they are
+ * measured. Songs added to the library while running are not in the index
+ * yet, they are measured the next time the scanner runs.
+ */
+#define MUSIC_SCANNER_DUTY 0.5f
+#define MUSIC_SCANNER_IO_RATE (2 * 1024 * 1024)
+#define MUSIC_SCANNER_NICE 19
+#define MUSIC_SCANNER_CHECKPOINT_S 30.0f
+#define MUSIC_SCANNER_WINDOW (128 * 1024)
+
+struct music_scanner_t {
+  // Settings
+  std::string index_path;
+  size_t nb_threads = 0;
+  float duty = MUSIC_SCANNER_DUTY;
+  size_t io_rate = MUSIC_SCANNER_IO_RATE;
+  music_watcher_t *library = nullptr;
+  music_seek_store_t *seek_store = nullptr;
+
+  std::thread thread;
+  std::atomic<bool> stopping{false};
+
+  // Progress, in albums
+  std::atomic<size_t> nb_albums{0};
+  std::atomic<size_t> nb_scanned{0};
+};
+
+int music_scan_song(const std::string &file_path,
+                    loudness_meter_t &meter,
+                    const float duty = 1.0f,
+                    const size_t io_rate = 0,
+                    const std::atomic<bool> *stopping = nullptr);
+int music_scanner_run(music_scanner_t &scanner);
+int music_scanner_start(music_scanner_t &scanner, const std::string &index_path);
+void music_scanner_stop(music_scanner_t &scanner);
+
+#endif // ZP3_SCANNER_HPP
@@ -0,0 +1,223 @@
+#include <FLAC/stream_encoder.h>
+
+#include "test.hpp"
+#include "decoder.hpp"
+
+#define TEST_WAV "/tmp/zp3_test_decoder.wav"
+#define TEST_FLAC "/tmp/zp3_test_decoder.flac"
+#define TEST_RATE 44100
+#define TEST_CHANNELS 2
+
+// Stereo test signal, not a multiple of the block or FLAC frame size
+static std::vector<int16_t> make_pcm() {
+  std::vector<int16_t> pcm(TEST_CHANNELS * 10007);
+  for (size_t i = 0; i < pcm.size(); i += 2) {
+    pcm[i] = (int16_t) (i * 7);
+    pcm[i + 1] = -(int16_t) (i / 2);
+  }
+  return pcm;
+}
+
+static void write_file(const std::string &path, const std::string &data) {
+  FILE *fp = fopen(path.c_str(), "wb");
+  fwrite(data.data(), 1, data.size(), fp);
+  fclose(fp);
+}
+
+static void put_le(std::string &buf, const uint32_t value, const int nb_bytes) {
+  for (int i = 0; i < nb_bytes; i++) {
+    buf += (char) ((value >> (8 * i)) & 0xff);
+  }
+}
+
+static void write_wav(const std::string &path, const std::vector<int16_t> &pcm) {
+  const uint32_t data_size = pcm.size() * 2;
+  std::string wav = "RIFF";
+  put_le(wav, 4 + 8 + 16 + 8 + 6 + 8 + data_size, 4);
+  wav += "WAVE";
+  wav += "fmt ";
+  put_le(wav, 16, 4);
+  put_le(wav, 1, 2);
+  put_le(wav, TEST_CHANNELS, 2);
+  put_le(wav, TEST_RATE, 4);
+  put_le(wav, TEST_RATE * TEST_CHANNELS * 2, 4);
+  put_le(wav, TEST_CHANNELS * 2, 2);
+  put_le(wav, 16, 2);
+
+  // A chunk the decoder does not know, with an odd size
+  wav += "LIST";
+  put_le(wav, 5, 4);
+  wav += std::string("zp3\0\0\0", 6);
+
+  wav += "data";
+  put_le(wav, data_size, 4);
+  wav.append((const char *) pcm.data(), data_size);
+  write_file(path, wav);
+}
+
+static int write_flac(const std::string &path, const std::vector<int16_t> &pcm) {
+  FLAC__StreamEncoder *encoder = FLAC__stream_encoder_new();
+  FLAC__stream_encoder_set_channels(encoder, TEST_CHANNELS);
+  FLAC__stream_encoder_set_bits_per_sample(encoder, 16);
+  FLAC__stream_encoder_set_sample_rate(encoder, TEST_RATE);
+  if (FLAC__stream_encoder_init_file(encoder, path.c_str(), NULL, NULL)
+      != FLAC__STREAM_ENCODER_INIT_STATUS_OK) {
+    FLAC__stream_encoder_delete(encoder);
+    return -1;
+  }
+
+  std::vector<FLAC__int32> samples(pcm.begin(), pcm.end());
+  FLAC__stream_encoder_process_interleaved(encoder,
+                                           samples.data(),
+                                           samples.size() / TEST_CHANNELS);
+  FLAC__stream_encoder_finish(encoder);
+  FLAC__stream_encoder_delete(encoder);
+
+  return 0;
+}
+
+static int sniff(const std::string &data) {
+  write_file("/tmp/zp3_test_sniff", data);
+  reader_t reader;
+  reader_open(reader, "/tmp/zp3_test_sniff");
+  const int type = decoder_sniff(reader);
+  reader_close(reader);
+  return type;
+}
+
+/**
+ * Decode the rest of the stream in blocks of `block_size` bytes.
+ */
+static std::vector<int16_t> decode(decoder_t &decoder, const size_t block_size) {
+  std::vector<unsigned char> block(block_size);
+  std::vector<int16_t> pcm;
+  size_t done = 0;
+  while (decoder_read(decoder, block.data(), block.size(), done) == DECODER_OK) {
+    const int16_t *samples = (const int16_t *) block.data();
+    pcm.insert(pcm.end(), samples, samples + done / 2);
+  }
+  return pcm;
+}
+
+int test_decoder_sniff() {
+  CHECK(sniff(std::string("RIFF\0\0\0\0WAVEfmt ", 16)) == DECODER_WAV);
+  CHECK(sniff("fLaC") == DECODER_FLAC);
+  CHECK(sniff(std::string("ID3\4\0\0\0\0\0\2zzfLaC", 16)) == DECODER_FLAC);
+  CHECK(sniff(std::string("ID3\4\0\0\0\0\0\2zz\xff\xfb", 14)) == DECODER_MPG123);
+  CHECK(sniff("\xff\xfb\x90\x64") == DECODER_MPG123);
+  CHECK(sniff("OggS") == DECODER_NONE);
+  CHECK(sniff("not a song") == DECODER_NONE);
+
+  // Files that cannot be decoded are not opened
+  reader_t reader;
+  decoder_t decoder;
+  CHECK(reader_open(reader, "/tmp/zp3_test_sniff") == 0);
+  CHECK(decoder_open(decoder, reader) == -1);
+  CHECK(decoder.type == DECODER_NONE);
+  reader_close(reader);
+
+  return 0;
+}
+
+int test_decoder_wav() {
+  const auto pcm = make_pcm();
+  write_wav(TEST_WAV, pcm);
+
+  reader_t reader;
+  decoder_t decoder;
+  CHECK(reader_open(reader, TEST_WAV) == 0);
+  CHECK(decoder_open(decoder, reader) == 0);
+  CHECK(decoder.type == DECODER_WAV);
+  CHECK(decoder.rate == TEST_RATE);
+  CHECK(decoder.channels == TEST_CHANNELS);
+  CHECK(decoder.samples == (off_t) pcm.size() / TEST_CHANNELS);
+  CHECK(decoder_duration(decoder) == (float) decoder.samples / TEST_RATE);
+  CHECK(decoder_block_size(decoder) == DECODER_BLOCK_SIZE);
+
+  // Samples come out as they were written
+  CHECK(decode(decoder, DECODER_BLOCK_SIZE) == pcm);
+  int16_t frame[TEST_CHANNELS];
+  size_t done = 1;
+  CHECK(decoder_read(decoder, (unsigned char *) frame, sizeof(frame), done) == DECODER_DONE);
+  CHECK(done == 0);
+
+  // Seek
+  CHECK(decoder_seek(decoder, 5000) == 5000);
+  CHECK(decoder_read(decoder, (unsigned char *) frame, sizeof(frame), done) == DECODER_OK);
+  CHECK(done == sizeof(frame));
+  CHECK(frame[0] == pcm[10000] && frame[1] == pcm[10001]);
+  CHECK(decoder_seek(decoder, decoder.samples + 100) == decoder.samples);
+
+  decoder_close(decoder);
+  reader_close(reader);
+
+  return 0;
+}
+
+int test_decoder_flac() {
+  const auto pcm = make_pcm();
+  CHECK(write_flac(TEST_FLAC, pcm) == 0);
+
+  reader_t reader;
+  decoder_t decoder;
+  CHECK(reader_open(reader, TEST_FLAC) == 0);
+  CHECK(decoder_open(decoder, reader) == 0);
+  CHECK(decoder.type == DECODER_FLAC);
+  CHECK(decoder.rate == TEST_RATE);
+  CHECK(decoder.channels == TEST_CHANNELS);
+  CHECK(decoder.samples == (off_t) pcm.size() / TEST_CHANNELS);
+
+  // Lossless, whatever the block size
+  CHECK(decode(decoder, DECODER_BLOCK_SIZE) == pcm);
+  CHECK(decoder_seek(decoder, 0) == 0);
+  CHECK(decode(decoder, 100) == pcm);
+
+  // Seek into the middle of a frame
+  int16_t frame[TEST_CHANNELS];
+  size_t done = 0;
+  CHECK(decoder_seek(decoder, 5000) == 5000);
+  CHECK(decoder_read(decoder, (unsigned char *) frame, sizeof(frame), done) == DECODER_OK);
+  CHECK(done == sizeof(frame));
+  CHECK(frame[0] == pcm[10000] && frame[1] == pcm[10001]);
+
+  decoder_close(decoder);
+  reader_close(reader);
+
+  return 0;
+}
+
+int test_decoder_mpg123() {
+  decoder_init();
+
+  reader_t reader;
+  decoder_t decoder;
+  CHECK(reader_open(reader, TEST_SONG) == 0);
+  CHECK(decoder_open(decoder, reader) == 0);
+  CHECK(decoder.type == DECODER_MPG123);
+  CHECK(decoder.rate > 0);
+  CHECK(decoder.samples == 0);
+
+  // Length is exact once the file has been indexed
+  music_seek_entry_t built;
+  CHECK(decoder_index(decoder, nullptr, built) == 1);
+  CHECK(decoder.samples > 0);
+  CHECK(built.samples == decoder.samples);
+  CHECK(decoder_duration(decoder) == (float) decoder.samples / decoder.rate);
+
+  const auto pcm = decode(decoder, decoder_block_size(decoder));
+  CHECK((off_t) pcm.size() == decoder.samples * decoder.channels);
+
+  decoder_close(decoder);
+  reader_close(reader);
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  RUN_TEST(test_decoder_sniff);
+  RUN_TEST(test_decoder_wav);
+  RUN_TEST(test_decoder_flac);
+  RUN_TEST(test_decoder_mpg123);
+
+  return 0;
+}
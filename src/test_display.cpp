@@ -56,6 +56,35 @@ int test_menu_get() {
   return 0;
 }
 
+int test_menu_source() {
+  // Only the requested page is pulled from the source
+  size_t nb_calls = 0;
+  menu_t menu;
+  menu_init(menu, 50000, [&nb_calls](const size_t i) {
+    nb_calls++;
+    return std::to_string(i);
+  });
+  CHECK(menu.configured);
+  CHECK(menu.nb_entries == 50000);
+  CHECK(menu.entries.size() == 0);
+
+  auto retval = menu_get_page(menu, 49999);
+  CHECK(retval.size() == 8);
+  CHECK(retval[0] == "49992");
+  CHECK(retval[7] == "49999");
+  CHECK(nb_calls == 8);
+
+  retval = menu_get_page(menu, 13);
+  CHECK(retval.size() == 12);
+  CHECK(retval[0] == "12");
+  CHECK(nb_calls == 20);
+
+  menu_clear(menu);
+  CHECK(menu.nb_entries == 0);
+
+  return 0;
+}
+
 int test_display_init() {
   display_init();
   return 0;
@@ -95,7 +124,7 @@ int test_display_menu() {
 int test_display_song() {
   music_t music;
   music_load_library(music, TEST_MUSIC_LIBRARY);
-  song_t song = music.songs.at(0);
+  song_t song = music_get_song(music, 0);
 
   // Test pause
   {
@@ -121,6 +150,83 @@ int test_display_song() {
   return 0;
 }
 
+int test_display_partial_update() {
+  music_t music;
+  music_load_library(music, TEST_MUSIC_LIBRARY);
+  song_t song = music_get_song(music, 0);
+  const size_t frame_size = 128 * 128;
+
+  // The first frame pushes whatever is not black
+  display_t display;
+  display_song(display, PLAYER_PLAY, song, 0.0, 108.0);
+  CHECK(display.frame_bytes > 0);
+  CHECK(display.frame_bytes < frame_size);
+
+  // An identical frame pushes nothing
+  display_song(display, PLAYER_PLAY, song, 0.0, 108.0);
+  CHECK(display.frame_bytes == 0);
+
+  // The progress bar moving by a pixel pushes one column of the bar
+  display_song(display, PLAYER_PLAY, song, 1.0, 108.0);
+  CHECK(display.frame_bytes > 0);
+  CHECK(display.frame_bytes <= 11);
+
+  // Pausing only redraws the state icon
+  display_song(display, PLAYER_PAUSE, song, 1.0, 108.0);
+  CHECK(display.frame_bytes > 0);
+  CHECK(display.frame_bytes <= 15 * 15);
+
+  // Moving the menu selection by a row only redraws the two rows
+  menu_init(display.menu, {"Songs", "Artists", "Albums"});
+  display_menu(display, 0);
+  display_menu(display, 1);
+  printf("menu: %zu bytes ", display.frame_bytes);
+  CHECK(display.frame_bytes > 0);
+  CHECK(display.frame_bytes * 4 < frame_size);
+
+  return 0;
+}
+
+int test_display_marquee() {
+  display_t display;
+  song_t song;
+  song.title = "A song title much too long to fit on one line";
+  song.artist = "Artist";
+  song.album = "Album";
+
+  // A short title does not scroll
+  song_t short_song = song;
+  short_song.title = "Short";
+  display_song(display, PLAYER_PLAY, short_song, 0.0, 108.0);
+  CHECK(display.marquee.active == false);
+  CHECK(display_tick(display) == false);
+
+  // A long title holds still before it starts scrolling
+  display_song(display, PLAYER_PLAY, song, 0.0, 108.0);
+  CHECK(display.marquee.active);
+  CHECK(display_tick(display));
+  CHECK(display.frame_bytes == 0);
+
+  // Once scrolling, a tick only pushes the title line
+  usleep((DISPLAY_MARQUEE_DELAY + 0.5) * 1e6);
+  display_tick(display);
+  printf("tick: %zu bytes ", display.frame_bytes);
+  CHECK(display.frame_bytes > 0);
+  CHECK(display.frame_bytes <= (size_t) (display.width * DISPLAY_FONT_HEIGHT));
+
+  // Redrawing the same song keeps the marquee going
+  const struct timespec start = display.marquee.start;
+  display_song(display, PLAYER_PLAY, song, 1.0, 108.0);
+  CHECK(display.marquee.start.tv_sec == start.tv_sec);
+  CHECK(display.marquee.start.tv_nsec == start.tv_nsec);
+
+  // Leaving the screen stops it
+  display_clear(display);
+  CHECK(display_tick(display) == false);
+
+  return 0;
+}
+
 int test_display_show_menu() {
   display_t display;
   display_show_menu(display, 0);
@@ -135,14 +241,14 @@ int test_display_show_songs() {
   // Show beginning of all songs
   {
     display_t display;
-    display_show_songs(display, music.songs, 0);
+    display_show_songs(display, music_filter_songs(music), 0);
     sleep(2);
   }
 
   // Show end of all songs
   {
     display_t display;
-    display_show_songs(display, music.songs, 14);
+    display_show_songs(display, music_filter_songs(music), 14);
     sleep(2);
   }
 
@@ -154,7 +260,7 @@ int test_display_show_artists() {
   music_load_library(music, TEST_MUSIC_LIBRARY);
 
   display_t display;
-  display_show_artists(display, music.artists, 0);
+  display_show_artists(display, music_filter_artists(music), 0);
   sleep(2);
 
   return 0;
@@ -164,10 +270,7 @@ int test_display_show_albums() {
   music_t music;
   music_load_library(music, TEST_MUSIC_LIBRARY);
 
-  std::vector<std::string> album_names;
-  for (const auto &album : music.albums) {
-    album_names.emplace_back(album.first);
-  }
+  const auto album_names = music_filter_albums(music);
 
   display_t display;
   display_show_albums(display, album_names, 0);
@@ -230,10 +333,13 @@ int main(int argc, char **argv) {
   RUN_TEST(test_menu_init);
   RUN_TEST(test_menu_clear);
   RUN_TEST(test_menu_get);
+  RUN_TEST(test_menu_source);
 
   RUN_TEST(test_display_init);
   RUN_TEST(test_display_menu);
   RUN_TEST(test_display_song);
+  RUN_TEST(test_display_partial_update);
+  RUN_TEST(test_display_marquee);
   // RUN_TEST(test_display_show_menu);
   // RUN_TEST(test_display_show_songs);
   // RUN_TEST(test_display_show_artists);
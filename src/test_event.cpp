@@ -0,0 +1,182 @@
+#include "test.hpp"
+#include "event.hpp"
+
+#define TEST_GPIO_ROOT "/tmp/zp3_test_event_gpio"
+
+// Fake sysfs tree: export plus a directory per pin, value files start high
+static void make_sysfs(const std::vector<int> &pins) {
+  std::string cmd = "rm -rf " TEST_GPIO_ROOT " && mkdir -p " TEST_GPIO_ROOT;
+  cmd += " && touch " TEST_GPIO_ROOT "/export";
+  for (const auto pin : pins) {
+    const std::string dir = TEST_GPIO_ROOT "/gpio" + std::to_string(pin);
+    cmd += " && mkdir " + dir;
+    cmd += " && touch " + dir + "/direction " + dir + "/edge";
+    cmd += " && echo 1 > " + dir + "/value";
+  }
+  if (system(cmd.c_str()) != 0) {
+    LOG_ERROR("Failed to create fake sysfs tree!");
+  }
+}
+
+static std::string read_file(const std::string &path) {
+  char buf[32] = {0};
+  FILE *fp = fopen(path.c_str(), "r");
+  if (fp == NULL) {
+    return "";
+  }
+  const size_t len = fread(buf, 1, sizeof(buf) - 1, fp);
+  fclose(fp);
+  return std::string(buf, len);
+}
+
+// Set the value of a fake pin and, like the kernel, interrupt if the edge
+// the pin is armed with fired
+static void set_value(event_loop_t &loop, const int pin, const int value) {
+  const std::string dir = TEST_GPIO_ROOT "/gpio" + std::to_string(pin);
+  FILE *fp = fopen((dir + "/value").c_str(), "w");
+  fprintf(fp, "%d\n", value);
+  fclose(fp);
+
+  const std::string edge = read_file(dir + "/edge");
+  const bool fired = (edge == "both")
+                     || (edge == "falling" && value == LOW)
+                     || (edge == "rising" && value == HIGH);
+  for (const auto &line : loop.gpio.lines) {
+    if (line.pin == pin && fired) {
+      gpio_input_read(loop.gpio, line.fd, tic());
+    }
+  }
+}
+
+int test_event_loop_keys() {
+  int fds[2];
+  CHECK(pipe(fds) == 0);
+
+  event_loop_t loop;
+  CHECK(event_loop_init(loop, fds[0]) == 0);
+  CHECK(loop.raw == false);
+
+  // Nothing to read
+  event_t event;
+  CHECK(event_loop_wait(loop, event, 0) == 0);
+  CHECK(event.type == EVENT_NONE);
+
+  // Keys typed together come out one at a time, in order
+  CHECK(write(fds[1], "jkl", 3) == 3);
+  const char expected[3] = {'j', 'k', 'l'};
+  for (const auto key : expected) {
+    CHECK(event_loop_wait(loop, event, 100) == 0);
+    CHECK(event.type == EVENT_KEY);
+    CHECK(event.key == key);
+  }
+  CHECK(event_loop_wait(loop, event, 0) == 0);
+  CHECK(event.type == EVENT_NONE);
+
+  event_loop_close(loop);
+  close(fds[0]);
+  close(fds[1]);
+
+  return 0;
+}
+
+int test_event_loop_sources() {
+  int fds[2];
+  CHECK(pipe(fds) == 0);
+  const int player_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  CHECK(player_fd != -1);
+
+  event_loop_t loop;
+  CHECK(event_loop_init(loop, fds[0]) == 0);
+  CHECK(event_loop_add_fd(loop, player_fd, EVENT_PLAYER) == 0);
+
+  // Signals from another thread, several before a wait count as one
+  std::thread thread([player_fd]() {
+    const uint64_t value = 1;
+    CHECK(write(player_fd, &value, sizeof(value)) == sizeof(value));
+    CHECK(write(player_fd, &value, sizeof(value)) == sizeof(value));
+    return 0;
+  });
+  thread.join();
+
+  event_t event;
+  CHECK(event_loop_wait(loop, event, 100) == 0);
+  CHECK(event.type == EVENT_PLAYER);
+  CHECK(event_loop_wait(loop, event, 0) == 0);
+  CHECK(event.type == EVENT_NONE);
+
+  // Timer fires until it is stopped
+  CHECK(event_loop_set_timer(loop, 10) == 0);
+  struct timespec t = tic();
+  for (int i = 0; i < 5; i++) {
+    CHECK(event_loop_wait(loop, event, 100) == 0);
+    CHECK(event.type == EVENT_TIMER);
+  }
+  const float elapsed = toc(&t);
+  CHECK(elapsed > 0.04);
+  CHECK(elapsed < 0.2);
+
+  CHECK(event_loop_set_timer(loop, 0) == 0);
+  CHECK(event_loop_wait(loop, event, 50) == 0);
+  CHECK(event_loop_wait(loop, event, 50) == 0);
+  CHECK(event.type == EVENT_NONE);
+
+  event_loop_close(loop);
+  close(player_fd);
+  close(fds[0]);
+  close(fds[1]);
+
+  return 0;
+}
+
+int test_event_loop_buttons() {
+  make_sysfs({17});
+
+  int fds[2];
+  CHECK(pipe(fds) == 0);
+
+  event_loop_t loop;
+  CHECK(event_loop_init(loop, fds[0]) == 0);
+  gpio_input_init(loop.gpio, TEST_GPIO_ROOT, 10);
+
+  // Value files in the fake tree are regular files, which epoll refuses, so
+  // the button is armed and then dropped again
+  CHECK(event_loop_add_button(loop, 17, 'j') == -1);
+  CHECK(read_file(TEST_GPIO_ROOT "/gpio17/edge") == "both");
+  CHECK(loop.gpio.lines.size() == 0);
+  CHECK(loop.buttons.size() == 0);
+
+  // Register the pin the same way, minus epoll, and deliver its interrupts
+  CHECK(gpio_input_add(loop.gpio, 17, "both") != -1);
+  loop.buttons[17] = 'j';
+  usleep(20 * 1000);
+
+  // Press, release, press: two keys
+  int nb_keys = 0;
+  const int values[3] = {LOW, HIGH, LOW};
+  for (const auto value : values) {
+    set_value(loop, 17, value);
+
+    event_t event;
+    CHECK(event_loop_wait(loop, event, 0) == 0);
+    if (event.type == EVENT_KEY) {
+      CHECK(event.key == 'j');
+      nb_keys++;
+    }
+    usleep(20 * 1000);
+  }
+  CHECK(nb_keys == 2);
+
+  event_loop_close(loop);
+  close(fds[0]);
+  close(fds[1]);
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  RUN_TEST(test_event_loop_keys);
+  RUN_TEST(test_event_loop_sources);
+  RUN_TEST(test_event_loop_buttons);
+
+  return 0;
+}
@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "test.hpp"
+#include "gain.hpp"
+
+static std::vector<int16_t> random_samples(const size_t nb_samples) {
+  std::vector<int16_t> samples(nb_samples);
+  for (auto &sample : samples) {
+    sample = (rand() % 65536) - 32768;
+  }
+  // Full scale in both directions
+  samples[0] = INT16_MIN;
+  samples[1] = INT16_MAX;
+  return samples;
+}
+
+int test_gain_from_db() {
+  CHECK(gain_from_linear(1.0f) == GAIN_UNITY);
+  CHECK(gain_from_linear(0.5f) == GAIN_UNITY / 2);
+  CHECK(gain_from_linear(-1.0f) == 0);
+  CHECK(gain_from_linear(100.0f) == GAIN_MAX);
+  CHECK(gain_from_db(0.0f) == GAIN_UNITY);
+  CHECK(gain_from_db(-6.0206f) == GAIN_UNITY / 2);
+  CHECK(gain_from_db(6.0206f) == GAIN_UNITY * 2);
+
+  return 0;
+}
+
+int test_gain_unity() {
+  auto samples = random_samples(1001);
+  const auto original = samples;
+
+  // Untouched at unity
+  gain_t gain;
+  gain_apply(gain, samples.data(), samples.size(), GAIN_UNITY);
+  CHECK(samples == original);
+
+  // Halved, rounding to nearest
+  gain.current = GAIN_UNITY / 2;
+  gain_apply(gain, samples.data(), samples.size(), GAIN_UNITY / 2);
+  gain_apply(gain, samples.data(), samples.size(), GAIN_UNITY / 2);
+  CHECK(samples[0] == INT16_MIN / 4);
+  CHECK(samples[1] == 8192);
+
+  // Muted
+  gain.current = 0;
+  gain_apply(gain, samples.data(), samples.size(), 0);
+  for (const auto sample : samples) {
+    CHECK(sample == 0);
+  }
+
+  return 0;
+}
+
+int test_gain_ramp() {
+  // Constant input, the ramp is visible in the output
+  std::vector<int16_t> samples(800, 10000);
+  gain_t gain;
+  gain.current = 0;
+  gain_apply(gain, samples.data(), samples.size(), GAIN_UNITY);
+  CHECK(gain.current == GAIN_UNITY);
+
+  // Rises monotonically, each group of lanes shares a gain, and the last
+  // group is at the target
+  CHECK(samples.front() > 0);
+  CHECK(samples.front() < 1000);
+  CHECK(samples.back() == 10000);
+  for (size_t i = 1; i < samples.size(); i++) {
+    CHECK(samples[i] >= samples[i - 1]);
+    if (i % GAIN_LANES != 0) {
+      CHECK(samples[i] == samples[i - 1]);
+    }
+  }
+
+  return 0;
+}
+
+int test_gain_soft_clip() {
+  std::vector<int16_t> samples(32768);
+  for (size_t i = 0; i < samples.size(); i++) {
+    samples[i] = i;
+  }
+
+  // Quiet samples are amplified as they are, loud ones bend towards full
+  // scale without ever passing it
+  gain_t gain;
+  gain.current = 2 * GAIN_UNITY;
+  gain_apply(gain, samples.data(), samples.size(), 2 * GAIN_UNITY);
+  CHECK(samples[1000] == 2000);
+  CHECK(samples[GAIN_CLIP_KNEE / 2] == GAIN_CLIP_KNEE - 1);
+  for (size_t i = 1; i < samples.size(); i++) {
+    CHECK(samples[i] >= samples[i - 1]);
+  }
+  CHECK(samples[20000] < INT16_MAX);
+  CHECK(samples.back() == INT16_MAX);
+
+  // Negative samples mirror positive ones
+  std::vector<int16_t> pair = {20000, -20000};
+  gain.current = 2 * GAIN_UNITY;
+  gain_apply(gain, pair.data(), pair.size(), 2 * GAIN_UNITY);
+  CHECK(pair[0] == samples[20000]);
+  CHECK(pair[1] == -pair[0]);
+
+  // Without soft clipping loud samples are clamped
+  pair = {20000, -20000};
+  gain.soft_clip = false;
+  gain_apply(gain, pair.data(), pair.size(), 2 * GAIN_UNITY);
+  CHECK(pair[0] == INT16_MAX);
+  CHECK(pair[1] == INT16_MIN);
+
+  return 0;
+}
+
+int test_gain_simd() {
+  if (GAIN_BEST == GAIN_SCALAR) {
+    printf("no SIMD implementation ");
+    return 0;
+  }
+
+  // Ramps up and down, across unity and with odd lengths
+  const int16_t gains[6] = {GAIN_UNITY, 0, GAIN_UNITY / 3, 3 * GAIN_UNITY, GAIN_MAX, 1234};
+  const size_t sizes[4] = {4608, 1001, 7, 0};
+  for (const auto size : sizes) {
+    for (const auto from : gains) {
+      for (const auto to : gains) {
+        const auto samples = random_samples(size + 2);
+        auto scalar_out = samples;
+        auto simd_out = samples;
+
+        gain_t scalar;
+        scalar.impl = GAIN_SCALAR;
+        scalar.current = from;
+        gain_apply(scalar, scalar_out.data(), size, to);
+
+        gain_t simd;
+        simd.current = from;
+        gain_apply(simd, simd_out.data(), size, to);
+        CHECK(simd_out == scalar_out);
+      }
+    }
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  RUN_TEST(test_gain_from_db);
+  RUN_TEST(test_gain_unity);
+  RUN_TEST(test_gain_ramp);
+  RUN_TEST(test_gain_soft_clip);
+  RUN_TEST(test_gain_simd);
+
+  return 0;
+}
@@ -0,0 +1,120 @@
+#include "test.hpp"
+#include "util.hpp"
+#include "log.hpp"
+#include "gpio.hpp"
+
+#define TEST_GPIO_ROOT "/tmp/zp3_test_gpio"
+
+// Fake sysfs tree: export plus a directory per pin, value files start high
+static void make_sysfs(const std::vector<int> &pins) {
+  std::string cmd = "rm -rf " TEST_GPIO_ROOT " && mkdir -p " TEST_GPIO_ROOT;
+  cmd += " && touch " TEST_GPIO_ROOT "/export";
+  for (const auto pin : pins) {
+    const std::string dir = TEST_GPIO_ROOT "/gpio" + std::to_string(pin);
+    cmd += " && mkdir " + dir;
+    cmd += " && touch " + dir + "/direction " + dir + "/edge";
+    cmd += " && echo 1 > " + dir + "/value";
+  }
+  if (system(cmd.c_str()) != 0) {
+    LOG_ERROR("Failed to create fake sysfs tree!");
+  }
+}
+
+static std::string read_file(const std::string &path) {
+  char buf[32] = {0};
+  FILE *fp = fopen(path.c_str(), "r");
+  if (fp == NULL) {
+    return "";
+  }
+  const size_t len = fread(buf, 1, sizeof(buf) - 1, fp);
+  fclose(fp);
+  return std::string(buf, len);
+}
+
+static void set_value(const int pin, const int value) {
+  const std::string path = TEST_GPIO_ROOT "/gpio" + std::to_string(pin) + "/value";
+  FILE *fp = fopen(path.c_str(), "w");
+  fprintf(fp, "%d\n", value);
+  fclose(fp);
+}
+
+int test_gpio_input_add() {
+  make_sysfs({17, 27});
+
+  gpio_input_t input;
+  gpio_input_init(input, TEST_GPIO_ROOT);
+  CHECK(gpio_input_add(input, 17) != -1);
+  CHECK(gpio_input_add(input, 27, "falling") != -1);
+  CHECK(input.lines.size() == 2);
+  CHECK(input.lines[0].value == HIGH);
+
+  // Pins are configured as edge triggered inputs
+  CHECK(read_file(TEST_GPIO_ROOT "/gpio17/direction") == "in");
+  CHECK(read_file(TEST_GPIO_ROOT "/gpio17/edge") == "both");
+  CHECK(read_file(TEST_GPIO_ROOT "/gpio27/edge") == "falling");
+
+  // A pin that is not there is exported first, which fails here
+  CHECK(gpio_input_add(input, 5) == -1);
+  CHECK(read_file(TEST_GPIO_ROOT "/export") == "5");
+  CHECK(input.lines.size() == 2);
+
+  gpio_input_close(input);
+  CHECK(input.lines.size() == 0);
+
+  return 0;
+}
+
+int test_gpio_input_debounce() {
+  make_sysfs({17});
+
+  gpio_input_t input;
+  gpio_input_init(input, TEST_GPIO_ROOT, 20);
+  const int fd = gpio_input_add(input, 17);
+  CHECK(fd != -1);
+  usleep(30 * 1000);
+
+  // Press
+  gpio_event_t event;
+  set_value(17, LOW);
+  CHECK(gpio_input_read(input, fd, tic()) == 1);
+  CHECK(gpio_input_next(input, event));
+  CHECK(event.pin == 17);
+  CHECK(event.value == LOW);
+  CHECK(gpio_input_next(input, event) == false);
+
+  // Contact bounce straight after is ignored
+  set_value(17, HIGH);
+  CHECK(gpio_input_read(input, fd, tic()) == 0);
+  set_value(17, LOW);
+  CHECK(gpio_input_read(input, fd, tic()) == 0);
+  CHECK(gpio_input_timeout(input, tic()) == -1);
+
+  // A release inside the window is held back until it has passed
+  set_value(17, HIGH);
+  CHECK(gpio_input_read(input, fd, tic()) == 0);
+  const int timeout = gpio_input_timeout(input, tic());
+  CHECK(timeout >= 0);
+  CHECK(timeout <= 21);
+
+  struct timespec t = tic();
+  CHECK(gpio_input_poll(input, 1000) == 1);
+  const float elapsed = toc(&t);
+  CHECK(elapsed < 0.1);
+  CHECK(gpio_input_next(input, event));
+  CHECK(event.value == HIGH);
+
+  // Nothing changes, poll times out
+  CHECK(gpio_input_poll(input, 10) == 0);
+  CHECK(gpio_input_next(input, event) == false);
+
+  gpio_input_close(input);
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  RUN_TEST(test_gpio_input_add);
+  RUN_TEST(test_gpio_input_debounce);
+
+  return 0;
+}
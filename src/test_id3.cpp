@@ -0,0 +1,139 @@
+#include "test.hpp"
+#include "music.hpp"
+
+static void id3_frame(std::string &tag,
+                      const std::string &id,
+                      const std::string &body) {
+  const uint32_t size = body.size();
+  tag += id;
+  tag.push_back((size >> 24) & 0xff);
+  tag.push_back((size >> 16) & 0xff);
+  tag.push_back((size >> 8) & 0xff);
+  tag.push_back(size & 0xff);
+  tag += std::string(2, '\0');
+  tag += body;
+}
+
+static std::string id3v23_tag(const std::string &frames, const uint8_t flags) {
+  const uint32_t size = frames.size();
+  std::string tag = "ID3";
+  tag.push_back(3);
+  tag.push_back(0);
+  tag.push_back(flags);
+  tag.push_back((size >> 21) & 0x7f);
+  tag.push_back((size >> 14) & 0x7f);
+  tag.push_back((size >> 7) & 0x7f);
+  tag.push_back(size & 0x7f);
+  return tag + frames;
+}
+
+int test_id3v2_parse() {
+  // UTF-16 title with BOM, Latin-1 artist, UTF-8 album
+  std::string frames;
+  id3_frame(frames, "TIT2", std::string("\x01\xff\xfe" "A\0p\0p\0l\0e\0", 13));
+  id3_frame(frames, "TPE1", std::string("\x00" "Bob Dylan", 10));
+  id3_frame(frames, "TALB", std::string("\x03" "ALBUM1\0", 8));
+  id3_frame(frames, "TYER", std::string("\x00" "2018", 5));
+  id3_frame(frames, "TRCK", std::string("\x00" "3/12", 5));
+  frames += std::string(64, '\0');
+  const auto data = id3v23_tag(frames, 0);
+
+  id3_tag_t tag;
+  CHECK(id3v2_parse(tag, (const uint8_t *) data.data(), data.size()) == 0);
+  CHECK(tag.title == "Apple");
+  CHECK(tag.artist == "Bob Dylan");
+  CHECK(tag.album == "ALBUM1");
+  CHECK(tag.year == 2018);
+  CHECK(tag.track_number == 3);
+
+  return 0;
+}
+
+int test_id3v2_parse_unsupported() {
+  std::string frames;
+  id3_frame(frames, "TIT2", std::string("\x00" "Apple", 6));
+  id3_tag_t tag;
+
+  // Unsynchronised tag
+  auto data = id3v23_tag(frames, 0x80);
+  CHECK(id3v2_parse(tag, (const uint8_t *) data.data(), data.size()) == -1);
+
+  // Text outside of Latin-1
+  frames.clear();
+  id3_frame(frames, "TIT2", std::string("\x01\xff\xfe\x34\x12", 5));
+  data = id3v23_tag(frames, 0);
+  CHECK(id3v2_parse(tag, (const uint8_t *) data.data(), data.size()) == -1);
+
+  // Cover art before the album, cut off at the read size
+  frames.clear();
+  id3_frame(frames, "TIT2", std::string("\x00" "Apple", 6));
+  id3_frame(frames, "TPE1", std::string("\x00" "Bob Dylan", 10));
+  id3_frame(frames, "APIC", std::string(2 * ID3_READ_SIZE, 'x'));
+  id3_frame(frames, "TALB", std::string("\x00" "ALBUM1", 7));
+  data = id3v23_tag(frames, 0);
+  tag = id3_tag_t();
+  CHECK(id3v2_parse(tag, (const uint8_t *) data.data(), ID3_READ_SIZE) == -1);
+  CHECK(id3v2_parse(tag, (const uint8_t *) data.data(), data.size()) == 0);
+  CHECK(tag.album == "ALBUM1");
+
+  // Not an ID3v2 tag
+  data = "fLaC";
+  CHECK(id3v2_parse(tag, (const uint8_t *) data.data(), data.size()) == -1);
+
+  return 0;
+}
+
+int test_id3v1_parse() {
+  uint8_t data[ID3V1_SIZE] = {0};
+  memcpy(data, "TAG", 3);
+  memcpy(data + 3, "Apple", 5);
+  memcpy(data + 33, "Bob Dylan    ", 13);
+  memcpy(data + 63, "ALBUM1", 6);
+  memcpy(data + 93, "2018", 4);
+  data[126] = 7;
+
+  id3_tag_t tag;
+  tag.album = "Keep";
+  CHECK(id3v1_parse(tag, data, ID3V1_SIZE) == 0);
+  CHECK(tag.title == "Apple");
+  CHECK(tag.artist == "Bob Dylan");
+  CHECK(tag.album == "Keep");
+  CHECK(tag.year == 2018);
+  CHECK(tag.track_number == 7);
+
+  return 0;
+}
+
+int test_id3_read() {
+  // Fast reader must agree with TagLib on every song in the test library
+  std::vector<std::string> file_list;
+  walkdir(TEST_MUSIC_LIBRARY, file_list, "mp3");
+  CHECK(file_list.size() == 15);
+
+  for (const auto &file_path : file_list) {
+    id3_tag_t tag;
+    song_t song;
+    CHECK(id3_read(tag, file_path) == 0);
+    CHECK(song_parse_metadata_taglib(song, file_path) == 0);
+    CHECK(tag.title == song.title);
+    CHECK(tag.artist == song.artist);
+    CHECK(tag.album == song.album);
+    CHECK(tag.year == song.year);
+    CHECK(tag.track_number == song.track_number);
+  }
+
+  // Missing file
+  id3_tag_t tag;
+  CHECK(id3_read(tag, "not_a_song.mp3") == -1);
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  RUN_TEST(test_id3v2_parse);
+  RUN_TEST(test_id3v2_parse_unsupported);
+  RUN_TEST(test_id3v1_parse);
+  RUN_TEST(test_id3_read);
+
+  return 0;
+}
@@ -0,0 +1,282 @@
+#include <math.h>
+
+#include "test.hpp"
+#include "loudness.hpp"
+#include "scanner.hpp"
+
+#define TEST_INDEX "/tmp/zp3_test_loudness_index"
+#define TEST_RATE 48000
+
+// 1 kHz sine, `level` in dBFS peak, `seconds` long
+static std::vector<int16_t> make_sine(const float level,
+                                      const float seconds,
+                                      const int channels,
+                                      const long rate = TEST_RATE) {
+  const size_t nb_frames = seconds * rate;
+  const double amplitude = pow(10.0, level / 20.0) * 32767.0;
+  std::vector<int16_t> pcm(nb_frames * channels);
+  for (size_t i = 0; i < nb_frames; i++) {
+    const int16_t sample = lrint(amplitude * sin(2.0 * M_PI * 1000.0 * i / rate));
+    for (int c = 0; c < channels; c++) {
+      pcm[i * channels + c] = sample;
+    }
+  }
+  return pcm;
+}
+
+static double measure(const std::vector<int16_t> &pcm,
+                      const int channels,
+                      const long rate = TEST_RATE) {
+  loudness_meter_t meter;
+  loudness_meter_init(meter, rate, channels);
+  loudness_meter_add(meter, pcm.data(), pcm.size() / channels);
+  return loudness_integrated(meter.blocks);
+}
+
+static void put_le(std::string &buf, const uint32_t value, const int nb_bytes) {
+  for (int i = 0; i < nb_bytes; i++) {
+    buf += (char) ((value >> (8 * i)) & 0xff);
+  }
+}
+
+static void write_wav(const std::string &path, const std::vector<int16_t> &pcm) {
+  const uint32_t data_size = pcm.size() * 2;
+  std::string wav = "RIFF";
+  put_le(wav, 4 + 8 + 16 + 8 + data_size, 4);
+  wav += "WAVE";
+  wav += "fmt ";
+  put_le(wav, 16, 4);
+  put_le(wav, 1, 2);
+  put_le(wav, 2, 2);
+  put_le(wav, TEST_RATE, 4);
+  put_le(wav, TEST_RATE * 4, 4);
+  put_le(wav, 4, 2);
+  put_le(wav, 16, 2);
+  wav += "data";
+  put_le(wav, data_size, 4);
+  wav.append((const char *) pcm.data(), data_size);
+
+  FILE *fp = fopen(path.c_str(), "wb");
+  fwrite(wav.data(), 1, wav.size(), fp);
+  fclose(fp);
+}
+
+static void add_song(music_index_t &index,
+                     const std::string &path,
+                     const std::string &album,
+                     const float level) {
+  write_wav(path, make_sine(level, 3.0f, 2));
+  music_index_entry_t entry;
+  entry.valid = true;
+  entry.song.file_path = path;
+  entry.song.artist = "Artist";
+  entry.song.album = album;
+  index[path] = entry;
+}
+
+int test_loudness_sine() {
+  // EBU Tech 3341 case 1: a stereo sine at -23 dBFS reads -23 LUFS, at any
+  // of the usual rates
+  CHECK(fabs(measure(make_sine(-23.0f, 20.0f, 2), 2) + 23.0) < 0.1);
+  CHECK(fabs(measure(make_sine(-33.0f, 20.0f, 2), 2) + 33.0) < 0.1);
+  CHECK(fabs(measure(make_sine(-23.0f, 20.0f, 2, 44100), 2, 44100) + 23.0) < 0.1);
+
+  // Mono carries half the power
+  CHECK(fabs(measure(make_sine(-23.0f, 20.0f, 1), 1) + 26.01) < 0.1);
+
+  // Sample peak
+  loudness_meter_t meter;
+  loudness_meter_init(meter, TEST_RATE, 2);
+  const auto pcm = make_sine(-6.0f, 1.0f, 2);
+  loudness_meter_add(meter, pcm.data(), pcm.size() / 2);
+  CHECK(fabs(meter.peak - pow(10.0, -6.0 / 20.0)) < 0.001);
+
+  // Less than one block, or nothing above the absolute gate
+  CHECK(measure(make_sine(-23.0f, 0.3f, 2), 2) == LOUDNESS_ABSOLUTE_GATE);
+  CHECK(measure(std::vector<int16_t>(2 * TEST_RATE, 0), 2) == LOUDNESS_ABSOLUTE_GATE);
+  CHECK(loudness_meter_init(meter, 0, 2) == -1);
+  CHECK(loudness_meter_init(meter, TEST_RATE, 0) == -1);
+
+  return 0;
+}
+
+int test_loudness_gating() {
+  // Silence falls below the absolute gate
+  auto pcm = make_sine(-23.0f, 10.0f, 2);
+  pcm.resize(pcm.size() * 2, 0);
+  CHECK(fabs(measure(pcm, 2) + 23.0) < 0.1);
+
+  // Quiet passages fall below the relative gate
+  pcm = make_sine(-23.0f, 10.0f, 2);
+  const auto quiet = make_sine(-60.0f, 10.0f, 2);
+  pcm.insert(pcm.end(), quiet.begin(), quiet.end());
+  CHECK(fabs(measure(pcm, 2) + 23.0) < 0.1);
+
+  // Feeding samples in odd sized pieces makes no difference
+  loudness_meter_t meter;
+  loudness_meter_init(meter, TEST_RATE, 2);
+  for (size_t i = 0; i < pcm.size() / 2; i += 1001) {
+    const size_t nb_frames = std::min((size_t) 1001, pcm.size() / 2 - i);
+    loudness_meter_add(meter, pcm.data() + 2 * i, nb_frames);
+  }
+  CHECK(loudness_integrated(meter.blocks) == measure(pcm, 2));
+
+  return 0;
+}
+
+int test_loudness_scanner() {
+  decoder_init();
+
+  // Two albums of generated songs
+  music_index_t index;
+  add_song(index, "/tmp/zp3_test_loudness_1.wav", "Album A", -23.0f);
+  add_song(index, "/tmp/zp3_test_loudness_2.wav", "Album A", -33.0f);
+  add_song(index, "/tmp/zp3_test_loudness_3.wav", "Album B", -28.0f);
+  index["/tmp/zp3_test_loudness_invalid.wav"] = music_index_entry_t();
+  CHECK(music_index_save(index, TEST_INDEX) == 0);
+
+  // Stopped before it starts, nothing is written
+  music_scanner_t scanner;
+  scanner.index_path = TEST_INDEX;
+  scanner.nb_threads = 2;
+  scanner.io_rate = 0;
+  scanner.stopping = true;
+  CHECK(music_scanner_run(scanner) == 0);
+  CHECK(scanner.nb_albums == 2);
+  CHECK(scanner.nb_scanned == 0);
+  music_index_t loaded;
+  CHECK(music_index_load(loaded, TEST_INDEX) == 0);
+  CHECK(loaded.at("/tmp/zp3_test_loudness_1.wav").song.replaygain.analysed == false);
+
+  // Full scan, published to the running library as well
+  songs_t songs;
+  for (const auto &kv : index) {
+    if (kv.second.valid) {
+      songs.push_back(kv.second.song);
+    }
+  }
+  music_t music;
+  music_init(music, songs);
+  music_watcher_t library;
+  music_watcher_init(library, music);
+  scanner.library = &library;
+  scanner.stopping = false;
+  CHECK(music_scanner_run(scanner) == 0);
+  CHECK(scanner.nb_scanned == 2);
+  const auto published = music_watcher_library(library);
+  for (size_t i = 0; i < published->songs.size(); i++) {
+    CHECK(music_get_song(*published, i).replaygain.analysed);
+  }
+  CHECK(music_get_song(music, 0).replaygain.analysed == false);
+  scanner.library = nullptr;
+  CHECK(music_index_load(loaded, TEST_INDEX) == 0);
+  const auto rg1 = loaded.at("/tmp/zp3_test_loudness_1.wav").song.replaygain;
+  const auto rg2 = loaded.at("/tmp/zp3_test_loudness_2.wav").song.replaygain;
+  const auto rg3 = loaded.at("/tmp/zp3_test_loudness_3.wav").song.replaygain;
+  CHECK(rg1.analysed && rg2.analysed && rg3.analysed);
+  CHECK(fabs(rg1.track_gain - 5.0f) < 0.1f);
+  CHECK(fabs(rg2.track_gain - 15.0f) < 0.1f);
+  CHECK(fabs(rg3.track_gain - 10.0f) < 0.1f);
+  CHECK(fabs(rg1.track_peak - pow(10.0, -23.0 / 20.0)) < 0.001);
+
+  // Album gain is shared and sits between the songs' gains
+  CHECK(rg1.album_gain == rg2.album_gain);
+  CHECK(rg1.album_gain > rg1.track_gain && rg1.album_gain < rg2.track_gain);
+  CHECK(rg1.album_peak == rg1.track_peak);
+  CHECK(rg3.album_gain == rg3.track_gain);
+  CHECK(loaded.at("/tmp/zp3_test_loudness_invalid.wav").song.replaygain.analysed == false);
+
+  // Resuming only scans albums with songs left to analyse
+  loaded.at("/tmp/zp3_test_loudness_3.wav").song.replaygain = replaygain_t();
+  CHECK(music_index_save(loaded, TEST_INDEX) == 0);
+  CHECK(music_scanner_run(scanner) == 0);
+  CHECK(scanner.nb_albums == 1);
+  CHECK(scanner.nb_scanned == 1);
+  CHECK(music_index_load(loaded, TEST_INDEX) == 0);
+  CHECK(loaded.at("/tmp/zp3_test_loudness_3.wav").song.replaygain.analysed);
+  CHECK(music_scanner_run(scanner) == 0);
+  CHECK(scanner.nb_albums == 0);
+
+  // Throttled, a 5% duty cycle takes far longer than flat out
+  loudness_meter_t meter;
+  struct timespec t = tic();
+  CHECK(music_scan_song("/tmp/zp3_test_loudness_1.wav", meter) == 0);
+  const float fast = toc(&t);
+  t = tic();
+  CHECK(music_scan_song("/tmp/zp3_test_loudness_1.wav", meter, 0.05f) == 0);
+  CHECK(toc(&t) > 5.0f * fast);
+  CHECK(music_scan_song("/tmp/zp3_no_such_song.wav", meter) == -1);
+
+  // In the background
+  CHECK(music_scanner_start(scanner, TEST_INDEX) == 0);
+  music_scanner_stop(scanner);
+  CHECK(scanner.thread.joinable() == false);
+
+  for (const auto &kv : index) {
+    unlink(kv.first.c_str());
+  }
+  unlink(TEST_INDEX);
+
+  return 0;
+}
+
+int test_loudness_scanner_seek_index() {
+  decoder_init();
+
+  // An MPEG song that is already analysed, and a WAV that needs no index
+  music_index_t index;
+  music_index_entry_t entry;
+  entry.valid = true;
+  entry.song.file_path = TEST_SONG;
+  entry.song.replaygain.analysed = true;
+  index[TEST_SONG] = entry;
+  add_song(index, "/tmp/zp3_test_loudness_1.wav", "Album A", -23.0f);
+  index["/tmp/zp3_test_loudness_1.wav"].song.replaygain.analysed = true;
+  CHECK(music_index_save(index, TEST_INDEX) == 0);
+
+  const std::string seek_index_path = "/tmp/zp3_test_loudness_seek_index";
+  unlink(seek_index_path.c_str());
+  music_seek_store_t store;
+  music_seek_store_load(store, seek_index_path);
+
+  // Only the frame index is built, and saved
+  music_scanner_t scanner;
+  scanner.index_path = TEST_INDEX;
+  scanner.io_rate = 0;
+  scanner.seek_store = &store;
+  CHECK(music_scanner_run(scanner) == 0);
+  CHECK(scanner.nb_albums == 0);
+  music_seek_entry_t seek;
+  CHECK(music_seek_store_get(store, TEST_SONG, seek));
+  CHECK(seek.samples > 0);
+  CHECK(seek.offsets.size() > 0);
+  CHECK(music_seek_store_has(store, "/tmp/zp3_test_loudness_1.wav") == false);
+  music_seek_index_t saved;
+  CHECK(music_seek_index_load(saved, seek_index_path) == 0);
+  CHECK(saved.size() == 1);
+
+  // Opening the song with it gives the exact length without a scan
+  reader_t reader;
+  decoder_t decoder;
+  CHECK(reader_open(reader, TEST_SONG) == 0);
+  CHECK(decoder_open(decoder, reader) == 0);
+  CHECK(decoder_set_index(decoder, &seek) == 0);
+  CHECK(decoder.samples == seek.samples);
+  decoder_close(decoder);
+  reader_close(reader);
+
+  unlink("/tmp/zp3_test_loudness_1.wav");
+  unlink(seek_index_path.c_str());
+  unlink(TEST_INDEX);
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  RUN_TEST(test_loudness_sine);
+  RUN_TEST(test_loudness_gating);
+  RUN_TEST(test_loudness_scanner);
+  RUN_TEST(test_loudness_scanner_seek_index);
+
+  return 0;
+}
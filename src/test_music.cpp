@@ -1,5 +1,6 @@
 #include "test.hpp"
 #include "music.hpp"
+#include "watcher.hpp"
 
 int test_song_parse_metadata() {
   const auto song_path = TEST_MUSIC_LIBRARY "/album1/1-apple.mp3";
@@ -16,6 +17,28 @@ int test_song_parse_metadata() {
   return 0;
 }
 
+int test_songs_parse_metadata() {
+  std::vector<std::string> file_list;
+  walkdir(TEST_MUSIC_LIBRARY, file_list, "mp3");
+  file_list.push_back("not_a_song.mp3");
+
+  // Serial
+  std::vector<song_t> serial;
+  songs_parse_metadata(serial, file_list, 1);
+  CHECK(serial.size() == 15);
+
+  // Parallel results must be in the same order as serial
+  std::vector<song_t> parallel;
+  songs_parse_metadata(parallel, file_list, 4);
+  CHECK(parallel.size() == serial.size());
+  for (size_t i = 0; i < serial.size(); i++) {
+    CHECK(parallel[i].file_path == serial[i].file_path);
+    CHECK(parallel[i].title == serial[i].title);
+  }
+
+  return 0;
+}
+
 int test_music_load_library() {
   music_t music;
   music_load_library(music, TEST_MUSIC_LIBRARY);
@@ -27,6 +50,427 @@ int test_music_load_library() {
   return 0;
 }
 
+int test_music_index_save_load() {
+  // Create index
+  music_index_t index;
+  music_index_entry_t entry;
+  entry.mtime = 1234;
+  entry.size = 5678;
+  entry.valid = true;
+  song_parse_metadata(entry.song, TEST_MUSIC_LIBRARY "/album1/1-apple.mp3");
+  entry.song.replaygain.analysed = true;
+  entry.song.replaygain.track_gain = -3.5f;
+  entry.song.replaygain.album_peak = 0.75f;
+  index[entry.song.file_path] = entry;
+  index["invalid.mp3"] = music_index_entry_t();
+
+  // Save and load index
+  const std::string index_path = "/tmp/zp3_test_index";
+  CHECK(music_index_save(index, index_path) == 0);
+  music_index_t loaded;
+  CHECK(music_index_load(loaded, index_path) == 0);
+
+  CHECK(loaded.size() == 2);
+  const auto &song = loaded.at(entry.song.file_path).song;
+  CHECK(loaded.at(entry.song.file_path).mtime == 1234);
+  CHECK(loaded.at(entry.song.file_path).size == 5678);
+  CHECK(loaded.at(entry.song.file_path).valid);
+  CHECK(loaded.at("invalid.mp3").valid == false);
+  CHECK(song.title == "Apple");
+  CHECK(song.artist == "Bob Dylan");
+  CHECK(song.album == "ALBUM1");
+  CHECK(song.year == 2018);
+  CHECK(song.track_number == 1);
+  CHECK(song.replaygain.analysed);
+  CHECK(song.replaygain.track_gain == -3.5f);
+  CHECK(song.replaygain.album_peak == 0.75f);
+  CHECK(loaded.at("invalid.mp3").song.replaygain.analysed == false);
+
+  // Loading garbage should fail
+  FILE *fp = fopen(index_path.c_str(), "wb");
+  fprintf(fp, "garbage");
+  fclose(fp);
+  CHECK(music_index_load(loaded, index_path) == -1);
+  CHECK(loaded.size() == 0);
+  unlink(index_path.c_str());
+
+  return 0;
+}
+
+int test_music_seek_index() {
+  // Index a copy of a song so its mtime can be changed
+  const std::string song_path = "/tmp/zp3_test_seek.mp3";
+  const std::string index_path = "/tmp/zp3_test_seek_index";
+  std::string cmd = "cp " TEST_SONG " " + song_path;
+  CHECK(system(cmd.c_str()) == 0);
+
+  music_seek_index_t index;
+  music_seek_entry_t entry;
+  entry.rate = 44100;
+  entry.samples = 1234567;
+  entry.step = 16;
+  entry.offsets = {0, 4176, 8352, 12528};
+  CHECK(music_seek_index_put(index, song_path, entry) == 0);
+  CHECK(music_seek_index_put(index, "/tmp/zp3_no_such_song.mp3", entry) == -1);
+
+  // Save and load
+  CHECK(music_seek_index_save(index, index_path) == 0);
+  music_seek_index_t loaded;
+  CHECK(music_seek_index_load(loaded, index_path) == 0);
+  CHECK(loaded.size() == 1);
+  const auto found = music_seek_index_get(loaded, song_path);
+  CHECK(found != nullptr);
+  CHECK(found->rate == 44100);
+  CHECK(found->samples == 1234567);
+  CHECK(found->step == 16);
+  CHECK(found->offsets == entry.offsets);
+  CHECK(music_seek_index_get(loaded, TEST_SONG) == nullptr);
+
+  // A modified file is not trusted
+  cmd = "echo >> " + song_path;
+  CHECK(system(cmd.c_str()) == 0);
+  CHECK(music_seek_index_get(loaded, song_path) == nullptr);
+
+  // Loading garbage should fail
+  FILE *fp = fopen(index_path.c_str(), "wb");
+  fprintf(fp, "garbage");
+  fclose(fp);
+  CHECK(music_seek_index_load(loaded, index_path) == -1);
+  CHECK(loaded.size() == 0);
+  unlink(index_path.c_str());
+  unlink(song_path.c_str());
+
+  return 0;
+}
+
+int test_music_load_library_index() {
+  const std::string index_path = "/tmp/zp3_test_library_index";
+  unlink(index_path.c_str());
+
+  // Cold start creates the index
+  music_t music;
+  CHECK(music_load_library(music, TEST_MUSIC_LIBRARY, index_path) == 0);
+  music_index_t index;
+  CHECK(music_index_load(index, index_path) == 0);
+  CHECK(index.size() == 15);
+
+  // Warm start loads from the index
+  music_t cached;
+  CHECK(music_load_library(cached, TEST_MUSIC_LIBRARY, index_path) == 0);
+  CHECK(cached.artists.size() == 2);
+  CHECK(cached.albums.size() == 3);
+  CHECK(cached.songs.size() == 15);
+  for (size_t i = 0; i < music.songs.size(); i++) {
+    const auto expected = music_get_song(music, i);
+    const auto song = music_get_song(cached, i);
+    CHECK(song.file_path == expected.file_path);
+    CHECK(song.title == expected.title);
+    CHECK(song.track_number == expected.track_number);
+  }
+  unlink(index_path.c_str());
+
+  return 0;
+}
+
+int test_music_add_remove_song() {
+  music_t music;
+  music_load_library(music, TEST_MUSIC_LIBRARY);
+  const song_t song = music_get_song(music, 3);
+  const int album_idx = music_find_album(music, song.artist, song.album);
+  CHECK(album_idx != -1);
+
+  // Remove song
+  CHECK(music_remove_song(music, song) == 0);
+  CHECK(music_remove_song(music, song) == -1);
+  CHECK(music.songs.size() == 14);
+  const auto &range = music.albums.at(album_idx).songs;
+  CHECK(range.end - range.begin == 4);
+
+  // Add it back, it should end up where it was
+  CHECK(music_add_song(music, song) == 0);
+  CHECK(music.songs.size() == 15);
+  CHECK(music_song_path(music, 3) == song.file_path);
+  CHECK(music.albums.at(album_idx).songs.end - music.albums.at(album_idx).songs.begin == 5);
+
+  // Removing every song of an album removes the album and its artist
+  const auto album = music_filter_songs(music, "Bob Dylan", "ALBUM1");
+  songs_t songs;
+  for (size_t i = 0; i < album.size; i++) {
+    songs.push_back(songs_view_get(album, i));
+  }
+  for (const auto &s : songs) {
+    CHECK(music_remove_song(music, s) == 0);
+  }
+  CHECK(music_find_album(music, "Bob Dylan", "ALBUM1") == -1);
+  CHECK(music_find_artist(music, "Bob Dylan") == -1);
+  CHECK(music.artists.size() == 1);
+  CHECK(music.albums.size() == 2);
+  CHECK(music.songs.size() == 10);
+
+  return 0;
+}
+
+int test_music_song_table() {
+  music_t music;
+  music_load_library(music, TEST_MUSIC_LIBRARY);
+
+  // Artists and albums are interned
+  CHECK(music.strings.size == 2 + 3 + 3);
+  CHECK(string_pool_intern(music.strings, "Bob Dylan") == music.artists[0].name);
+
+  // Rows are sorted and round trip through song_t
+  for (size_t i = 0; i < music.songs.size(); i++) {
+    const auto song = music_get_song(music, i);
+    song_t expected;
+    CHECK(song_parse_metadata(expected, song.file_path) == 0);
+    CHECK(song.file_path == expected.file_path);
+    CHECK(song.title == expected.title);
+    CHECK(song.artist == expected.artist);
+    CHECK(song.album == expected.album);
+    CHECK(song.year == expected.year);
+    CHECK(song.track_number == expected.track_number);
+    if (i > 0) {
+      CHECK(song_comparator(music_get_song(music, i - 1), song));
+    }
+  }
+
+  // Artist and album ranges cover the table
+  const auto &bob = music.artists[music_find_artist(music, "Bob Dylan")];
+  const auto &michael = music.artists[music_find_artist(music, "Michael Jackson")];
+  CHECK(bob.songs.begin == 0 && bob.songs.end == 5);
+  CHECK(bob.albums.end - bob.albums.begin == 1);
+  CHECK(michael.songs.begin == 5 && michael.songs.end == 15);
+  CHECK(michael.albums.end - michael.albums.begin == 2);
+
+  return 0;
+}
+
+// Artists, albums and the album name index match a library built from scratch
+static bool check_ranges(const music_t &music) {
+  songs_t songs;
+  for (size_t i = 0; i < music.songs.size(); i++) {
+    songs.push_back(music_get_song(music, i));
+  }
+  music_t expected;
+  music_init(expected, songs);
+
+  if (music.artists.size() != expected.artists.size()
+      || music.albums.size() != expected.albums.size()
+      || music.albums_by_name != expected.albums_by_name) {
+    return false;
+  }
+  for (size_t i = 0; i < music.artists.size(); i++) {
+    const auto &a = music.artists[i];
+    const auto &b = expected.artists[i];
+    if (string_pool_get(music.strings, a.name) != string_pool_get(expected.strings, b.name)
+        || a.songs.begin != b.songs.begin || a.songs.end != b.songs.end
+        || a.albums.begin != b.albums.begin || a.albums.end != b.albums.end) {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < music.albums.size(); i++) {
+    const auto &a = music.albums[i];
+    const auto &b = expected.albums[i];
+    if (string_pool_get(music.strings, a.name) != string_pool_get(expected.strings, b.name)
+        || a.songs.begin != b.songs.begin || a.songs.end != b.songs.end) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+int test_music_update() {
+  music_t music;
+  music_load_library(music, TEST_MUSIC_LIBRARY);
+  const song_t song3 = music_get_song(music, 3);
+  const song_t song7 = music_get_song(music, 7);
+
+  // Remove two songs, re-add one of them under another path, paths that are
+  // not in the library are ignored
+  song_t moved = song3;
+  moved.file_path = TEST_MUSIC_LIBRARY "/moved/4-dates.mp3";
+  const std::set<std::string> removed = {song3.file_path,
+                                         song7.file_path,
+                                         "/no/such/dir/song.mp3",
+                                         TEST_MUSIC_LIBRARY "/album1/no_such_song.mp3"};
+  CHECK(music_update(music, removed, {moved}) == 3);
+  CHECK(music.songs.size() == 14);
+  CHECK(music_song_path(music, 3) == moved.file_path);
+  CHECK(music_remove_song(music, song7) == -1);
+  const auto &album = music.albums.at(music_find_album(music, song7.artist, song7.album));
+  CHECK(album.songs.end - album.songs.begin == 4);
+  CHECK(music_update(music, {song7.file_path}, {}) == 0);
+  CHECK(check_ranges(music));
+
+  return 0;
+}
+
+int test_music_copy_on_write() {
+  // A library large enough to span many chunks
+  songs_t songs;
+  for (int i = 0; i < 20 * SONG_TABLE_CHUNK; i++) {
+    song_t song;
+    song.file_path = "/music/" + std::to_string(i / 100) + "/" + std::to_string(i) + ".mp3";
+    song.title = "Song " + std::to_string(i);
+    song.artist = "Artist " + std::to_string(i / 1000);
+    song.album = "Album " + std::to_string(i / 100);
+    song.track_number = i % 100;
+    songs.push_back(song);
+  }
+  music_t music;
+  music_init(music, songs);
+  CHECK(music.songs.size() == songs.size());
+  CHECK(music.songs.chunks.size() > 1);
+  for (size_t i = 0; i < songs.size(); i += 97) {
+    CHECK(music_song_path(music, i) == songs[i].file_path);
+  }
+
+  // A copy shares everything until it is modified
+  music_t copy = music;
+  song_t song = songs[1234];
+  song.file_path = "/music/12/new.mp3";
+  song.title = "New";
+  song.album = "New Album";
+  CHECK(music_add_song(copy, song) == 0);
+  CHECK(music_remove_song(copy, songs[10]) == 0);
+  CHECK(copy.songs.size() == music.songs.size());
+
+  size_t nb_shared = 0;
+  for (const auto &chunk : copy.songs.chunks) {
+    for (const auto &original : music.songs.chunks) {
+      nb_shared += (chunk == original);
+    }
+  }
+  CHECK(nb_shared == copy.songs.chunks.size() - 2);
+
+  size_t nb_shared_paths = 0;
+  for (size_t i = 0; i < SONG_PATHS_SHARDS; i++) {
+    nb_shared_paths += (copy.paths[i] == music.paths[i]);
+  }
+  CHECK(nb_shared_paths >= SONG_PATHS_SHARDS - 2);
+
+  // The original is unchanged
+  CHECK(music.songs.size() == songs.size());
+  CHECK(music.strings.size + 1 == copy.strings.size);
+  CHECK(music_find_album(music, "Artist 1", "New Album") == -1);
+  CHECK(music_find_album(copy, "Artist 1", "New Album") != -1);
+  CHECK(check_ranges(copy));
+  for (size_t i = 0; i < songs.size(); i++) {
+    CHECK(music_song_path(music, i) == songs[i].file_path);
+  }
+
+  // Chunks split as they grow and go away once empty
+  for (int i = 0; i < 2 * SONG_TABLE_CHUNK; i++) {
+    song.file_path = "/music/12/new" + std::to_string(i) + ".mp3";
+    CHECK(music_add_song(copy, song) == 0);
+  }
+  for (const auto &chunk : copy.songs.chunks) {
+    CHECK(chunk->size() < 2 * SONG_TABLE_CHUNK);
+  }
+  for (int i = 0; i < 1000; i++) {
+    CHECK(music_remove_song(copy, songs[i]) == ((i == 10) ? -1 : 0));
+  }
+  CHECK(music_find_artist(copy, "Artist 0") == -1);
+  CHECK(check_ranges(copy));
+  for (int i = 1100; i < 1200; i++) {
+    CHECK(music_remove_song(copy, songs[i]) == 0);
+  }
+  CHECK(music_find_album(copy, songs[1100].artist, songs[1100].album) == -1);
+  CHECK(check_ranges(copy));
+  CHECK(copy.songs.starts[0] == 0);
+  for (size_t i = 1; i < copy.songs.chunks.size(); i++) {
+    CHECK(copy.songs.starts[i] == copy.songs.starts[i - 1] + copy.songs.chunks[i - 1]->size());
+  }
+
+  return 0;
+}
+
+int test_music_find() {
+  music_t music;
+  music_load_library(music, TEST_MUSIC_LIBRARY);
+
+  // Artists
+  CHECK(music_find_artist(music, "Bob Dylan") == 0);
+  CHECK(music_find_artist(music, "Michael Jackson") == 1);
+  CHECK(music_find_artist(music, "") == -1);
+  CHECK(music_find_artist(music, "Bob") == -1);
+  CHECK(music_find_artist(music, "Zappa") == -1);
+
+  // Albums of an artist
+  const int album_idx = music_find_album(music, "Michael Jackson", "ALBUM3");
+  CHECK(album_idx == 2);
+  CHECK(music_find_album(music, "Bob Dylan", "ALBUM3") == -1);
+  CHECK(music_find_album(music, "Nobody", "ALBUM3") == -1);
+
+  // Albums by name across artists
+  const auto albums = music_find_albums(music, "ALBUM3");
+  CHECK(albums.size() == 1);
+  CHECK((int) albums.at(0) == album_idx);
+  CHECK(music_find_albums(music, "ALBUM").size() == 0);
+  CHECK(music.albums_by_name.size() == music.albums.size());
+
+  return 0;
+}
+
+static bool wait_for_songs(const music_watcher_t &watcher, const size_t nb_songs) {
+  for (int i = 0; i < 50; i++) {
+    if (music_watcher_library(watcher)->songs.size() == nb_songs) {
+      return true;
+    }
+    usleep(100 * 1000);
+  }
+  return false;
+}
+
+int test_music_watcher() {
+  const std::string path = "/tmp/zp3_test_watcher";
+  std::string cmd = "rm -rf " + path + " && mkdir -p " + path;
+  cmd += " && cp -r " TEST_MUSIC_LIBRARY "/album1 " + path;
+  CHECK(system(cmd.c_str()) == 0);
+
+  music_t music;
+  music_load_library(music, path);
+  music_watcher_t watcher;
+  music_watcher_init(watcher, music);
+  CHECK(music_watcher_start(watcher, path) == 0);
+  const auto before = music_watcher_library(watcher);
+  CHECK(before->songs.size() == 5);
+
+  // Copy a whole album in
+  cmd = "cp -r " TEST_MUSIC_LIBRARY "/album2 " + path;
+  CHECK(system(cmd.c_str()) == 0);
+  CHECK(wait_for_songs(watcher, 10));
+  CHECK(music_watcher_library(watcher)->albums.size() == 2);
+  CHECK(music_watcher_library(watcher)->artists.size() == 2);
+
+  // Old snapshots are unaffected
+  CHECK(before->songs.size() == 5);
+
+  // Delete a song
+  cmd = "rm " + path + "/album2/1-alpha.mp3";
+  CHECK(system(cmd.c_str()) == 0);
+  CHECK(wait_for_songs(watcher, 9));
+
+  // Move a song out of the library
+  cmd = "mv " + path + "/album1/1-apple.mp3 /tmp/zp3_test_watcher_apple.mp3";
+  CHECK(system(cmd.c_str()) == 0);
+  CHECK(wait_for_songs(watcher, 8));
+
+  // Delete a whole album
+  cmd = "rm -r " + path + "/album2";
+  CHECK(system(cmd.c_str()) == 0);
+  CHECK(wait_for_songs(watcher, 4));
+  CHECK(music_watcher_library(watcher)->albums.size() == 1);
+  CHECK(music_watcher_library(watcher)->artists.size() == 1);
+
+  music_watcher_stop(watcher);
+  cmd = "rm -rf " + path + " /tmp/zp3_test_watcher_apple.mp3";
+  CHECK(system(cmd.c_str()) == 0);
+
+  return 0;
+}
+
 int test_music_filter_songs() {
   music_t music;
   music_load_library(music, TEST_MUSIC_LIBRARY);
@@ -35,7 +479,9 @@ int test_music_filter_songs() {
   {
     const auto target_artist = "Bob Dylan";
     const auto songs = music_filter_songs(music, target_artist);
-    for (const auto &song : songs) {
+    CHECK(songs.size == 5);
+    for (size_t i = 0; i < songs.size; i++) {
+      const auto song = songs_view_get(songs, i);
       CHECK(song.artist == "Bob Dylan");
     }
   }
@@ -45,12 +491,36 @@ int test_music_filter_songs() {
     const auto target_artist = "Michael Jackson";
     const auto target_album = "ALBUM3";
     const auto songs = music_filter_songs(music, target_artist, target_album);
-    for (const auto &song : songs) {
+    CHECK(songs.size == 5);
+    for (size_t i = 0; i < songs.size; i++) {
+      const auto song = songs_view_get(songs, i);
       CHECK(song.artist == "Michael Jackson");
       CHECK(song.album == "ALBUM3");
     }
   }
 
+  // Album filter only
+  {
+    const auto songs = music_filter_songs(music, "", "ALBUM2");
+    CHECK(songs.size == 5);
+    CHECK(std::string(songs_view_title(songs, 0)) == "Alpha");
+    CHECK(std::string(songs_view_title(songs, 4)) == "Foxtrot");
+  }
+
+  // No filter, view refers to the library rather than copying it
+  {
+    const auto songs = music_filter_songs(music);
+    CHECK(songs.music == &music);
+    CHECK(songs.size == 15);
+    CHECK(songs.ranges.size() == 1);
+  }
+
+  // No match
+  {
+    const auto songs = music_filter_songs(music, "Nobody");
+    CHECK(songs.size == 0);
+  }
+
   return 0;
 }
 
@@ -74,7 +544,17 @@ int test_music_filter_albums() {
 
 int main(int argc, char **argv) {
   RUN_TEST(test_song_parse_metadata);
+  RUN_TEST(test_songs_parse_metadata);
   RUN_TEST(test_music_load_library);
+  RUN_TEST(test_music_index_save_load);
+  RUN_TEST(test_music_seek_index);
+  RUN_TEST(test_music_load_library_index);
+  RUN_TEST(test_music_song_table);
+  RUN_TEST(test_music_find);
+  RUN_TEST(test_music_add_remove_song);
+  RUN_TEST(test_music_update);
+  RUN_TEST(test_music_copy_on_write);
+  RUN_TEST(test_music_watcher);
   RUN_TEST(test_music_filter_songs);
   RUN_TEST(test_music_filter_albums);
 
@@ -6,15 +6,22 @@ int test_player_init() {
   return 0;
 }
 
+static void load_test_song(music_t &music) {
+  songs_t songs(1);
+  song_parse_metadata(songs[0], TEST_SONG);
+  music_init(music, songs);
+}
+
 int test_player_thread() {
   // Load a song
-  song_t song;
-  song_parse_metadata(song, TEST_SONG);
+  music_t music;
+  load_test_song(music);
 
   // Prepare player
   player_t player;
   player.volume = 0.0;
-  player.song_queue.push_back(song);
+  player.song_queue = music_filter_songs(music);
+  player.player_state = PLAYER_PLAY;
 
   // Execute player thread
   std::thread thread{player_thread, &player};
@@ -23,17 +30,180 @@ int test_player_thread() {
   return 0;
 }
 
+/**
+ * Number of consecutive silent frames in `pcm` starting at frame `start` and
+ * walking forwards or backwards.
+ */
+static size_t count_silence(const std::vector<unsigned char> &pcm,
+                            const size_t frame_size,
+                            const size_t start,
+                            const bool forwards) {
+  const size_t nb_frames = pcm.size() / frame_size;
+  size_t count = 0;
+  for (size_t i = start; i < nb_frames; i += (forwards) ? 1 : -1) {
+    const unsigned char *frame = pcm.data() + i * frame_size;
+    for (size_t j = 0; j < frame_size; j++) {
+      if (frame[j] != 0) {
+        return count;
+      }
+    }
+    count++;
+  }
+
+  return count;
+}
+
+int test_player_gapless() {
+  // Play the test song on its own
+  music_t single;
+  load_test_song(single);
+  player_t reference;
+  reference.volume = 1.0;
+  reference.output.capture = true;
+  reference.song_queue = music_filter_songs(single);
+  reference.player_state = PLAYER_PLAY;
+  player_thread(&reference);
+  const auto &track = reference.output.captured;
+  const size_t frame_size = reference.output.format.channels
+                            * reference.output.format.bits / 8;
+  const size_t nb_frames = track.size() / frame_size;
+  CHECK(nb_frames > 0);
+
+  // Play it twice back to back
+  music_t music;
+  songs_t songs(2);
+  song_parse_metadata(songs[0], TEST_SONG);
+  song_parse_metadata(songs[1], TEST_SONG);
+  songs[1].track_number = songs[0].track_number + 1;
+  music_init(music, songs);
+  player_t player;
+  player.volume = 1.0;
+  player.output.capture = true;
+  player.song_queue = music_filter_songs(music);
+  player.player_state = PLAYER_PLAY;
+  player_thread(&player);
+  const auto &pcm = player.output.captured;
+
+  // The device is opened once and nothing is inserted between the tracks
+  CHECK(player.output.nb_opens == 1);
+  CHECK(pcm.size() == 2 * track.size());
+  CHECK(memcmp(pcm.data(), track.data(), track.size()) == 0);
+  CHECK(memcmp(pcm.data() + track.size(), track.data(), track.size()) == 0);
+
+  // Silence at the join that is not part of the track itself
+  const size_t track_silence = count_silence(track, frame_size, nb_frames - 1, false)
+                               + count_silence(track, frame_size, 0, true);
+  const size_t join_silence = count_silence(pcm, frame_size, nb_frames - 1, false)
+                              + count_silence(pcm, frame_size, nb_frames, true);
+  const float gap_ms = (join_silence - track_silence) * 1000.0
+                       / player.output.format.rate;
+  printf("gap: %.2f ms ", gap_ms);
+  CHECK(join_silence == track_silence);
+
+  return 0;
+}
+
+/**
+ * Write a 16-bit stereo WAV of `nb_frames` frames holding `left` and `right`.
+ */
+static void write_wav(const std::string &path,
+                      const long rate,
+                      const size_t nb_frames,
+                      const int16_t left,
+                      const int16_t right) {
+  std::vector<int16_t> pcm(2 * nb_frames);
+  for (size_t i = 0; i < nb_frames; i++) {
+    pcm[2 * i] = left;
+    pcm[2 * i + 1] = right;
+  }
+
+  const uint32_t data_size = pcm.size() * 2;
+  const uint32_t header[11] = {0x46464952, 36 + data_size, 0x45564157,
+                               0x20746d66, 16, 0x00020001, (uint32_t) rate,
+                               (uint32_t) rate * 4, 0x00100004, 0x61746164,
+                               data_size};
+  FILE *fp = fopen(path.c_str(), "wb");
+  fwrite(header, 1, sizeof(header), fp);
+  fwrite(pcm.data(), 1, data_size, fp);
+  fclose(fp);
+}
+
+int test_player_crossfade() {
+  // Two tracks, one on each channel so the mix can be told apart
+  const long rate = 44100;
+  const size_t nb_frames = 2 * rate;
+  write_wav("/tmp/zp3_test_fade_1.wav", rate, nb_frames, 8000, 0);
+  write_wav("/tmp/zp3_test_fade_2.wav", rate, nb_frames, 0, 8000);
+  songs_t songs(2);
+  songs[0].file_path = "/tmp/zp3_test_fade_1.wav";
+  songs[0].track_number = 1;
+  songs[1].file_path = "/tmp/zp3_test_fade_2.wav";
+  songs[1].track_number = 2;
+  music_t music;
+  music_init(music, songs);
+
+  // Render the transition offline
+  player_t player;
+  player.volume = 1.0;
+  player.output.capture = true;
+  player.song_queue = music_filter_songs(music);
+  player.player_state = PLAYER_PLAY;
+  player_set_crossfade(player, 0.5f);
+  player_thread(&player);
+  const int16_t *pcm = (const int16_t *) player.output.captured.data();
+  const size_t nb_played = player.output.captured.size() / 4;
+
+  // The tracks overlap by exactly the crossfade
+  const size_t fade = 0.5f * rate;
+  CHECK(player.output.nb_opens == 1);
+  CHECK(nb_played == 2 * nb_frames - fade);
+  size_t overlap = 0;
+  for (size_t i = 0; i < nb_played; i++) {
+    const int16_t left = pcm[2 * i];
+    const int16_t right = pcm[2 * i + 1];
+    const bool first = (left == 8000 && right == 0);
+    const bool second = (left == 0 && right == 8000);
+    if (first || second) {
+      CHECK(first == (i < nb_frames - fade));
+      continue;
+    }
+    overlap++;
+
+    // Equal power, one fades out as the other fades in
+    const float power = (float) left * left + (float) right * right;
+    CHECK(fabs(power / (8000.0f * 8000.0f) - 1.0f) < 0.01f);
+    CHECK(left <= pcm[2 * (i - 1)]);
+    CHECK(right >= pcm[2 * (i - 1) + 1]);
+  }
+  CHECK(overlap == fade);
+
+  // Half way through both are 3 dB down
+  const size_t middle = nb_frames - fade / 2;
+  CHECK(abs(pcm[2 * middle] - 5657) < 10);
+  CHECK(abs(pcm[2 * middle + 1] - 5657) < 10);
+
+  // Limited to 10 s
+  player_set_crossfade(player, 60.0f);
+  CHECK(player.crossfade == PLAYER_CROSSFADE_MAX);
+  player_set_crossfade(player, -1.0f);
+  CHECK(player.crossfade == 0.0f);
+  unlink("/tmp/zp3_test_fade_1.wav");
+  unlink("/tmp/zp3_test_fade_2.wav");
+
+  return 0;
+}
+
 int test_player_play() {
   // Load a song
-  song_t song;
-  song_parse_metadata(song, TEST_SONG);
+  music_t music;
+  load_test_song(music);
 
   // Prepare player
   display_t display;
   player_t player;
   player.volume = 0.0;
   player.display = &display;
-  player.song_queue.push_back(song);
+  player.song_queue = music_filter_songs(music);
 
   // Play
   player_play(player);
@@ -65,6 +235,179 @@ int test_player_toggle_pause_play() {
   return 0;
 }
 
+int test_player_pause() {
+  // Load a song
+  music_t music;
+  load_test_song(music);
+
+  // Start playing then pause
+  player_t player;
+  player.volume = 0.0;
+  player.song_queue = music_filter_songs(music);
+  player_play(player);
+  usleep(200 * 1000);
+  player_toggle_pause_play(player);
+  const int paused_state = player.player_state;
+  usleep(100 * 1000);
+
+  // A paused player should neither advance nor use any CPU
+  const float song_time = player.song_time;
+  struct timespec start;
+  struct timespec end;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
+  sleep(3);
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end);
+  const float cpu_ms = (end.tv_sec - start.tv_sec) * 1e3
+                       + (end.tv_nsec - start.tv_nsec) * 1e-6;
+  const float paused_time = player.song_time;
+
+  // Resume and stop
+  player_toggle_pause_play(player);
+  const int resumed_state = player.player_state;
+  player_stop(player);
+
+  printf("paused cpu: %.2f ms ", cpu_ms);
+  CHECK(paused_state == PLAYER_PAUSE);
+  CHECK(cpu_ms < 30.0);
+  CHECK(paused_time == song_time);
+  CHECK(resumed_state == PLAYER_PLAY);
+  CHECK(player.player_is_dead);
+
+  return 0;
+}
+
+int test_player_seek_next() {
+  // Queue the test song twice
+  music_t music;
+  songs_t songs(2);
+  song_parse_metadata(songs[0], TEST_SONG);
+  song_parse_metadata(songs[1], TEST_SONG);
+  songs[1].track_number = songs[0].track_number + 1;
+  music_init(music, songs);
+
+  player_t player;
+  player.volume = 0.0;
+  player.song_queue = music_filter_songs(music);
+  player_play(player);
+  usleep(100 * 1000);
+  const size_t start_index = player.song_index;
+
+  // Seek forward
+  player_seek(player, 1.0);
+  usleep(300 * 1000);
+  const size_t seek_index = player.song_index;
+  const float seek_time = player.song_time;
+
+  // Skip to the next song
+  player_next(player);
+  usleep(300 * 1000);
+  const size_t next_index = player.song_index;
+  const float next_time = player.song_time;
+  player_stop(player);
+
+  CHECK(start_index == 0);
+  CHECK(seek_index == 0);
+  CHECK(seek_time >= 1.0);
+  CHECK(next_index == 1);
+  CHECK(next_time < 1.0);
+
+  return 0;
+}
+
+int test_track_seek_index() {
+  song_t song;
+  song_parse_metadata(song, TEST_SONG);
+
+  // Opening does not scan the file, the length is an estimate until the
+  // first seek builds the frame index
+  track_t track;
+  CHECK(track_open(track, song) == 0);
+  CHECK(track.indexed == false);
+  CHECK(track.scanned == false);
+  CHECK(track.decoder.samples == 0);
+  CHECK(track.length > 0.0f);
+  CHECK(track_seek(track, 0) == 0);
+  CHECK(track.indexed);
+  CHECK(track.scanned);
+  CHECK(track.decoder.samples > 0);
+  CHECK(track.length == (float) track.decoder.samples / track.decoder.rate);
+  const music_seek_entry_t seek = track.seek;
+  const float length = track.length;
+  CHECK(seek.step > 0);
+  CHECK(seek.offsets.size() > 0);
+  track_close(track);
+
+  // Reopening with the index skips the scan
+  CHECK(track_open(track, song, READER_WINDOW, &seek) == 0);
+  CHECK(track.indexed);
+  CHECK(track.length == length);
+  CHECK(track_seek(track, 0) == 0);
+  CHECK(track.scanned == false);
+  track_close(track);
+
+  // The player keeps indexes built by seeks in its seek store and saves them
+  // when playback ends, playing through without a seek builds none
+  music_t music;
+  songs_t songs = {song};
+  music_init(music, songs);
+
+  const std::string index_path = "/tmp/zp3_test_player_seek_index";
+  unlink(index_path.c_str());
+  music_seek_store_t store;
+  music_seek_store_load(store, index_path);
+  player_t player;
+  player.volume = 0.0;
+  player.song_queue = music_filter_songs(music);
+  player.seek_store = &store;
+  player_play(player);
+  usleep(100 * 1000);
+  player_stop(player);
+  CHECK(access(index_path.c_str(), F_OK) != 0);
+
+  player_play(player);
+  usleep(100 * 1000);
+  player_seek(player, 1.0f);
+  usleep(100 * 1000);
+  player_stop(player);
+  CHECK(music_seek_store_has(store, TEST_SONG));
+  music_seek_index_t saved;
+  CHECK(music_seek_index_load(saved, index_path) == 0);
+  CHECK(music_seek_index_get(saved, TEST_SONG) != nullptr);
+  unlink(index_path.c_str());
+
+  return 0;
+}
+
+int test_player_seek_relative() {
+  music_t music;
+  songs_t songs(1);
+  song_parse_metadata(songs[0], TEST_SONG);
+  music_init(music, songs);
+
+  player_t player;
+  player.volume = 0.0;
+  player.song_queue = music_filter_songs(music);
+  player_play(player);
+  usleep(200 * 1000);
+
+  // Presses before the decoder catches up add up
+  player_seek_relative(player, 0.5);
+  player_seek_relative(player, 0.5);
+  usleep(300 * 1000);
+  const float forward_time = player.song_time;
+
+  // Seeking back past the start lands on the start
+  player_seek_relative(player, -10.0);
+  usleep(300 * 1000);
+  const float back_time = player.song_time;
+  player_stop(player);
+
+  CHECK(forward_time >= 1.0);
+  CHECK(back_time < 0.5);
+
+  return 0;
+}
+
 int test_player_volume_up() {
   player_t player;
   player.volume = 0.0;
@@ -88,9 +431,15 @@ int test_player_volume_down() {
 int main(int argc, char **argv) {
   RUN_TEST(test_player_init);
   RUN_TEST(test_player_thread);
+  RUN_TEST(test_player_gapless);
+  RUN_TEST(test_player_crossfade);
   RUN_TEST(test_player_play);
   RUN_TEST(test_player_stop);
   RUN_TEST(test_player_toggle_pause_play);
+  RUN_TEST(test_player_pause);
+  RUN_TEST(test_player_seek_next);
+  RUN_TEST(test_track_seek_index);
+  RUN_TEST(test_player_seek_relative);
   RUN_TEST(test_player_volume_up);
   RUN_TEST(test_player_volume_down);
 
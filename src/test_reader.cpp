@@ -0,0 +1,163 @@
+#include "test.hpp"
+#include "reader.hpp"
+
+static std::string read_file(const std::string &path) {
+  std::string data;
+  FILE *fp = fopen(path.c_str(), "rb");
+  if (fp == NULL) {
+    return data;
+  }
+
+  char buf[4096];
+  size_t len = 0;
+  while ((len = fread(buf, 1, sizeof(buf), fp)) > 0) {
+    data.append(buf, len);
+  }
+  fclose(fp);
+
+  return data;
+}
+
+int test_reader_open() {
+  reader_t reader;
+  CHECK(reader_open(reader, TEST_SONG) == 0);
+  CHECK(reader.size == read_file(TEST_SONG).size());
+  CHECK(reader.pos == 0);
+  CHECK(reader.nb_prefetches == 1);
+  reader_close(reader);
+  CHECK(reader.fd == -1);
+
+  // Missing file
+  CHECK(reader_open(reader, "/tmp/zp3_no_such_song.mp3") == -1);
+  CHECK(reader_read(&reader, NULL, 10) == -1);
+
+  return 0;
+}
+
+int test_reader_read() {
+  const std::string expected = read_file(TEST_SONG);
+
+  // Small reads return the file as it is on disk
+  reader_t reader;
+  CHECK(reader_open(reader, TEST_SONG, 4096) == 0);
+  std::string data;
+  char buf[1000];
+  ssize_t len = 0;
+  while ((len = reader_read(&reader, buf, sizeof(buf))) > 0) {
+    data.append(buf, len);
+  }
+  CHECK(len == 0);
+  CHECK(data == expected);
+  CHECK(reader.nb_reads > 0);
+  CHECK(reader.io_wait >= reader.io_wait_max);
+
+  // A new window is requested each time half of the last one is used
+  CHECK(reader.nb_prefetches >= expected.size() / 4096);
+  CHECK(reader.nb_prefetches <= expected.size() / 2048 + 1);
+
+  reader_close(reader);
+
+  return 0;
+}
+
+int test_reader_lseek() {
+  const std::string expected = read_file(TEST_SONG);
+
+  reader_t reader;
+  CHECK(reader_open(reader, TEST_SONG) == 0);
+  CHECK(reader_lseek(&reader, 0, SEEK_END) == (off_t) expected.size());
+  CHECK(reader_lseek(&reader, 100, SEEK_SET) == 100);
+  CHECK(reader_lseek(&reader, 10, SEEK_CUR) == 110);
+  CHECK(reader_lseek(&reader, -1, SEEK_SET) == -1);
+  CHECK(reader_lseek(&reader, 1, SEEK_END) == -1);
+
+  char buf[16];
+  CHECK(reader_read(&reader, buf, sizeof(buf)) == sizeof(buf));
+  CHECK(memcmp(buf, expected.data() + 110, sizeof(buf)) == 0);
+
+  // Reads stop at the end of the file
+  CHECK(reader_lseek(&reader, -4, SEEK_END) == (off_t) expected.size() - 4);
+  CHECK(reader_read(&reader, buf, sizeof(buf)) == 4);
+  CHECK(reader_read(&reader, buf, sizeof(buf)) == 0);
+
+  reader_close(reader);
+
+  return 0;
+}
+
+// Test file larger than the reader's buffer
+#define TEST_BIG_FILE "/tmp/zp3_test_reader_big"
+
+static std::string write_big_file() {
+  std::string data;
+  for (int i = 0; data.size() < 4 * READER_BUFFER; i++) {
+    data += std::to_string(i) + "\n";
+  }
+
+  FILE *fp = fopen(TEST_BIG_FILE, "wb");
+  if (fp != NULL) {
+    fwrite(data.data(), 1, data.size(), fp);
+    fclose(fp);
+  }
+
+  return data;
+}
+
+int test_reader_pread() {
+  const std::string expected = write_big_file();
+
+  // Reads at an offset leave the read position alone, in or out of the
+  // buffer and larger than it
+  reader_t reader;
+  CHECK(reader_open(reader, TEST_BIG_FILE) == 0);
+  char buf[16];
+  CHECK(reader_pread(reader, buf, sizeof(buf), 100) == sizeof(buf));
+  CHECK(memcmp(buf, expected.data() + 100, sizeof(buf)) == 0);
+  CHECK(reader_pread(reader, buf, sizeof(buf), 50) == sizeof(buf));
+  CHECK(memcmp(buf, expected.data() + 50, sizeof(buf)) == 0);
+  std::string big(2 * READER_BUFFER, 0);
+  CHECK(reader_pread(reader, &big[0], big.size(), 10) == (ssize_t) big.size());
+  CHECK(big == expected.substr(10, big.size()));
+  CHECK(reader.pos == 0);
+
+  // Past the end of the file
+  CHECK(reader_pread(reader, buf, sizeof(buf), expected.size() - 4) == 4);
+  CHECK(reader_pread(reader, buf, sizeof(buf), expected.size() + 4) == 0);
+  reader_close(reader);
+  CHECK(reader_pread(reader, buf, sizeof(buf), 0) == -1);
+  unlink(TEST_BIG_FILE);
+
+  return 0;
+}
+
+int test_reader_truncated() {
+  const std::string expected = write_big_file();
+
+  // A file cut short while it is read makes reads fail instead of faulting
+  reader_t reader;
+  CHECK(reader_open(reader, TEST_BIG_FILE, 4096) == 0);
+  char buf[1000];
+  CHECK(reader_read(&reader, buf, sizeof(buf)) == sizeof(buf));
+  CHECK(truncate(TEST_BIG_FILE, 2000) == 0);
+  ssize_t len = 0;
+  size_t total = sizeof(buf);
+  while ((len = reader_read(&reader, buf, sizeof(buf))) > 0) {
+    total += len;
+  }
+  CHECK(len == -1);
+  CHECK(total == READER_BUFFER);
+  reader_close(reader);
+  unlink(TEST_BIG_FILE);
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  RUN_TEST(test_reader_open);
+  RUN_TEST(test_reader_read);
+  RUN_TEST(test_reader_lseek);
+  RUN_TEST(test_reader_pread);
+  RUN_TEST(test_reader_truncated);
+
+  return 0;
+}
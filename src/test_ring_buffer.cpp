@@ -0,0 +1,129 @@
+#include "test.hpp"
+#include "util.hpp"
+#include "ring_buffer.hpp"
+
+int test_ring_buffer_init() {
+  ring_buffer_t rb;
+  ring_buffer_init(rb, 1000);
+  CHECK(ring_buffer_capacity(rb) == 1024);
+  CHECK(ring_buffer_size(rb) == 0);
+  CHECK(ring_buffer_space(rb) == 1024);
+
+  return 0;
+}
+
+int test_ring_buffer_write_read() {
+  ring_buffer_t rb;
+  ring_buffer_init(rb, 8);
+
+  // Fill, writes beyond capacity are truncated
+  const unsigned char in[10] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+  CHECK(ring_buffer_write(rb, in, 6) == 6);
+  CHECK(ring_buffer_write(rb, in + 6, 4) == 2);
+  CHECK(ring_buffer_size(rb) == 8);
+  CHECK(ring_buffer_space(rb) == 0);
+
+  // Peek does not consume
+  unsigned char out[10] = {0};
+  CHECK(ring_buffer_peek(rb, out, 3) == 3);
+  CHECK(ring_buffer_size(rb) == 8);
+  CHECK(ring_buffer_read(rb, out, 5) == 5);
+  CHECK(out[0] == 0 && out[4] == 4);
+
+  // Wrap around
+  CHECK(ring_buffer_write(rb, in, 5) == 5);
+  CHECK(ring_buffer_read(rb, out, 10) == 8);
+  const unsigned char expected[8] = {5, 6, 7, 0, 1, 2, 3, 4};
+  CHECK(memcmp(out, expected, 8) == 0);
+  CHECK(ring_buffer_read(rb, out, 10) == 0);
+
+  return 0;
+}
+
+/**
+ * Stream a counting byte pattern through the ring buffer. The producer
+ * writes decoder sized blocks and sleeps for `delay_us` every few blocks, the
+ * consumer drains it at a fixed rate like a sound card. Returns the number of
+ * underruns, or -1 if the data was corrupted.
+ */
+static int ring_buffer_stress(const size_t capacity, const int delay_us) {
+  const size_t total = 512 * 1024;
+  const size_t block_size = 4608;
+  const size_t chunk_size = 4096;
+  const int period_us = 5000;  // ~800 KB/s
+  const size_t blocks_per_delay = 16;
+
+  ring_buffer_t rb;
+  ring_buffer_init(rb, capacity);
+  std::atomic<bool> done{false};
+
+  // Decoder
+  std::thread producer([&]() {
+    std::vector<unsigned char> block(block_size);
+    size_t written = 0;
+    for (size_t i = 0; written < total; i++) {
+      if (i > 0 && (i % blocks_per_delay) == 0) {
+        usleep(delay_us);
+      }
+
+      const size_t size = std::min(block_size, total - written);
+      for (size_t j = 0; j < size; j++) {
+        block[j] = (written + j) & 0xff;
+      }
+      size_t n = 0;
+      while (n < size) {
+        n += ring_buffer_write(rb, block.data() + n, size - n);
+        if (n < size) {
+          usleep(1000);
+        }
+      }
+      written += size;
+    }
+    done = true;
+  });
+
+  // Sound card, starts once the buffer is full
+  while (ring_buffer_space(rb) > 0 && done == false) {
+    usleep(1000);
+  }
+
+  int underruns = 0;
+  bool corrupt = false;
+  std::vector<unsigned char> chunk(chunk_size);
+  size_t read = 0;
+  while (read < total) {
+    const bool finished = done;
+    const size_t n = ring_buffer_read(rb, chunk.data(), chunk_size);
+    if (n < chunk_size && finished == false) {
+      underruns++;
+    }
+    for (size_t j = 0; j < n; j++) {
+      corrupt |= (chunk[j] != ((read + j) & 0xff));
+    }
+    read += n;
+    usleep(period_us);
+  }
+  producer.join();
+
+  return (corrupt) ? -1 : underruns;
+}
+
+int test_ring_buffer_stress() {
+  // 64 KB drains in ~80 ms, delays within that budget are absorbed
+  const int underruns = ring_buffer_stress(64 * 1024, 40 * 1000);
+  printf("underruns: %d ", underruns);
+  CHECK(underruns == 0);
+
+  // Delays longer than the buffer run it dry
+  CHECK(ring_buffer_stress(64 * 1024, 200 * 1000) > 0);
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  RUN_TEST(test_ring_buffer_init);
+  RUN_TEST(test_ring_buffer_write_read);
+  RUN_TEST(test_ring_buffer_stress);
+
+  return 0;
+}
@@ -0,0 +1,101 @@
+#include "test.hpp"
+#include "display.hpp"
+
+int test_text_cache_get() {
+  text_cache_t cache;
+
+  // Miss then hit
+  const auto &bitmap = text_cache_get(cache, DISPLAY_FONT, 6, 8, 0xff, "Hello");
+  CHECK(bitmap.width == 30);
+  CHECK(bitmap.height == 8);
+  CHECK(cache.misses == 1);
+  text_cache_get(cache, DISPLAY_FONT, 6, 8, 0xff, "Hello");
+  CHECK(cache.hits == 1);
+  CHECK(cache.bitmaps.size() == 1);
+
+  // Color is part of the key
+  text_cache_get(cache, DISPLAY_FONT, 6, 8, 0x00, "Hello");
+  CHECK(cache.misses == 2);
+  CHECK(cache.bitmaps.size() == 2);
+
+  text_cache_clear(cache);
+  CHECK(cache.bitmaps.size() == 0);
+  CHECK(cache.bytes == 0);
+
+  return 0;
+}
+
+int test_text_cache_evict() {
+  // Room for two 10 character strings
+  text_cache_t cache;
+  cache.max_bytes = 2 * (60 * 8 + 10);
+
+  text_cache_get(cache, DISPLAY_FONT, 6, 8, 0xff, "0123456789");
+  text_cache_get(cache, DISPLAY_FONT, 6, 8, 0xff, "abcdefghij");
+  CHECK(cache.bitmaps.size() == 2);
+
+  // Using the first makes the second least recently used
+  text_cache_get(cache, DISPLAY_FONT, 6, 8, 0xff, "0123456789");
+  text_cache_get(cache, DISPLAY_FONT, 6, 8, 0xff, "ABCDEFGHIJ");
+  CHECK(cache.bitmaps.size() == 2);
+  CHECK(cache.bytes <= cache.max_bytes);
+  CHECK(cache.bitmaps.front().key.text == "ABCDEFGHIJ");
+  CHECK(cache.bitmaps.back().key.text == "0123456789");
+
+  return 0;
+}
+
+int test_text_blit() {
+  display_init();
+  const int width = 128;
+  const int height = 128;
+  const std::string text = "Bob Dylan - Apple";
+
+  // Rendered directly
+  std::vector<uint8_t> expected(width * height, 0);
+  NanoCanvas8 canvas(width, height, expected.data());
+  canvas.setMode(CANVAS_MODE_TRANSPARENT);
+  canvas.setColor(RGB_COLOR8(255, 255, 255));
+  canvas.printFixed(3, 5, text.c_str());
+
+  // Rendered from the cache
+  text_cache_t cache;
+  const auto &bitmap = text_cache_get(cache,
+                                      DISPLAY_FONT,
+                                      DISPLAY_FONT_WIDTH,
+                                      DISPLAY_FONT_HEIGHT,
+                                      RGB_COLOR8(255, 255, 255),
+                                      text);
+  std::vector<uint8_t> buffer(width * height, 0);
+  text_blit(buffer.data(), width, height, bitmap, 0, bitmap.width, 3, 5);
+  CHECK(buffer == expected);
+
+  // Clipped on the left is the same as drawing the tail
+  const auto &tail = text_cache_get(cache,
+                                    DISPLAY_FONT,
+                                    DISPLAY_FONT_WIDTH,
+                                    DISPLAY_FONT_HEIGHT,
+                                    RGB_COLOR8(255, 255, 255),
+                                    text.substr(2));
+  std::vector<uint8_t> clipped(width * height, 0);
+  std::vector<uint8_t> shifted(width * height, 0);
+  text_blit(clipped.data(), width, height, bitmap, 0, bitmap.width, -12, 0);
+  text_blit(shifted.data(), width, height, tail, 0, tail.width, 0, 0);
+  CHECK(clipped == shifted);
+
+  // Off screen draws nothing
+  std::vector<uint8_t> empty(width * height, 0);
+  text_blit(empty.data(), width, height, bitmap, 0, bitmap.width, width, height);
+  text_blit(empty.data(), width, height, bitmap, 0, bitmap.width, -1000, -20);
+  CHECK(empty == std::vector<uint8_t>(width * height, 0));
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  RUN_TEST(test_text_cache_get);
+  RUN_TEST(test_text_cache_evict);
+  RUN_TEST(test_text_blit);
+
+  return 0;
+}
@@ -0,0 +1,53 @@
+#include "test.hpp"
+#include "util.hpp"
+
+int test_has_ext() {
+  const std::vector<std::string> exts = {"mp3", "flac"};
+
+  CHECK(has_ext("song.mp3", 8, exts));
+  CHECK(has_ext("SONG.MP3", 8, exts));
+  CHECK(has_ext("song.flac", 9, exts));
+  CHECK(has_ext("song.ogg", 8, exts) == false);
+  CHECK(has_ext("songmp3", 7, exts) == false);
+  CHECK(has_ext(".mp3", 4, exts) == false);
+  CHECK(has_ext("a", 1, exts) == false);
+  CHECK(has_ext("a", 1, {"*"}));
+
+  return 0;
+}
+
+int test_walkdir() {
+  // Single extension
+  std::vector<std::string> file_list;
+  walkdir(TEST_MUSIC_LIBRARY, file_list, "mp3");
+  CHECK(file_list.size() == 15);
+
+  // Multiple extensions in one pass
+  file_list.clear();
+  walkdir(TEST_MUSIC_LIBRARY, file_list, std::vector<std::string>{"mp3", "py"});
+  CHECK(file_list.size() == 16);
+
+  // Everything
+  file_list.clear();
+  walkdir(TEST_MUSIC_LIBRARY, file_list);
+  CHECK(file_list.size() == 16);
+
+  // Paths are joined to the root
+  for (const auto &file_path : file_list) {
+    CHECK(file_path.compare(0, strlen(TEST_MUSIC_LIBRARY "/"), TEST_MUSIC_LIBRARY "/") == 0);
+  }
+
+  // Non-existent directory
+  file_list.clear();
+  walkdir("not_a_dir", file_list);
+  CHECK(file_list.size() == 0);
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  RUN_TEST(test_has_ext);
+  RUN_TEST(test_walkdir);
+
+  return 0;
+}
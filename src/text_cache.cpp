@@ -0,0 +1,89 @@
+#include "text_cache.hpp"
+
+static size_t text_bitmap_bytes(const text_bitmap_t &bitmap) {
+  return bitmap.mask.size() + bitmap.key.text.size();
+}
+
+const text_bitmap_t &text_cache_get(text_cache_t &cache,
+                                    const uint8_t *font,
+                                    const int font_width,
+                                    const int font_height,
+                                    const uint16_t color,
+                                    const std::string &text) {
+  text_key_t key;
+  key.font = font;
+  key.color = color;
+  key.text = text;
+
+  // Hit, move to the front
+  const auto it = cache.index.find(key);
+  if (it != cache.index.end()) {
+    cache.hits++;
+    cache.bitmaps.splice(cache.bitmaps.begin(), cache.bitmaps, it->second);
+    return *it->second;
+  }
+  cache.misses++;
+
+  // Miss, rasterise the string with the current fixed font
+  text_bitmap_t bitmap;
+  bitmap.key = key;
+  bitmap.width = font_width * text.length();
+  bitmap.height = font_height;
+  bitmap.mask.assign(bitmap.width * bitmap.height, 0);
+  if (bitmap.width > 0) {
+    NanoCanvas8 canvas(bitmap.width, bitmap.height, bitmap.mask.data());
+    canvas.setMode(CANVAS_MODE_TRANSPARENT);
+    canvas.setColor(0xff);
+    canvas.printFixed(0, 0, text.c_str());
+  }
+
+  // Evict least recently used bitmaps to make room
+  const size_t bytes = text_bitmap_bytes(bitmap);
+  while (cache.bitmaps.empty() == false && cache.bytes + bytes > cache.max_bytes) {
+    cache.bytes -= text_bitmap_bytes(cache.bitmaps.back());
+    cache.index.erase(cache.bitmaps.back().key);
+    cache.bitmaps.pop_back();
+  }
+
+  cache.bitmaps.push_front(std::move(bitmap));
+  cache.index[key] = cache.bitmaps.begin();
+  cache.bytes += bytes;
+
+  return cache.bitmaps.front();
+}
+
+void text_cache_clear(text_cache_t &cache) {
+  cache.bitmaps.clear();
+  cache.index.clear();
+  cache.bytes = 0;
+}
+
+/**
+ * Draw columns [src_x, src_x + src_width) of `bitmap` at (x, y) in an 8-bit
+ * buffer, clipped to the buffer. Only covered pixels are written.
+ */
+void text_blit(uint8_t *buffer,
+               const int width,
+               const int height,
+               const text_bitmap_t &bitmap,
+               const int src_x,
+               const int src_width,
+               const int x,
+               const int y) {
+  const uint8_t color = bitmap.key.color;
+  const int src_end = min(src_x + src_width, bitmap.width);
+  const int col_begin = max(src_x, src_x - x);
+  const int col_end = min(src_end, src_x + width - x);
+  const int row_begin = max(0, -y);
+  const int row_end = min(bitmap.height, height - y);
+
+  for (int row = row_begin; row < row_end; row++) {
+    const uint8_t *mask = bitmap.mask.data() + row * bitmap.width;
+    uint8_t *dst = buffer + (y + row) * width + (x - src_x);
+    for (int col = col_begin; col < col_end; col++) {
+      if (mask[col]) {
+        dst[col] = color;
+      }
+    }
+  }
+}
@@ -0,0 +1,80 @@
+#ifndef ZP3_TEXT_CACHE_HPP
+#define ZP3_TEXT_CACHE_HPP
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <ssd1306.h>
+#include <nano_engine.h>
+
+/**
+ * Text bitmap cache
+ *
+ * Drawing a string with printFixed rasterises it glyph by glyph every time.
+ * The cache keeps strings already rasterised with a fixed font as coverage
+ * masks keyed by (string, font, color), so redrawing the same menu page or
+ * track info is a series of bitmap copies. Least recently used bitmaps are
+ * evicted once the cache holds more than `max_bytes`.
+ */
+#define TEXT_CACHE_MAX_BYTES (64 * 1024)
+
+struct text_key_t {
+  const uint8_t *font = nullptr;
+  uint16_t color = 0;
+  std::string text;
+
+  bool operator==(const text_key_t &other) const {
+    return font == other.font && color == other.color && text == other.text;
+  }
+};
+
+struct text_key_hash_t {
+  size_t operator()(const text_key_t &key) const {
+    const size_t h = std::hash<std::string>()(key.text);
+    return h ^ (std::hash<const void *>()(key.font) << 1) ^ ((size_t) key.color << 7);
+  }
+};
+
+struct text_bitmap_t {
+  text_key_t key;
+  int width = 0;
+  int height = 0;
+  std::vector<uint8_t> mask;
+};
+
+typedef std::list<text_bitmap_t> text_bitmaps_t;
+
+struct text_cache_t {
+  size_t max_bytes = TEXT_CACHE_MAX_BYTES;
+  size_t bytes = 0;
+  size_t hits = 0;
+  size_t misses = 0;
+
+  // Most recently used first
+  text_bitmaps_t bitmaps;
+  std::unordered_map<text_key_t, text_bitmaps_t::iterator, text_key_hash_t> index;
+};
+
+const text_bitmap_t &text_cache_get(text_cache_t &cache,
+                                    const uint8_t *font,
+                                    const int font_width,
+                                    const int font_height,
+                                    const uint16_t color,
+                                    const std::string &text);
+void text_cache_clear(text_cache_t &cache);
+void text_blit(uint8_t *buffer,
+               const int width,
+               const int height,
+               const text_bitmap_t &bitmap,
+               const int src_x,
+               const int src_width,
+               const int x,
+               const int y);
+
+#endif // ZP3_TEXT_CACHE_HPP
@@ -1,30 +1,131 @@
 #include "util.hpp"
 
+// Not exposed by glibc
+struct linux_dirent64 {
+  ino64_t d_ino;
+  off64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+bool has_ext(const char *file_name,
+             const size_t len,
+             const std::vector<std::string> &target_exts) {
+  for (const auto &ext : target_exts) {
+    if (ext == "*") {
+      return true;
+    }
+
+    // Case insensitive match on ".<ext>", without allocating
+    const size_t ext_len = ext.length();
+    if (len > ext_len + 1
+        && file_name[len - ext_len - 1] == '.'
+        && strncasecmp(file_name + len - ext_len, ext.c_str(), ext_len) == 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * Type of directory entry `name` in directory `dir_fd` as reported by
+ * readdir, not every file system fills it in so it is looked up if unknown.
+ */
+unsigned char dirent_type(const int dir_fd, const char *name, const unsigned char type) {
+  if (type != DT_UNKNOWN) {
+    return type;
+  }
+
+  struct stat st;
+  if (fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+    return DT_UNKNOWN;
+  }
+  return S_ISDIR(st.st_mode) ? DT_DIR : DT_REG;
+}
+
 void walkdir(const std::string &path,
              std::vector<std::string> &file_list,
-             const std::string &target_ext) {
-  DIR *dir = opendir(path.c_str());
-  if (dir == NULL) {
-    return;
-  }
+             const std::vector<std::string> &target_exts) {
+  std::vector<char> buf(WALKDIR_BUFFER_SIZE);
+  std::vector<std::string> stack{path};
 
-  struct dirent *entry;
-  while ((entry = readdir(dir)) != NULL) {
-    std::string value(entry->d_name);
-    if (value == "." || value == "..") {
+  // Depth first with an explicit stack of directories still to visit
+  while (stack.empty() == false) {
+    const std::string dir = std::move(stack.back());
+    stack.pop_back();
+
+    const int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
       continue;
     }
 
-    const auto ext_len = target_ext.length();
-    const auto file_ext = value.substr(value.length() - ext_len, ext_len);
-    if (entry->d_type == DT_DIR) {
-      walkdir(path + "/" + value, file_list, target_ext);
-    } else if (target_ext == "*" || target_ext == file_ext) {
-      file_list.push_back(path + "/" + value);
+    long nb_read;
+    while ((nb_read = syscall(SYS_getdents64, fd, buf.data(), buf.size())) > 0) {
+      for (long pos = 0; pos < nb_read;) {
+        const auto entry = (struct linux_dirent64 *) (buf.data() + pos);
+        pos += entry->d_reclen;
+
+        const char *name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+          continue;
+        }
+
+        const unsigned char type = dirent_type(fd, name, entry->d_type);
+        const size_t len = strlen(name);
+        if (type == DT_DIR) {
+          stack.emplace_back(dir);
+          stack.back().append(1, '/').append(name, len);
+        } else if (has_ext(name, len, target_exts)) {
+          file_list.emplace_back(dir);
+          file_list.back().append(1, '/').append(name, len);
+        }
+      }
+    }
+
+    close(fd);
+  }
+}
+
+void walkdir(const std::string &path,
+             std::vector<std::string> &file_list,
+             const std::string &target_ext) {
+  walkdir(path, file_list, std::vector<std::string>{target_ext});
+}
+
+void parallel_for(const size_t n,
+                  const size_t nb_threads,
+                  const std::function<void(size_t)> &fn) {
+  size_t nb_workers = nb_threads;
+  if (nb_workers == 0) {
+    nb_workers = std::thread::hardware_concurrency();
+  }
+  nb_workers = (nb_workers > n) ? n : nb_workers;
+
+  // Not worth spawning threads
+  if (nb_workers <= 1) {
+    for (size_t i = 0; i < n; i++) {
+      fn(i);
     }
+    return;
   }
 
-  closedir(dir);
+  std::atomic<size_t> next{0};
+  auto worker = [&]() {
+    size_t i;
+    while ((i = next.fetch_add(1)) < n) {
+      fn(i);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < nb_workers; i++) {
+    workers.emplace_back(worker);
+  }
+  for (auto &t : workers) {
+    t.join();
+  }
 }
 
 char getch() {
@@ -53,3 +154,20 @@ char getch() {
 
   return (buf);
 }
+
+struct timespec tic() {
+  struct timespec time_start;
+  clock_gettime(CLOCK_MONOTONIC, &time_start);
+  return time_start;
+}
+
+float toc(struct timespec *tic) {
+  struct timespec toc;
+  float time_elapsed;
+
+  clock_gettime(CLOCK_MONOTONIC, &toc);
+  time_elapsed = (toc.tv_sec - tic->tv_sec);
+  time_elapsed += (toc.tv_nsec - tic->tv_nsec) / 1000000000.0;
+
+  return time_elapsed;
+}
@@ -3,10 +3,21 @@
 
 #include <dirent.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
 #include <unistd.h>
 #include <termios.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 
+#include <atomic>
+#include <functional>
 #include <map>
+#include <string>
+#include <thread>
 #include <vector>
 
 template <typename K, typename V>
@@ -25,10 +36,34 @@ void pop_front(std::vector<T> &vec) {
   vec.pop_back();
 }
 
+/**
+ * Directory walk buffer size. Large buffers mean few getdents64 calls per
+ * directory, which matters on slow SD cards.
+ */
+#define WALKDIR_BUFFER_SIZE (32 * 1024)
+
+bool has_ext(const char *file_name,
+             const size_t len,
+             const std::vector<std::string> &target_exts);
+unsigned char dirent_type(const int dir_fd, const char *name, const unsigned char type);
+void walkdir(const std::string &path,
+             std::vector<std::string> &file_list,
+             const std::vector<std::string> &target_exts);
 void walkdir(const std::string &path,
              std::vector<std::string> &file_list,
              const std::string &target_ext="*");
 
+/**
+ * Call `fn(i)` for every `i` in `[0, n)` on a pool of `nb_threads` worker
+ * threads (0 = hardware concurrency). Workers claim indices one at a time so
+ * slow items do not stall a whole batch. Blocks until all items are done.
+ */
+void parallel_for(const size_t n,
+                  const size_t nb_threads,
+                  const std::function<void(size_t)> &fn);
+
 char getch();
+struct timespec tic();
+float toc(struct timespec *tic);
 
 #endif // ZP3_UTIL_HPP
@@ -0,0 +1,338 @@
+#include "watcher.hpp"
+
+#define WATCHER_EVENTS \
+  (IN_CREATE | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+
+struct watcher_batch_t {
+  bool rescan = false;
+  std::set<std::string> added;
+  std::set<std::string> removed;
+};
+
+static bool watcher_is_song(const std::string &path) {
+  return has_ext(path.c_str(), path.length(), music_file_exts);
+}
+
+/**
+ * Watch directory `dir` and everything below it. Songs found on the way are
+ * added to `songs`, which is how files in directories that were moved or
+ * copied in as a whole are picked up.
+ */
+static void watcher_add_dir(music_watcher_t &watcher,
+                            const std::string &dir,
+                            std::set<std::string> &songs) {
+  const int wd = inotify_add_watch(watcher.fd, dir.c_str(), WATCHER_EVENTS);
+  if (wd == -1) {
+    LOG_WARN("Failed to watch [%s]", dir.c_str());
+    return;
+  }
+  watcher.watches[wd] = dir;
+
+  DIR *dp = opendir(dir.c_str());
+  if (dp == NULL) {
+    return;
+  }
+
+  struct dirent *entry;
+  while ((entry = readdir(dp)) != NULL) {
+    const std::string name(entry->d_name);
+    if (name == "." || name == "..") {
+      continue;
+    }
+
+    const std::string path = dir + "/" + name;
+    if (dirent_type(dirfd(dp), entry->d_name, entry->d_type) == DT_DIR) {
+      watcher_add_dir(watcher, path, songs);
+    } else if (watcher_is_song(path)) {
+      songs.insert(path);
+    }
+  }
+  closedir(dp);
+}
+
+/**
+ * Stop watching directory `dir` and everything below it, every song that was
+ * in it is added to `songs`.
+ */
+static void watcher_remove_dir(music_watcher_t &watcher,
+                               const std::string &dir,
+                               std::set<std::string> &songs) {
+  const std::string prefix = dir + "/";
+
+  for (auto it = watcher.watches.begin(); it != watcher.watches.end();) {
+    if (it->second == dir || it->second.compare(0, prefix.length(), prefix) == 0) {
+      inotify_rm_watch(watcher.fd, it->first);
+      it = watcher.watches.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  // Files are sorted by path, so everything below dir is one contiguous range
+  for (auto it = watcher.files.lower_bound(prefix);
+       it != watcher.files.end() && it->first.compare(0, prefix.length(), prefix) == 0;
+       ++it) {
+    songs.insert(it->first);
+  }
+}
+
+static void watcher_handle_event(music_watcher_t &watcher,
+                                 const struct inotify_event *event,
+                                 watcher_batch_t &batch) {
+  if (event->mask & IN_Q_OVERFLOW) {
+    batch.rescan = true;
+    return;
+  }
+
+  if (event->mask & IN_IGNORED) {
+    watcher.watches.erase(event->wd);
+    return;
+  }
+
+  const auto it = watcher.watches.find(event->wd);
+  if (it == watcher.watches.end() || event->len == 0) {
+    return;
+  }
+  const std::string path = it->second + "/" + event->name;
+
+  if (event->mask & IN_ISDIR) {
+    std::set<std::string> songs;
+    if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+      watcher_add_dir(watcher, path, songs);
+      for (const auto &song : songs) {
+        batch.added.insert(song);
+        batch.removed.erase(song);
+      }
+    } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+      watcher_remove_dir(watcher, path, songs);
+      for (const auto &song : songs) {
+        batch.removed.insert(song);
+        batch.added.erase(song);
+      }
+    }
+    return;
+  }
+
+  if (watcher_is_song(path) == false) {
+    return;
+  }
+
+  if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+    batch.added.insert(path);
+    batch.removed.erase(path);
+  } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+    batch.removed.insert(path);
+    batch.added.erase(path);
+  }
+}
+
+static void watcher_apply(music_watcher_t &watcher, watcher_batch_t &batch) {
+  // Event queue overflowed, we no longer know what changed
+  if (batch.rescan) {
+    std::lock_guard<std::mutex> guard(watcher.mutex);
+    LOG_WARN("Library watcher lost events, rescanning [%s]", watcher.path.c_str());
+
+    // Directories created in the meantime are not watched either, start
+    // again from the root
+    for (const auto &kv : watcher.watches) {
+      inotify_rm_watch(watcher.fd, kv.first);
+    }
+    watcher.watches.clear();
+    std::set<std::string> songs;
+    watcher_add_dir(watcher, watcher.path, songs);
+
+    // Only files that changed since the index was written are parsed
+    music_t music;
+    music_load_library(music, watcher.path, watcher.index_path);
+    music_watcher_init(watcher, music);
+    batch = watcher_batch_t();
+    return;
+  }
+
+  // Work out what changed, modified songs are removed and added again
+  std::set<std::string> removed;
+  songs_t added;
+  for (const auto &path : batch.removed) {
+    const auto it = watcher.files.find(path);
+    if (it == watcher.files.end()) {
+      continue;
+    }
+    if (it->second.valid) {
+      removed.insert(path);
+    }
+    watcher.files.erase(it);
+  }
+
+  for (const auto &path : batch.added) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+      continue;
+    }
+
+    music_watcher_file_t file;
+    file.mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    file.size = st.st_size;
+
+    const auto it = watcher.files.find(path);
+    if (it != watcher.files.end()) {
+      if (it->second.mtime == file.mtime && it->second.size == file.size) {
+        continue;
+      }
+      if (it->second.valid) {
+        removed.insert(path);
+      }
+    }
+
+    song_t song;
+    file.valid = (song_parse_metadata(song, path) == 0);
+    if (file.valid) {
+      added.push_back(song);
+    }
+    watcher.files[path] = file;
+  }
+  batch = watcher_batch_t();
+
+  if (removed.empty() && added.empty()) {
+    return;
+  }
+
+  // Apply changes to a copy of the current library, readers keep using the
+  // old one until it is published
+  std::lock_guard<std::mutex> guard(watcher.mutex);
+  auto music = std::make_shared<music_t>(*music_watcher_library(watcher));
+  const size_t nb_changes = music_update(*music, removed, added);
+
+  // Publish
+  if (nb_changes) {
+    std::atomic_store(&watcher.music, std::shared_ptr<const music_t>(music));
+    watcher.generation++;
+    LOG_INFO("Library updated [%zu changes, %zu songs]",
+             nb_changes,
+             music->songs.size());
+  }
+}
+
+static void watcher_thread(music_watcher_t *watcher) {
+  watcher_batch_t batch;
+  bool pending = false;
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+  while (watcher->running) {
+    // Wait for events, once some have arrived wait for things to settle
+    struct pollfd fds[2];
+    fds[0].fd = watcher->fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = watcher->stop_fd;
+    fds[1].events = POLLIN;
+    const int timeout = pending ? MUSIC_WATCHER_SETTLE_MS : -1;
+    const int retval = poll(fds, 2, timeout);
+    if (retval == -1 && errno != EINTR) {
+      LOG_ERROR("Library watcher poll failed!");
+      break;
+    } else if (fds[1].revents & POLLIN) {
+      break;
+    } else if (retval == 0) {
+      watcher_apply(*watcher, batch);
+      pending = false;
+      continue;
+    }
+
+    // Read events
+    const ssize_t len = read(watcher->fd, buf, sizeof(buf));
+    if (len <= 0) {
+      continue;
+    }
+    for (char *ptr = buf; ptr < buf + len;) {
+      const auto event = (const struct inotify_event *) ptr;
+      watcher_handle_event(*watcher, event, batch);
+      ptr += sizeof(struct inotify_event) + event->len;
+    }
+    pending = true;
+  }
+}
+
+void music_watcher_init(music_watcher_t &watcher, const music_t &music) {
+  watcher.files.clear();
+  for (size_t i = 0; i < music.songs.size(); i++) {
+    // No mtime or size, any later write to the file counts as a modification
+    music_watcher_file_t file;
+    file.valid = true;
+    watcher.files[music_song_path(music, i)] = file;
+  }
+
+  std::atomic_store(&watcher.music, std::make_shared<const music_t>(music));
+  watcher.generation++;
+}
+
+/**
+ * Watch the library at `path`. If the watcher loses events it rescans the
+ * library with the index at `index_path`, if there is one.
+ */
+int music_watcher_start(music_watcher_t &watcher,
+                        const std::string &path,
+                        const std::string &index_path) {
+  watcher.path = path;
+  watcher.index_path = index_path;
+  watcher.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  watcher.stop_fd = eventfd(0, EFD_CLOEXEC);
+  if (watcher.fd == -1 || watcher.stop_fd == -1) {
+    LOG_ERROR("Failed to initialize library watcher!");
+    music_watcher_stop(watcher);
+    return -1;
+  }
+
+  std::set<std::string> songs;
+  watcher_add_dir(watcher, path, songs);
+
+  watcher.running = true;
+  watcher.thread = std::thread(watcher_thread, &watcher);
+
+  return 0;
+}
+
+void music_watcher_stop(music_watcher_t &watcher) {
+  if (watcher.running) {
+    watcher.running = false;
+    const uint64_t value = 1;
+    if (write(watcher.stop_fd, &value, sizeof(value)) != sizeof(value)) {
+      LOG_ERROR("Failed to signal library watcher!");
+    }
+    watcher.thread.join();
+  }
+
+  if (watcher.fd != -1) {
+    close(watcher.fd);
+    watcher.fd = -1;
+  }
+  if (watcher.stop_fd != -1) {
+    close(watcher.stop_fd);
+    watcher.stop_fd = -1;
+  }
+  watcher.watches.clear();
+}
+
+std::shared_ptr<const music_t> music_watcher_library(const music_watcher_t &watcher) {
+  return std::atomic_load(&watcher.music);
+}
+
+/**
+ * Publish loudness scan results, `replaygains` maps file paths to their new
+ * values. Songs no longer in the library are skipped. Returns the number of
+ * songs updated.
+ */
+size_t music_watcher_set_replaygain(music_watcher_t &watcher,
+                                    const std::map<std::string, replaygain_t> &replaygains) {
+  std::lock_guard<std::mutex> guard(watcher.mutex);
+  auto music = std::make_shared<music_t>(*music_watcher_library(watcher));
+  size_t nb_updated = 0;
+  for (const auto &kv : replaygains) {
+    nb_updated += (music_set_replaygain(*music, kv.first, kv.second) == 0);
+  }
+
+  if (nb_updated) {
+    std::atomic_store(&watcher.music, std::shared_ptr<const music_t>(music));
+    watcher.generation++;
+  }
+
+  return nb_updated;
+}
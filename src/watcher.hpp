@@ -0,0 +1,79 @@
+#ifndef ZP3_WATCHER_HPP
+#define ZP3_WATCHER_HPP
+
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+#include "log.hpp"
+#include "music.hpp"
+
+/**
+ * Music library watcher
+ *
+ * Watches the music directory tree with inotify and applies file changes to
+ * the library incrementally: only created, modified, moved or deleted files
+ * have their tags parsed, and songs are inserted into / removed from the
+ * existing song list, artist and album maps in place.
+ *
+ * Changes are batched until the directory has been quiet for
+ * `MUSIC_WATCHER_SETTLE_MS`, applied to a private copy of the current
+ * library and then published with a single atomic pointer swap. The copy
+ * shares the song table and string pool chunks the batch does not touch
+ * with the current library, so publishing costs in proportion to the batch
+ * rather than to the library. Readers take
+ * a snapshot with `music_watcher_library()` and are never exposed to a half
+ * applied batch; a snapshot stays valid for as long as it is held. Other
+ * threads publish changes the same way, e.g. the loudness scanner with
+ * `music_watcher_set_replaygain()`.
+ */
+#define MUSIC_WATCHER_SETTLE_MS 500
+
+// What the watcher last saw of a file, to tell whether it was modified
+struct music_watcher_file_t {
+  int64_t mtime = 0;
+  int64_t size = 0;
+  bool valid = false;
+};
+
+struct music_watcher_t {
+  std::string path;
+  std::string index_path;
+  int fd = -1;
+  int stop_fd = -1;
+  std::thread thread;
+  std::atomic<bool> running{false};
+
+  // Watch descriptor -> directory
+  std::map<int, std::string> watches;
+  // File path -> what was last seen of it, the song itself is only kept in
+  // the library
+  std::map<std::string, music_watcher_file_t> files;
+
+  // Published library, only accessed with std::atomic_load/store. Writers
+  // hold the mutex from taking their copy until they have published it.
+  std::mutex mutex;
+  std::shared_ptr<const music_t> music;
+  std::atomic<uint64_t> generation{0};
+};
+
+void music_watcher_init(music_watcher_t &watcher, const music_t &music);
+int music_watcher_start(music_watcher_t &watcher,
+                        const std::string &path,
+                        const std::string &index_path = "");
+void music_watcher_stop(music_watcher_t &watcher);
+std::shared_ptr<const music_t> music_watcher_library(const music_watcher_t &watcher);
+size_t music_watcher_set_replaygain(music_watcher_t &watcher,
+                                    const std::map<std::string, replaygain_t> &replaygains);
+
+#endif // ZP3_WATCHER_HPP
@@ -1,14 +1,157 @@
 #include "zp3.hpp"
 
+#if ZP3_DISPLAY == DISPLAY_HARDWARE
+// Buttons, active low: GPIO pin -> key
+static const struct {
+  int pin;
+  char key;
+} zp3_buttons[] = {{17, 'k'}, {27, 'j'}, {22, 'h'}, {23, 'l'}};
+#endif
+
+static int zp3_init_events(zp3_t &zp3) {
+  if (event_loop_init(zp3.events, STDIN_FILENO) != 0) {
+    return -1;
+  }
+
+  // Player
+  zp3.player.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (zp3.player.event_fd == -1
+      || event_loop_add_fd(zp3.events, zp3.player.event_fd, EVENT_PLAYER) != 0) {
+    LOG_WARN("Player events will not be picked up!");
+  }
+
+  // Buttons
+#if ZP3_DISPLAY == DISPLAY_HARDWARE
+  for (const auto &button : zp3_buttons) {
+    if (event_loop_add_button(zp3.events, button.pin, button.key) != 0) {
+      LOG_WARN("Failed to set up button on GPIO [%d]!", button.pin);
+    }
+  }
+#endif
+
+  // Timing log
+  const char *timing_log = getenv(ZP3_TIMING_LOG);
+  if (timing_log != NULL) {
+    zp3.events.timing_log = fopen(timing_log, "w");
+    if (zp3.events.timing_log == NULL) {
+      LOG_WARN("Failed to open timing log [%s]!", timing_log);
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Level songs by album once the loudness scanner has measured any of the
+ * songs in `music`, songs that have not been scanned yet fall back to their
+ * tags. Scan results are published while running, so this is checked again
+ * whenever playback starts.
+ */
+static void zp3_update_replaygain(zp3_t &zp3, const music_t &music) {
+  if (zp3.player.replaygain != PLAYER_REPLAYGAIN_OFF) {
+    return;
+  }
+
+  for (const auto &chunk : music.songs.chunks) {
+    for (const auto &replaygain : chunk->replaygains) {
+      if (replaygain.analysed) {
+        zp3.player.replaygain = PLAYER_REPLAYGAIN_ALBUM;
+        return;
+      }
+    }
+  }
+}
+
+/**
+ * Stop the background jobs and exit. The loudness scanner saves what it has
+ * measured so far, so the next scan resumes from there.
+ */
+static void zp3_quit(zp3_t &zp3) {
+  music_scanner_stop(zp3.scanner);
+  music_watcher_stop(zp3.library);
+  exit(0);
+}
+
 int zp3_init(zp3_t &zp3, const std::string &music_path) {
-  if (music_load_library(zp3.music, music_path)) {
+  zp3.start = tic();
+
+  const std::string index_path = music_path + "/" ZP3_LIBRARY_INDEX;
+  music_t music;
+  if (music_load_library(music, music_path, index_path)) {
     LOG_ERROR("Failed to load music library [%s]!", music_path.c_str());
   }
+
+  // Keep library up to date while running
+  music_watcher_init(zp3.library, music);
+  if (music_watcher_start(zp3.library, music_path, index_path) != 0) {
+    LOG_WARN("Library changes will not be picked up until restart!");
+  }
+  player_init();
   zp3.player.display = &zp3.display;
+  music_seek_store_load(zp3.seek_store, music_path + "/" ZP3_SEEK_INDEX);
+  zp3.player.seek_store = &zp3.seek_store;
+
+  zp3_update_replaygain(zp3, music);
+
+  // Index and measure the loudness of songs that have not been scanned yet,
+  // in the background once decoders are initialized
+  zp3.scanner.library = &zp3.library;
+  zp3.scanner.seek_store = &zp3.seek_store;
+  if (music_scanner_start(zp3.scanner, index_path) != 0) {
+    LOG_WARN("Loudness of new songs will not be measured!");
+  }
+
+  // Input
+  if (zp3_init_events(zp3) != 0) {
+    LOG_ERROR("Failed to initialize event loop!");
+    return -1;
+  }
 
   return 0;
 }
 
+/**
+ * Wait for the next key press, or `ZP3_PLAYER_EVENT` if the player signals a
+ * change first. Marquees on screen keep scrolling while waiting.
+ *
+ * Being called again means the previous key has been handled and its frame
+ * drawn, so that is when its latency goes to the timing log.
+ */
+static int zp3_getch(zp3_t &zp3) {
+  if (zp3.started == false) {
+    event_loop_log_time(zp3.events, "startup", zp3.start);
+    zp3.started = true;
+  }
+  if (zp3.key_pending) {
+    event_loop_log_time(zp3.events, "key", zp3.key_time);
+    zp3.key_pending = false;
+  }
+
+  while (true) {
+    const bool animating = display_animating(zp3.display);
+    event_loop_set_timer(zp3.events, animating ? DISPLAY_MARQUEE_PERIOD_MS : 0);
+
+    event_t event;
+    if (event_loop_wait(zp3.events, event, -1) != 0) {
+      FATAL("Event loop failed!");
+    }
+
+    switch (event.type) {
+      case EVENT_KEY:
+        zp3.key_time = event.time;
+        zp3.key_pending = true;
+        return event.key;
+      case EVENT_TIMER:
+        display_tick(zp3.display);
+        break;
+      case EVENT_PLAYER:
+        return ZP3_PLAYER_EVENT;
+      default:
+        break;
+    }
+  }
+}
+
 int zp3_menu_mode(zp3_t &zp3) {
   LOG_INFO("Menu mode");
   zp3.target_artist = "";
@@ -17,7 +160,7 @@ int zp3_menu_mode(zp3_t &zp3) {
   int menu_index = zp3.main_menu_idx;
   display_show_menu(zp3.display, menu_index);
   while (true) {
-    switch (getch()) {
+    switch (zp3_getch(zp3)) {
       case 'j':
         menu_index++;
         menu_index = (menu_index > 2) ? 2 : menu_index;
@@ -32,7 +175,8 @@ int zp3_menu_mode(zp3_t &zp3) {
         display_clear(zp3.display);
         return menu_index + 1;
       case 'q':
-        exit(0);
+        zp3_quit(zp3);
+        break;
       default:
         continue;
     }
@@ -47,11 +191,15 @@ int zp3_player_mode(zp3_t &zp3) {
   LOG_INFO("Player mode");
   player_play(zp3.player);
 
-  // Listen for keyboard events
+  // Listen for keyboard and player events
   while (true) {
-    // display_song(&zp3, zp3.song_queue.at(zp3.song_index));
-
-    switch (getch()) {
+    switch (zp3_getch(zp3)) {
+      case ZP3_PLAYER_EVENT:
+        if (zp3.player.player_is_dead == false) {
+          continue;
+        }
+        // Play queue finished, go back
+        /* fall through */
       case 'h': {
         player_stop(zp3.player);
         display_clear(zp3.display);
@@ -63,6 +211,12 @@ int zp3_player_mode(zp3_t &zp3) {
       case 'l':
         player_toggle_pause_play(zp3.player);
         break;
+      case 'j':
+        player_seek_relative(zp3.player, -zp3.player.seek_step);
+        break;
+      case 'k':
+        player_seek_relative(zp3.player, zp3.player.seek_step);
+        break;
       case '+':
         player_volume_up(zp3.player);
         break;
@@ -82,15 +236,15 @@ int zp3_songs_mode(zp3_t &zp3) {
   int menu_idx = zp3.player.song_index;
 
   // Listen for keyboard events
-  const auto music = zp3.music;
+  const auto music = music_watcher_library(zp3.library);
   const auto artist = zp3.target_artist;
   const auto album = zp3.target_album;
-  const auto songs = music_filter_songs(music, artist, album);
+  const auto songs = music_filter_songs(*music, artist, album);
   display_show_songs(zp3.display, songs, menu_idx);
 
-  int max_entries = zp3.music.songs.size() - 1;
+  int max_entries = songs.size - 1;
   while (true) {
-    switch (getch()) {
+    switch (zp3_getch(zp3)) {
       case 'h': {
         display_clear(zp3.display);
         zp3.player.song_index = 0;
@@ -107,10 +261,9 @@ int zp3_songs_mode(zp3_t &zp3) {
         menu_idx = (menu_idx < 0) ? 0 : menu_idx;
         break;
       case 'l': {
-        const auto music = zp3.music;
-        const auto artist = zp3.target_artist;
-        const auto album = zp3.target_album;
-        zp3.player.song_queue = music_filter_songs(music, artist, album);
+        zp3_update_replaygain(zp3, *music_watcher_library(zp3.library));
+        zp3.player.library = music;
+        zp3.player.song_queue = songs;
         zp3.player.song_index = menu_idx;
         zp3.history.push_back(SONGS);
         return PLAYER;
@@ -126,13 +279,13 @@ int zp3_songs_mode(zp3_t &zp3) {
 int zp3_artists_mode(zp3_t &zp3) {
   LOG_INFO("Artists mode");
   int menu_idx = zp3.artists_menu_idx;
-  std::string artist = display_show_artists(zp3.display,
-                                            zp3.music.artists,
-                                            menu_idx);
+  const auto music = music_watcher_library(zp3.library);
+  const auto artists = music_filter_artists(*music);
+  std::string artist = display_show_artists(zp3.display, artists, menu_idx);
 
-  int max_entries = zp3.music.artists.size() - 1;
+  int max_entries = music->artists.size() - 1;
   while (true) {
-    switch (getch()) {
+    switch (zp3_getch(zp3)) {
       case 'h': {
         display_clear(zp3.display);
         const auto mode = zp3.history.back();
@@ -158,9 +311,7 @@ int zp3_artists_mode(zp3_t &zp3) {
         continue;
     }
 
-    std::string artist = display_show_artists(zp3.display,
-                                              zp3.music.artists,
-                                              menu_idx);
+    std::string artist = display_show_artists(zp3.display, artists, menu_idx);
   }
 }
 
@@ -169,16 +320,17 @@ int zp3_albums_mode(zp3_t &zp3) {
   int menu_idx = zp3.albums_menu_idx;
 
   // Filter and show albums
+  const auto music = music_watcher_library(zp3.library);
   std::vector<std::string> album_names;
-  for (const auto &album : music_filter_albums(zp3.music, zp3.target_artist)) {
+  for (const auto &album : music_filter_albums(*music, zp3.target_artist)) {
     album_names.emplace_back(album);
   }
   std::string album = display_show_albums(zp3.display, album_names, menu_idx);
 
   // Event handler
-  int max_entries = zp3.music.albums.size() - 1;
+  int max_entries = music->albums.size() - 1;
   while (true) {
-    switch (getch()) {
+    switch (zp3_getch(zp3)) {
       case 'h': {
         display_clear(zp3.display);
         const auto mode = zp3.history.back();
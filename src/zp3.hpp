@@ -4,8 +4,11 @@
 #include "util.hpp"
 #include "log.hpp"
 #include "music.hpp"
+#include "event.hpp"
 #include "player.hpp"
 #include "display.hpp"
+#include "watcher.hpp"
+#include "scanner.hpp"
 
 // ZP3 STATES
 #define MENU 0
@@ -14,6 +17,16 @@
 #define ALBUMS 3
 #define PLAYER 4
 
+// Library and seek index files, relative to the music path
+#define ZP3_LIBRARY_INDEX ".zp3_index"
+#define ZP3_SEEK_INDEX ".zp3_seek_index"
+
+// Key returned to the modes when the player signals a change
+#define ZP3_PLAYER_EVENT -2
+
+// Environment variable naming a file to write startup and key latencies to
+#define ZP3_TIMING_LOG "ZP3_TIMING_LOG"
+
 struct zp3_t {
   // State
   std::vector<int> history;
@@ -23,9 +36,18 @@ struct zp3_t {
   int artists_menu_idx = 0;
   int albums_menu_idx = 0;
 
-  music_t music;
+  music_watcher_t library;
+  music_seek_store_t seek_store;
+  music_scanner_t scanner;
   display_t display;
   player_t player;
+
+  // Input
+  event_loop_t events;
+  struct timespec start;
+  struct timespec key_time;
+  bool started = false;
+  bool key_pending = false;
 };
 
 int zp3_init(zp3_t &zp3, const std::string &music_path);